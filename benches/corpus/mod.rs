@@ -0,0 +1,120 @@
+// Fixed-seed message corpora shared by the benches. Same seed, same text on
+// every run, so numbers are comparable across commits.
+
+#![allow(dead_code)] // each bench uses a subset
+
+pub struct Corpus {
+    pub name: &'static str,
+    pub messages: Vec<String>,
+}
+
+const SEED: u64 = 0x9E37_79B9_7F4A_7C15;
+const MESSAGES: usize = 64;
+// Very large messages are few per corpus; each is ~64 KiB.
+const LARGE_MESSAGES: usize = 4;
+
+// xorshift64*: enough to vary word choice without pulling in rand.
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545_F491_4F6C_DD1D)
+    }
+
+    fn pick<'a>(&mut self, items: &[&'a str]) -> &'a str {
+        items[(self.next() % items.len() as u64) as usize]
+    }
+}
+
+const WORDS: &[&str] = &[
+    "the", "room", "key", "sync", "server", "thread", "reply", "please", "check", "build",
+    "merge", "tonight", "works", "for", "me", "again", "after", "restart", "link", "ok",
+];
+const EMOJI: &[&str] = &["😀", "🎉", "👍", "🔥", "❤️", "🙈", "🚀", "🤔", "👨‍👩‍👧", "🇳🇱"];
+const TAGS: &[(&str, &str)] = &[
+    ("<b>", "</b>"),
+    ("<i>", "</i>"),
+    ("<code>", "</code>"),
+    ("<a href=\"https://example.org/x?a=1&b=2\">", "</a>"),
+    ("<font color=\"#ff0000\">", "</font>"),
+    ("<span data-mx-spoiler>", "</span>"),
+    ("<script>", "</script>"),
+    ("<img src=\"mxc://example.org/abc\" onerror=\"x()\">", ""),
+];
+
+fn plain(rng: &mut Rng, words: usize) -> String {
+    let mut s = String::new();
+    for i in 0..words {
+        if i > 0 { s.push(' '); }
+        s.push_str(rng.pick(WORDS));
+    }
+    s
+}
+
+fn html(rng: &mut Rng, words: usize) -> String {
+    let mut s = String::from("<p>");
+    for i in 0..words {
+        if i > 0 { s.push(' '); }
+        if rng.next() % 3 == 0 {
+            let (open, close) = TAGS[(rng.next() % TAGS.len() as u64) as usize];
+            s.push_str(open);
+            s.push_str(rng.pick(WORDS));
+            s.push_str(close);
+        } else {
+            s.push_str(rng.pick(WORDS));
+        }
+    }
+    s.push_str("</p><blockquote>quoted &amp; <del>struck</del></blockquote><ul><li>one</li><li>two</li></ul>");
+    s
+}
+
+fn emoji(rng: &mut Rng, words: usize) -> String {
+    let mut s = String::new();
+    for i in 0..words {
+        if i > 0 { s.push(' '); }
+        s.push_str(if rng.next() % 2 == 0 { rng.pick(EMOJI) } else { rng.pick(WORDS) });
+    }
+    s
+}
+
+// Markdown-ish input, as typed into the conversation window.
+fn markdown(rng: &mut Rng, words: usize) -> String {
+    let mut s = format!("**{}** _{}_ `{}`\n\n", rng.pick(WORDS), rng.pick(WORDS), rng.pick(WORDS));
+    s.push_str("- ");
+    s.push_str(&plain(rng, words / 2));
+    s.push_str("\n- ~~");
+    s.push_str(&plain(rng, 3));
+    s.push_str("~~\n\n> ");
+    s.push_str(&plain(rng, words / 2));
+    s
+}
+
+fn build(name: &'static str, salt: u64, count: usize, f: impl Fn(&mut Rng) -> String) -> Corpus {
+    let mut rng = Rng(SEED ^ salt);
+    Corpus { name, messages: (0..count).map(|_| f(&mut rng)).collect() }
+}
+
+pub fn all() -> Vec<Corpus> {
+    vec![
+        build("plain", 1, MESSAGES, |r| { let n = 4 + (r.next() % 24) as usize; plain(r, n) }),
+        build("html_heavy", 2, MESSAGES, |r| { let n = 8 + (r.next() % 40) as usize; html(r, n) }),
+        build("emoji_heavy", 3, MESSAGES, |r| { let n = 4 + (r.next() % 24) as usize; emoji(r, n) }),
+        build("very_large", 4, LARGE_MESSAGES, |r| html(r, 10_000)),
+    ]
+}
+
+pub fn markdown_corpora() -> Vec<Corpus> {
+    vec![
+        build("plain", 1, MESSAGES, |r| { let n = 4 + (r.next() % 24) as usize; plain(r, n) }),
+        build("markdown", 5, MESSAGES, |r| { let n = 8 + (r.next() % 40) as usize; markdown(r, n) }),
+        build("emoji_heavy", 3, MESSAGES, |r| { let n = 4 + (r.next() % 24) as usize; emoji(r, n) }),
+        build("very_large", 6, LARGE_MESSAGES, |r| markdown(r, 10_000)),
+    ]
+}
+
+pub fn bytes(corpus: &Corpus) -> u64 {
+    corpus.messages.iter().map(|m| m.len() as u64).sum()
+}
@@ -0,0 +1,92 @@
+// FfiEvent -> C struct conversion in purple_matrix_rust_poll_event, and the
+// matching purple_matrix_rust_free_event, for MessageReceived events built
+// from the shared corpora. Only the call under test is timed; queueing the
+// events and cleaning up after them are not.
+//
+//   cargo bench --bench ffi_events
+
+use std::os::raw::c_void;
+use std::time::{Duration, Instant};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use purple_matrix_rust::ffi::{self, FfiEvent, EVENTS_CHANNEL};
+use purple_matrix_rust::intern;
+
+mod corpus;
+
+fn enqueue(messages: &[String]) {
+    for (i, msg) in messages.iter().enumerate() {
+        let _ = EVENTS_CHANNEL.0.send(FfiEvent::MessageReceived {
+            user_id: intern::id("@bench:example.org"),
+            sender: intern::id("@alice:example.org"),
+            msg: msg.clone(),
+            room_id: Some(intern::id("!bench:example.org")),
+            thread_root_id: if i % 4 == 0 { Some("$root:example.org".to_string()) } else { None },
+            event_id: format!("$bench{}:example.org", i),
+            timestamp: 1_700_000_000_000 + i as u64,
+            encrypted: i % 2 == 0,
+        });
+    }
+}
+
+fn poll_all(out: &mut Vec<(i32, *mut c_void)>) {
+    let mut ev_type = 0i32;
+    let mut data: *mut c_void = std::ptr::null_mut();
+    let mut span = 0u64;
+    while ffi::purple_matrix_rust_poll_event(&mut ev_type, &mut data, &mut span) {
+        out.push((ev_type, data));
+    }
+}
+
+fn free_all(events: &mut Vec<(i32, *mut c_void)>) {
+    for (ev_type, data) in events.drain(..) {
+        ffi::purple_matrix_rust_free_event(ev_type, data);
+    }
+}
+
+fn bench_poll_event(c: &mut Criterion) {
+    let mut group = c.benchmark_group("poll_event");
+    for corpus in corpus::all() {
+        group.throughput(Throughput::Elements(corpus.messages.len() as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            let mut events = Vec::with_capacity(corpus.messages.len());
+            b.iter_custom(|iters| {
+                let mut total = Duration::ZERO;
+                for _ in 0..iters {
+                    enqueue(&corpus.messages);
+                    let started = Instant::now();
+                    poll_all(&mut events);
+                    total += started.elapsed();
+                    free_all(&mut events);
+                }
+                total
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_free_event(c: &mut Criterion) {
+    let mut group = c.benchmark_group("free_event");
+    for corpus in corpus::all() {
+        group.throughput(Throughput::Elements(corpus.messages.len() as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            let mut events = Vec::with_capacity(corpus.messages.len());
+            b.iter_custom(|iters| {
+                let mut total = Duration::ZERO;
+                for _ in 0..iters {
+                    enqueue(&corpus.messages);
+                    poll_all(&mut events);
+                    let started = Instant::now();
+                    free_all(&mut events);
+                    total += started.elapsed();
+                }
+                total
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_poll_event, bench_free_event);
+criterion_main!(benches);
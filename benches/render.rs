@@ -0,0 +1,103 @@
+// Rendering hot paths: what every incoming message goes through before it
+// reaches C, plus markdown for every outgoing one.
+//
+//   cargo bench --bench render
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use matrix_sdk::ruma::events::room::message::RoomMessageEventContent;
+
+mod corpus;
+
+fn bench_sanitize_matrix_html(c: &mut Criterion) {
+    let mut group = c.benchmark_group("sanitize_matrix_html");
+    for corpus in corpus::all() {
+        group.throughput(Throughput::Bytes(corpus::bytes(&corpus)));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            b.iter(|| {
+                for msg in &corpus.messages {
+                    black_box(purple_matrix_rust::html_fmt::sanitize_matrix_html(black_box(msg)));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_escape_html(c: &mut Criterion) {
+    let mut group = c.benchmark_group("escape_html");
+    for corpus in corpus::all() {
+        group.throughput(Throughput::Bytes(corpus::bytes(&corpus)));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            b.iter(|| {
+                for msg in &corpus.messages {
+                    black_box(purple_matrix_rust::escape_html(black_box(msg)));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_sanitize_string(c: &mut Criterion) {
+    let mut group = c.benchmark_group("sanitize_string");
+    for corpus in corpus::all() {
+        group.throughput(Throughput::Bytes(corpus::bytes(&corpus)));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            b.iter(|| {
+                for msg in &corpus.messages {
+                    black_box(purple_matrix_rust::sanitize_string(black_box(msg)));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_create_message_content(c: &mut Criterion) {
+    let mut group = c.benchmark_group("create_message_content");
+    for corpus in corpus::markdown_corpora() {
+        group.throughput(Throughput::Bytes(corpus::bytes(&corpus)));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &corpus, |b, corpus| {
+            b.iter(|| {
+                for msg in &corpus.messages {
+                    black_box(purple_matrix_rust::create_message_content(black_box(msg.clone())));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_get_display_html(c: &mut Criterion) {
+    let mut group = c.benchmark_group("get_display_html");
+    for corpus in corpus::all() {
+        // Formatted HTML bodies go through the sanitizer, plain ones through
+        // escaping; the plain corpora arrive without a formatted body.
+        let contents: Vec<RoomMessageEventContent> = corpus.messages.iter()
+            .map(|m| if m.contains('<') {
+                RoomMessageEventContent::text_html(m.clone(), m.clone())
+            } else {
+                RoomMessageEventContent::text_plain(m.clone())
+            })
+            .collect();
+        group.throughput(Throughput::Bytes(corpus::bytes(&corpus)));
+        group.bench_with_input(BenchmarkId::from_parameter(corpus.name), &contents, |b, contents| {
+            b.iter(|| {
+                for content in contents {
+                    black_box(purple_matrix_rust::get_display_html(black_box(content)));
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_sanitize_matrix_html,
+    bench_escape_html,
+    bench_sanitize_string,
+    bench_create_message_content,
+    bench_get_display_html
+);
+criterion_main!(benches);
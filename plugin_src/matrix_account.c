@@ -46,6 +46,8 @@ void matrix_login(PurpleAccount *account) {
   }
 
   purple_connection_set_state(gc, PURPLE_CONNECTING);
+  matrix_forget_account_id(account);
+  matrix_register_account_id(account, username);
 
   char *safe_username = g_strdup(username);
   for (char *p = safe_username; *p; p++)
@@ -56,6 +58,9 @@ void matrix_login(PurpleAccount *account) {
   if (!g_file_test(data_dir, G_FILE_TEST_EXISTS))
     g_mkdir_with_parents(data_dir, 0700);
 
+  purple_matrix_rust_set_upload_max_image_dim(
+      username, get_upload_max_image_dim(account));
+
   /* ALWAYS returns 2 (Pending) now, connected state handled by connected_cb */
   purple_matrix_rust_login(username, password, homeserver, data_dir);
 
@@ -68,6 +73,8 @@ void matrix_login(PurpleAccount *account) {
 void matrix_close(PurpleConnection *gc) {
   PurpleAccount *account = purple_connection_get_account(gc);
   purple_matrix_rust_logout(purple_account_get_username(account));
+  matrix_forget_account_id(account);
+  matrix_blist_forget_account(account);
 }
 
 void manual_sso_token_action_cb(void *user_data, PurpleRequestFields *fields) {
@@ -122,6 +129,11 @@ static gboolean process_sso_cb(gpointer data) {
 void sso_url_cb(const char *url) { g_idle_add(process_sso_cb, g_strdup(url)); }
 
 static gboolean process_connected_cb(gpointer data) {
+  char *user_id = (char *)data;
+  /* Map the server-resolved MXID to its account before any room events. */
+  find_matrix_account_by_id(user_id);
+  g_free(user_id);
+
   GList *connections = purple_connections_get_all();
   for (GList *l = connections; l != NULL; l = l->next) {
     PurpleConnection *gc = (PurpleConnection *)l->data;
@@ -136,7 +148,7 @@ static gboolean process_connected_cb(gpointer data) {
 }
 
 void connected_cb(const char *user_id) {
-  g_idle_add(process_connected_cb, NULL);
+  g_idle_add(process_connected_cb, g_strdup(user_id));
 }
 
 static gboolean process_login_failed_cb(gpointer data) {
@@ -17,6 +17,101 @@
 static PurpleRoomlist *active_roomlist = NULL;
 static GHashTable *roomlist_nodes = NULL;
 
+/* PurpleAccount* -> (room_id / virtual thread id -> PurpleChat*).
+ * Each account's table is seeded from the buddy list on first lookup and kept
+ * current through explicit inserts and the blist-node-added/removed signals,
+ * so purple_blist_find_chat's full-list walk never runs per sync event. */
+static GHashTable *chat_index = NULL;
+/* PurpleAccount* -> (room_id -> MatrixRoomSnapshot*) */
+static GHashTable *room_snapshots = NULL;
+
+static const char *chat_index_key(PurpleChat *chat) {
+  GHashTable *components = purple_chat_get_components(chat);
+  return components ? g_hash_table_lookup(components, "room_id") : NULL;
+}
+
+static GHashTable *chat_index_for_account(PurpleAccount *account) {
+  if (!chat_index)
+    chat_index = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                       (GDestroyNotify)g_hash_table_destroy);
+  GHashTable *table = g_hash_table_lookup(chat_index, account);
+  if (table)
+    return table;
+
+  table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_insert(chat_index, account, table);
+  for (PurpleBlistNode *gnode = purple_blist_get_root(); gnode;
+       gnode = gnode->next) {
+    if (!PURPLE_BLIST_NODE_IS_GROUP(gnode))
+      continue;
+    for (PurpleBlistNode *cnode = gnode->child; cnode; cnode = cnode->next) {
+      if (!PURPLE_BLIST_NODE_IS_CHAT(cnode))
+        continue;
+      PurpleChat *chat = (PurpleChat *)cnode;
+      if (purple_chat_get_account(chat) != account)
+        continue;
+      const char *room_id = chat_index_key(chat);
+      if (room_id && !g_hash_table_contains(table, room_id))
+        g_hash_table_insert(table, g_strdup(room_id), chat);
+    }
+  }
+  return table;
+}
+
+PurpleChat *matrix_blist_find_chat(PurpleAccount *account,
+                                   const char *room_id) {
+  if (!account || !room_id || !*room_id)
+    return NULL;
+  return g_hash_table_lookup(chat_index_for_account(account), room_id);
+}
+
+static void chat_index_insert(PurpleChat *chat) {
+  PurpleAccount *account = purple_chat_get_account(chat);
+  const char *room_id = chat_index_key(chat);
+  if (!account || !room_id || !*room_id)
+    return;
+  g_hash_table_replace(chat_index_for_account(account), g_strdup(room_id),
+                       chat);
+}
+
+void matrix_blist_node_added_cb(PurpleBlistNode *node) {
+  if (!chat_index || !node || !PURPLE_BLIST_NODE_IS_CHAT(node))
+    return;
+  PurpleChat *chat = (PurpleChat *)node;
+  /* Accounts not yet indexed pick the node up when their table is seeded. */
+  if (g_hash_table_lookup(chat_index, purple_chat_get_account(chat)))
+    chat_index_insert(chat);
+}
+
+void matrix_blist_node_removed_cb(PurpleBlistNode *node) {
+  if (!chat_index || !node || !PURPLE_BLIST_NODE_IS_CHAT(node))
+    return;
+  PurpleChat *chat = (PurpleChat *)node;
+  GHashTable *table =
+      g_hash_table_lookup(chat_index, purple_chat_get_account(chat));
+  const char *room_id = chat_index_key(chat);
+  if (table && room_id && g_hash_table_lookup(table, room_id) == chat)
+    g_hash_table_remove(table, room_id);
+}
+
+void matrix_blist_forget_account(PurpleAccount *account) {
+  if (chat_index && account)
+    g_hash_table_remove(chat_index, account);
+  if (room_snapshots && account)
+    g_hash_table_remove(room_snapshots, account);
+}
+
+void matrix_blist_cleanup(void) {
+  if (chat_index) {
+    g_hash_table_destroy(chat_index);
+    chat_index = NULL;
+  }
+  if (room_snapshots) {
+    g_hash_table_destroy(room_snapshots);
+    room_snapshots = NULL;
+  }
+}
+
 typedef struct {
   PurpleAccount *account;
   char *target_user_id;
@@ -76,6 +171,106 @@ void cleanup_stale_thread_labels(PurpleAccount *account) {
   }
 }
 
+/* Last room attributes applied to the blist, per account and room, so repeat
+ * RoomJoined/tag events that carry nothing new are dropped before any string
+ * stripping, group lookup, g_file_test or blist write. */
+typedef struct {
+  char *name;
+  char *group_name;
+  char *avatar_url;
+  char *topic;
+  gboolean encrypted;
+  guint64 member_count;
+} MatrixRoomSnapshot;
+
+static void room_snapshot_free(MatrixRoomSnapshot *snap) {
+  g_free(snap->name);
+  g_free(snap->group_name);
+  g_free(snap->avatar_url);
+  g_free(snap->topic);
+  g_free(snap);
+}
+
+static MatrixRoomSnapshot *room_snapshot_get(PurpleAccount *account,
+                                             const char *room_id) {
+  if (!room_snapshots)
+    room_snapshots = g_hash_table_new_full(
+        g_direct_hash, g_direct_equal, NULL,
+        (GDestroyNotify)g_hash_table_destroy);
+  GHashTable *rooms = g_hash_table_lookup(room_snapshots, account);
+  if (!rooms) {
+    rooms = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)room_snapshot_free);
+    g_hash_table_insert(room_snapshots, account, rooms);
+  }
+  MatrixRoomSnapshot *snap = g_hash_table_lookup(rooms, room_id);
+  if (!snap) {
+    snap = g_new0(MatrixRoomSnapshot, 1);
+    g_hash_table_insert(rooms, g_strdup(room_id), snap);
+  }
+  return snap;
+}
+
+static gboolean snapshot_set_str(char **slot, const char *value) {
+  if (g_strcmp0(*slot, value) == 0)
+    return FALSE;
+  g_free(*slot);
+  *slot = g_strdup(value);
+  return TRUE;
+}
+
+/* Folds the fields carried by `d` into `snap`; returns the ones that changed. */
+static guint room_snapshot_merge(MatrixRoomSnapshot *snap,
+                                 const MatrixRoomData *d) {
+  guint changed = 0;
+  if ((d->fields & MATRIX_ROOM_FIELD_NAME) &&
+      snapshot_set_str(&snap->name, d->name))
+    changed |= MATRIX_ROOM_FIELD_NAME;
+  if ((d->fields & MATRIX_ROOM_FIELD_GROUP) &&
+      snapshot_set_str(&snap->group_name, d->group_name))
+    changed |= MATRIX_ROOM_FIELD_GROUP;
+  if ((d->fields & MATRIX_ROOM_FIELD_AVATAR) && d->avatar_url &&
+      *d->avatar_url && snapshot_set_str(&snap->avatar_url, d->avatar_url))
+    changed |= MATRIX_ROOM_FIELD_AVATAR;
+  if ((d->fields & MATRIX_ROOM_FIELD_TOPIC) &&
+      snapshot_set_str(&snap->topic, d->topic))
+    changed |= MATRIX_ROOM_FIELD_TOPIC;
+  if ((d->fields & MATRIX_ROOM_FIELD_ENCRYPTED) &&
+      snap->encrypted != d->encrypted) {
+    snap->encrypted = d->encrypted;
+    changed |= MATRIX_ROOM_FIELD_ENCRYPTED;
+  }
+  if ((d->fields & MATRIX_ROOM_FIELD_MEMBER_COUNT) &&
+      snap->member_count != d->member_count) {
+    snap->member_count = d->member_count;
+    changed |= MATRIX_ROOM_FIELD_MEMBER_COUNT;
+  }
+  return changed;
+}
+
+static PurpleGroup *ensure_room_group(const char *raw_group,
+                                      char **target_group_name) {
+  char *s_group = strip_emojis(raw_group ? raw_group : "Matrix Rooms");
+  const char *group_name =
+      (s_group && strlen(s_group) > 0) ? s_group : "Matrix Rooms";
+  char *name = g_strdup(group_name);
+
+  if (strstr(name, " / Threads")) {
+    gchar *clean_group = derive_base_group_from_threads_group(group_name);
+    g_free(name);
+    name = clean_group;
+  }
+  g_free(s_group);
+
+  PurpleGroup *group = purple_find_group(name);
+  if (!group) {
+    group = purple_group_new(name);
+    purple_blist_add_group(group, NULL);
+  }
+  *target_group_name = name;
+  return group;
+}
+
 static gboolean process_room_cb(gpointer data) {
   MatrixRoomData *d = (MatrixRoomData *)data;
   PurpleAccount *account = find_matrix_account_by_id(d->user_id);
@@ -88,130 +283,131 @@ static gboolean process_room_cb(gpointer data) {
   if (!d->room_id)
     goto cleanup;
 
-  char *s_name = strip_emojis(d->name ? d->name : "");
-  char *s_topic = strip_emojis(d->topic ? d->topic : "");
-  char *s_group = strip_emojis(d->group_name ? d->group_name : "Matrix Rooms");
-
-  const char *group_name =
-      (s_group && strlen(s_group) > 0) ? s_group : "Matrix Rooms";
-  char *target_group_name = g_strdup(group_name);
+  MatrixRoomSnapshot *snap = room_snapshot_get(account, d->room_id);
+  guint changed = room_snapshot_merge(snap, d);
+  PurpleChat *chat = matrix_blist_find_chat(account, d->room_id);
 
-  if (strstr(target_group_name, " / Threads")) {
-    gchar *clean_group = derive_base_group_from_threads_group(group_name);
-    g_free(target_group_name);
-    target_group_name = clean_group;
-  }
-
-  PurpleGroup *group = purple_find_group(target_group_name);
-  if (!group) {
-    group = purple_group_new(target_group_name);
-    purple_blist_add_group(group, NULL);
-  }
+  if (chat && changed == 0)
+    goto cleanup;
 
-  PurpleChat *chat = purple_blist_find_chat(account, d->room_id);
   if (!chat) {
+    char *target_group_name = NULL;
+    PurpleGroup *group = ensure_room_group(snap->group_name, &target_group_name);
+    char *s_name = strip_emojis(snap->name ? snap->name : "");
+    char *s_topic = strip_emojis(snap->topic ? snap->topic : "");
+
     GHashTable *components =
         g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     g_hash_table_insert(components, g_strdup("room_id"), g_strdup(d->room_id));
-    if (d->avatar_url && strlen(d->avatar_url) > 0)
+    if (snap->avatar_url)
       g_hash_table_insert(components, g_strdup("avatar_path"),
-                          g_strdup(d->avatar_url));
+                          g_strdup(snap->avatar_url));
     if (s_topic && strlen(s_topic) > 0)
       g_hash_table_insert(components, g_strdup("topic"), g_strdup(s_topic));
     g_hash_table_insert(components, g_strdup("encrypted"),
-                        g_strdup(d->encrypted ? "1" : "0"));
+                        g_strdup(snap->encrypted ? "1" : "0"));
 
     chat = purple_chat_new(account, d->room_id, components);
     purple_blist_add_chat(chat, group, NULL);
+    chat_index_insert(chat);
 
-    if (d->avatar_url && strlen(d->avatar_url) > 0) {
+    if (snap->avatar_url) {
       purple_blist_node_set_string((PurpleBlistNode *)chat, "buddy_icon",
-                                   d->avatar_url);
+                                   snap->avatar_url);
       purple_blist_node_set_string((PurpleBlistNode *)chat, "icon_path",
-                                   d->avatar_url);
+                                   snap->avatar_url);
     }
     if (s_name && strlen(s_name) > 0) {
       purple_blist_alias_chat(chat, s_name);
     }
+    changed = MATRIX_ROOM_FIELD_ALL;
+    g_free(target_group_name);
+    g_free(s_name);
+    g_free(s_topic);
   } else {
     GHashTable *components = purple_chat_get_components(chat);
-    gboolean changed = FALSE;
-    if (components) {
-      if (d->avatar_url && strlen(d->avatar_url) > 0) {
-        const char *old_avatar = g_hash_table_lookup(components, "avatar_path");
-        if (g_strcmp0(old_avatar, d->avatar_url) != 0 &&
-            g_file_test(d->avatar_url, G_FILE_TEST_EXISTS)) {
+    gboolean icon_changed = FALSE;
+    if (components && (changed & MATRIX_ROOM_FIELD_AVATAR)) {
+      const char *old_avatar = g_hash_table_lookup(components, "avatar_path");
+      if (g_strcmp0(old_avatar, snap->avatar_url) != 0) {
+        if (g_file_test(snap->avatar_url, G_FILE_TEST_EXISTS)) {
           g_hash_table_replace(components, g_strdup("avatar_path"),
-                               g_strdup(d->avatar_url));
+                               g_strdup(snap->avatar_url));
           purple_blist_node_set_string((PurpleBlistNode *)chat, "buddy_icon",
-                                       d->avatar_url);
+                                       snap->avatar_url);
           purple_blist_node_set_string((PurpleBlistNode *)chat, "icon_path",
-                                       d->avatar_url);
-          changed = TRUE;
-        }
-      }
-      if (s_topic && strlen(s_topic) > 0) {
-        const char *old_topic = g_hash_table_lookup(components, "topic");
-        if (g_strcmp0(old_topic, s_topic) != 0) {
-          g_hash_table_replace(components, g_strdup("topic"),
-                               g_strdup(s_topic));
-          changed = TRUE;
+                                       snap->avatar_url);
+          icon_changed = TRUE;
+        } else {
+          /* Not on disk yet: forget it so the next update retries. */
+          g_free(snap->avatar_url);
+          snap->avatar_url = NULL;
         }
       }
-      const char *old_enc = g_hash_table_lookup(components, "encrypted");
-      const char *new_enc = d->encrypted ? "1" : "0";
-      if (g_strcmp0(old_enc, new_enc) != 0) {
+    }
+    if (components && (changed & MATRIX_ROOM_FIELD_TOPIC)) {
+      char *s_topic = strip_emojis(snap->topic ? snap->topic : "");
+      if (s_topic && strlen(s_topic) > 0 &&
+          g_strcmp0(g_hash_table_lookup(components, "topic"), s_topic) != 0)
+        g_hash_table_replace(components, g_strdup("topic"), g_strdup(s_topic));
+      g_free(s_topic);
+    }
+    if (components && (changed & MATRIX_ROOM_FIELD_ENCRYPTED)) {
+      const char *new_enc = snap->encrypted ? "1" : "0";
+      if (g_strcmp0(g_hash_table_lookup(components, "encrypted"), new_enc) !=
+          0) {
         g_hash_table_replace(components, g_strdup("encrypted"),
                              g_strdup(new_enc));
-        changed = TRUE;
+        icon_changed = TRUE;
       }
     }
 
-    PurpleBlistNode *parent = PURPLE_BLIST_NODE(chat)->parent;
-    const char *cur_grp = (parent && PURPLE_BLIST_NODE_IS_GROUP(parent))
-                              ? purple_group_get_name((PurpleGroup *)parent)
-                              : NULL;
-    if (!cur_grp || g_strcmp0(cur_grp, target_group_name) != 0) {
-      purple_blist_add_chat(chat, group, NULL);
-      changed = TRUE;
+    if (changed & MATRIX_ROOM_FIELD_GROUP) {
+      char *target_group_name = NULL;
+      PurpleGroup *group =
+          ensure_room_group(snap->group_name, &target_group_name);
+      PurpleBlistNode *parent = PURPLE_BLIST_NODE(chat)->parent;
+      const char *cur_grp = (parent && PURPLE_BLIST_NODE_IS_GROUP(parent))
+                                ? purple_group_get_name((PurpleGroup *)parent)
+                                : NULL;
+      if (!cur_grp || g_strcmp0(cur_grp, target_group_name) != 0)
+        purple_blist_add_chat(chat, group, NULL);
+      g_free(target_group_name);
     }
 
-    if (s_name && strlen(s_name) > 0) {
-      const char *old_alias = chat->alias;
-      if (g_strcmp0(old_alias, s_name) != 0) {
+    if (changed & MATRIX_ROOM_FIELD_NAME) {
+      char *s_name = strip_emojis(snap->name ? snap->name : "");
+      if (s_name && strlen(s_name) > 0 && g_strcmp0(chat->alias, s_name) != 0)
         purple_blist_alias_chat(chat, s_name);
-        changed = TRUE;
-      }
+      g_free(s_name);
     }
 
-    if (changed) {
+    if (icon_changed) {
       purple_blist_update_node_icon((PurpleBlistNode *)chat);
     }
   }
 
   /* Set conversation data if the chat window is open */
-  PurpleConversation *conv = purple_find_conversation_with_account(
-      PURPLE_CONV_TYPE_CHAT, d->room_id, account);
-  if (conv) {
-    char mc_buf[32];
-    g_snprintf(mc_buf, sizeof(mc_buf), "%" G_GUINT64_FORMAT, d->member_count);
-
-    g_free(purple_conversation_get_data(conv, "matrix_room_encrypted"));
-    purple_conversation_set_data(conv, "matrix_room_encrypted",
-                                 g_strdup(d->encrypted ? "1" : "0"));
-
-    g_free(purple_conversation_get_data(conv, "matrix_room_member_count"));
-    purple_conversation_set_data(conv, "matrix_room_member_count",
-                                 g_strdup(mc_buf));
-
-    matrix_ui_refresh_room_chips(conv);
+  if (changed & (MATRIX_ROOM_FIELD_ENCRYPTED | MATRIX_ROOM_FIELD_MEMBER_COUNT)) {
+    PurpleConversation *conv = purple_find_conversation_with_account(
+        PURPLE_CONV_TYPE_CHAT, d->room_id, account);
+    if (conv) {
+      char mc_buf[32];
+      g_snprintf(mc_buf, sizeof(mc_buf), "%" G_GUINT64_FORMAT,
+                 snap->member_count);
+
+      g_free(purple_conversation_get_data(conv, "matrix_room_encrypted"));
+      purple_conversation_set_data(conv, "matrix_room_encrypted",
+                                   g_strdup(snap->encrypted ? "1" : "0"));
+
+      g_free(purple_conversation_get_data(conv, "matrix_room_member_count"));
+      purple_conversation_set_data(conv, "matrix_room_member_count",
+                                   g_strdup(mc_buf));
+
+      matrix_ui_refresh_room_chips(conv);
+    }
   }
 
-  g_free(target_group_name);
-  g_free(s_name);
-  g_free(s_topic);
-  g_free(s_group);
-
 cleanup:
   g_free(d->user_id);
   g_free(d->room_id);
@@ -237,6 +433,7 @@ void room_joined_callback(const char *user_id, const char *room_id,
   d->topic = g_strdup(topic);
   d->encrypted = encrypted;
   d->member_count = member_count;
+  d->fields = MATRIX_ROOM_FIELD_ALL;
   g_idle_add(process_room_cb, d);
 }
 
@@ -350,6 +547,7 @@ void room_tag_callback(const char *user_id, const char *room_id,
     d->user_id = g_strdup(user_id);
     d->room_id = g_strdup(room_id);
     d->group_name = g_strdup(tag);
+    d->fields = MATRIX_ROOM_FIELD_GROUP;
     g_idle_add(process_room_cb, d);
   }
 }
@@ -365,7 +563,7 @@ void ensure_thread_in_blist(PurpleAccount *account, const char *virtual_id,
 
   char *group_name = NULL;
   if (parent_room_id) {
-    PurpleChat *pchat = purple_blist_find_chat(account, parent_room_id);
+    PurpleChat *pchat = matrix_blist_find_chat(account, parent_room_id);
     const char *p_title =
         (pchat && pchat->alias) ? pchat->alias : parent_room_id;
     const char *p_grp =
@@ -395,13 +593,14 @@ void ensure_thread_in_blist(PurpleAccount *account, const char *virtual_id,
   } else
     nice_alias = g_strdup("Thread");
 
-  PurpleChat *chat = purple_blist_find_chat(account, virtual_id);
+  PurpleChat *chat = matrix_blist_find_chat(account, virtual_id);
   if (!chat) {
     GHashTable *comp =
         g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     g_hash_table_insert(comp, g_strdup("room_id"), g_strdup(virtual_id));
     chat = purple_chat_new(account, virtual_id, comp);
     purple_blist_add_chat(chat, group, NULL);
+    chat_index_insert(chat);
     purple_blist_alias_chat(chat, nice_alias);
   } else {
     PurpleBlistNode *parent = PURPLE_BLIST_NODE(chat)->parent;
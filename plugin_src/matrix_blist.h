@@ -30,6 +30,13 @@ void update_buddy_callback(const char *user_id, const char *alias,
                            const char *avatar_url);
 void cleanup_stale_thread_labels(PurpleAccount *account);
 
+// O(1) room_id / virtual thread id -> PurpleChat lookup (per account)
+PurpleChat *matrix_blist_find_chat(PurpleAccount *account, const char *room_id);
+void matrix_blist_node_added_cb(PurpleBlistNode *node);
+void matrix_blist_node_removed_cb(PurpleBlistNode *node);
+void matrix_blist_forget_account(PurpleAccount *account);
+void matrix_blist_cleanup(void);
+
 PurpleRoomlist *matrix_roomlist_get_list(PurpleConnection *gc);
 void matrix_roomlist_cancel(PurpleRoomlist *list);
 
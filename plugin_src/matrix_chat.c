@@ -12,9 +12,7 @@
 #include <libpurple/util.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
-#define MATRIX_PASTED_PREFIX "matrix_pasted_"
 #define MATRIX_RECENT_EVENT_SLOTS 10
 
 static void matrix_conv_data_replace(PurpleConversation *conv, const char *key,
@@ -112,21 +110,18 @@ static void check_and_send_pasted_images(PurpleConnection *gc, const char *who,
     if (id > 0) {
       PurpleStoredImage *img = purple_imgstore_find_by_id(id);
       if (img) {
-        char *filename = g_build_filename(g_get_tmp_dir(),
-                                          MATRIX_PASTED_PREFIX "XXXXXX", NULL);
-        int fd = g_mkstemp(filename);
-        if (fd != -1) {
-          if (write(fd, purple_imgstore_get_data(img),
-                    purple_imgstore_get_size(img)) > 0) {
-            close(fd);
-            purple_matrix_rust_send_file(
-                purple_account_get_username(purple_connection_get_account(gc)),
-                who, filename);
-          } else {
-            close(fd);
-          }
+        const char *filename = purple_imgstore_get_filename(img);
+        char *fallback = NULL;
+        if (!filename || !*filename) {
+          const char *ext = purple_imgstore_get_extension(img);
+          fallback = g_strdup_printf("image.%s", ext ? ext : "png");
+          filename = fallback;
         }
-        g_free(filename);
+        purple_matrix_rust_send_image_bytes(
+            purple_account_get_username(purple_connection_get_account(gc)),
+            who, filename, purple_imgstore_get_data(img),
+            purple_imgstore_get_size(img));
+        g_free(fallback);
       }
     }
   }
@@ -153,63 +148,81 @@ int matrix_send_chat(PurpleConnection *gc, int id, const char *message,
   if (!conv)
     return -1;
   const char *room_id = purple_conversation_get_name(conv);
+  const char *thread_sep = strchr(room_id, '|');
+  time_t now = time(NULL);
+  char *txn_id = matrix_new_txn_id();
   check_and_send_pasted_images(gc, room_id, message);
   purple_conv_chat_write(PURPLE_CONV_CHAT(conv), "me", message,
-                         PURPLE_MESSAGE_SEND, time(NULL));
-  purple_matrix_rust_send_message(
+                         PURPLE_MESSAGE_SEND, now);
+  /* Tag the echo with the transaction id until the server assigns the event
+   * id (see message_sent_callback), so it can be replied to or edited. */
+  matrix_record_recent_event(
+      conv, txn_id,
+      purple_account_get_username(purple_connection_get_account(gc)), message,
+      thread_sep ? thread_sep + 1 : NULL, FALSE, (guint64)now * 1000);
+  purple_matrix_rust_send_message_txn(
       purple_account_get_username(purple_connection_get_account(gc)), room_id,
-      message);
+      message, txn_id);
+  g_free(txn_id);
   return 0;
 }
 
+/* Returning a resend interval makes Pidgin report PURPLE_TYPING again on the
+ * next keypress after it, which keeps the Rust side's idle cutoff from
+ * ending the notice while the user is still typing. Kept under the 4 s
+ * server timeout. */
+#define MATRIX_TYPING_RESEND_SECS 3
+
 unsigned int matrix_send_typing(PurpleConnection *gc, const char *name,
                                 PurpleTypingState state) {
   purple_matrix_rust_send_typing(
       purple_account_get_username(purple_connection_get_account(gc)), name,
       state == PURPLE_TYPING);
-  return 0;
+  return state == PURPLE_TYPING ? MATRIX_TYPING_RESEND_SECS : 0;
+}
+
+/* The room id to store in a marshalled struct: interned for a room id, or a
+ * copy owned through *buf for a "room|thread" conversation id, which would
+ * otherwise leave one permanent intern entry per thread. */
+static const char *matrix_room_id_ref(const char *room_id, char **buf) {
+  if (room_id && strchr(room_id, '|'))
+    return *buf = g_strdup(room_id);
+  return g_intern_string(room_id);
+}
+
+/* Frees a message marshalled by msg_callback. One that was not written to a
+ * conversation closes its trace span here. */
+static void matrix_msg_data_free(MatrixMsgData *d, gboolean displayed) {
+  if (!displayed)
+    purple_matrix_rust_trace_event(d->span_id, FFI_TRACE_DROPPED);
+  g_free(d->message);
+  g_free(d->room_id_buf);
+  g_free(d->thread_root_id);
+  g_free(d->event_id);
+  g_free(d);
 }
 
 static gboolean process_msg_cb(gpointer data) {
   MatrixMsgData *d = (MatrixMsgData *)data;
+  gboolean displayed = FALSE;
 
   if (!d->user_id || !d->room_id || !d->sender || !d->message) {
-    if (d->user_id)
-      g_free(d->user_id);
-    if (d->sender)
-      g_free(d->sender);
-    if (d->message)
-      g_free(d->message);
-    if (d->room_id)
-      g_free(d->room_id);
-    if (d->thread_root_id)
-      g_free(d->thread_root_id);
-    if (d->event_id)
-      g_free(d->event_id);
-    g_free(d);
+    matrix_msg_data_free(d, FALSE);
     return FALSE;
   }
 
   PurpleAccount *account = find_matrix_account_by_id(d->user_id);
   if (!account) {
-    g_free(d->user_id);
-    g_free(d->sender);
-    g_free(d->message);
-    g_free(d->room_id);
-    if (d->thread_root_id)
-      g_free(d->thread_root_id);
-    if (d->event_id)
-      g_free(d->event_id);
-    g_free(d);
+    matrix_msg_data_free(d, FALSE);
     return FALSE;
   }
 
   /* Signal UI that room is (potentially) encrypted if we see an encrypted msg
    */
   if (d->encrypted) {
-    purple_debug_info("matrix-ui-signal",
-                      "Dispatching matrix-ui-room-encrypted room_id=%s\n",
-                      d->room_id);
+    matrix_debug_verbose("matrix-ui-signal",
+                         "Dispatching matrix-ui-room-encrypted room_id=%s\n",
+                         d->room_id);
     purple_signal_emit(my_plugin, "matrix-ui-room-encrypted", d->room_id, TRUE);
   }
 
@@ -234,7 +247,7 @@ static gboolean process_msg_cb(gpointer data) {
         if ((int)strlen(plain) > 120)
           plain[120] = '\0';
         snippet = sanitize_markup_text(plain);
-        purple_debug_info(
+        matrix_debug_verbose(
             "matrix-ui-signal",
             "Dispatching matrix-ui-room-activity room_id=%s sender=%s\n",
             d->room_id, d->sender ? d->sender : "user");
@@ -269,17 +282,11 @@ static gboolean process_msg_cb(gpointer data) {
     if (conv) {
       purple_conversation_write(conv, "", sys_msg, PURPLE_MESSAGE_SYSTEM,
                                 d->timestamp / 1000);
+      purple_matrix_rust_trace_event(d->span_id, FFI_TRACE_DISPLAYED);
+      displayed = TRUE;
     }
     g_free(target_id);
-    g_free(d->user_id);
-    g_free(d->sender);
-    g_free(d->message);
-    g_free(d->room_id);
-    if (d->thread_root_id)
-      g_free(d->thread_root_id);
-    if (d->event_id)
-      g_free(d->event_id);
-    g_free(d);
+    matrix_msg_data_free(d, displayed);
     return FALSE;
   }
 
@@ -301,23 +308,19 @@ static gboolean process_msg_cb(gpointer data) {
 
       purple_conversation_write(conv, s_sender, s_msg, PURPLE_MESSAGE_RECV,
                                 d->timestamp / 1000);
+      purple_matrix_rust_trace_event(d->span_id, FFI_TRACE_DISPLAYED);
+      displayed = TRUE;
 
       g_free(s_msg);
       g_free(s_sender);
     } else {
-      purple_debug_info("matrix", "process_msg_cb: No conversation found for target_id=%s\n", target_id);
+      purple_debug_warning(
+          "matrix", "process_msg_cb: No conversation found for target_id=%s\n",
+          target_id);
     }
   }
 
-  g_free(d->user_id);
-  g_free(d->sender);
-  g_free(d->message);
-  g_free(d->room_id);
-  if (d->thread_root_id)
-    g_free(d->thread_root_id);
-  if (d->event_id)
-    g_free(d->event_id);
-  g_free(d);
+  matrix_msg_data_free(d, displayed);
   g_free(target_id);
   return FALSE;
 }
@@ -325,18 +328,21 @@ static gboolean process_msg_cb(gpointer data) {
 void msg_callback(const char *user_id, const char *sender, const char *msg,
                   const char *room_id, const char *thread_root_id,
                   const char *event_id, guint64 timestamp, bool encrypted) {
-  purple_debug_info("matrix", "msg_callback: sender=%s msg=%s\n", sender, msg);
+  matrix_debug_verbose("matrix", "msg_callback: event=%s sender=%s len=%zu\n",
+                       event_id ? event_id : "(local)", sender,
+                       msg ? strlen(msg) : 0);
   MatrixMsgData *d = g_new0(MatrixMsgData, 1);
-  d->user_id = g_strdup(user_id);
-  d->sender = g_strdup(sender);
+  d->user_id = g_intern_string(user_id);
+  d->sender = g_intern_string(sender);
   d->message = g_strdup(msg);
-  d->room_id = g_strdup(room_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
   if (thread_root_id)
     d->thread_root_id = g_strdup(thread_root_id);
   if (event_id)
     d->event_id = g_strdup(event_id);
   d->timestamp = timestamp;
   d->encrypted = encrypted;
+  d->span_id = matrix_current_span();
   g_idle_add(process_msg_cb, d);
 }
 
@@ -349,7 +355,7 @@ static gboolean process_typing_cb(gpointer data) {
       serv_got_typing(gc, d->who, 0,
                       d->is_typing ? PURPLE_TYPING : PURPLE_NOT_TYPING);
       /* Signal UI plugin */
-      purple_debug_info(
+      matrix_debug_verbose(
           "matrix-ui-signal",
           "Dispatching matrix-ui-room-typing room_id=%s who=%s typing=%d\n",
           d->room_id, d->who, d->is_typing);
@@ -357,9 +363,7 @@ static gboolean process_typing_cb(gpointer data) {
                          d->is_typing);
     }
   }
-  g_free(d->user_id);
-  g_free(d->room_id);
-  g_free(d->who);
+  g_free(d->room_id_buf);
   g_free(d);
   return FALSE;
 }
@@ -376,19 +380,15 @@ static gboolean process_reactions_changed_cb(gpointer data) {
       g_free(purple_conversation_get_data(conv, key));
       purple_conversation_set_data(conv, key, g_strdup(d->reactions_text));
 
-      purple_debug_info("matrix-ui-signal",
-                        "Dispatching matrix-ui-reactions-changed room_id=%s "
-                        "event_id=%s text=%s\n",
-                        d->room_id, d->event_id, d->reactions_text);
-      purple_debug_info("matrix-ui-signal",
-                        "Emitting matrix-ui-reactions-changed for room=%s event=%s\n",
-                        d->room_id, d->event_id);
+      matrix_debug_verbose("matrix-ui-signal",
+                           "Dispatching matrix-ui-reactions-changed room_id=%s "
+                           "event_id=%s\n",
+                           d->room_id, d->event_id);
       purple_signal_emit(my_plugin, "matrix-ui-reactions-changed", d->room_id,
                          d->event_id, d->reactions_text);
     }
   }
-  g_free(d->user_id);
-  g_free(d->room_id);
+  g_free(d->room_id_buf);
   g_free(d->event_id);
   g_free(d->reactions_text);
   g_free(d);
@@ -402,16 +402,15 @@ static gboolean process_message_edited_cb(gpointer data) {
     PurpleConversation *conv = purple_find_conversation_with_account(
         PURPLE_CONV_TYPE_ANY, d->room_id, account);
     if (conv) {
-      purple_debug_info("matrix-ui-signal",
-                        "Dispatching matrix-ui-message-edited room_id=%s "
-                        "event_id=%s\n",
-                        d->room_id, d->event_id);
+      matrix_debug_verbose("matrix-ui-signal",
+                           "Dispatching matrix-ui-message-edited room_id=%s "
+                           "event_id=%s\n",
+                           d->room_id, d->event_id);
       purple_signal_emit(my_plugin, "matrix-ui-message-edited", d->room_id,
                          d->event_id, d->new_msg);
     }
   }
-  g_free(d->user_id);
-  g_free(d->room_id);
+  g_free(d->room_id_buf);
   g_free(d->event_id);
   g_free(d->new_msg);
   g_free(d);
@@ -421,19 +420,84 @@ static gboolean process_message_edited_cb(gpointer data) {
 void message_edited_callback(const char *user_id, const char *room_id,
                              const char *event_id, const char *new_msg) {
   MatrixEditData *d = g_new0(MatrixEditData, 1);
-  d->user_id = g_strdup(user_id);
-  d->room_id = g_strdup(room_id);
+  d->user_id = g_intern_string(user_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
   d->event_id = g_strdup(event_id);
   d->new_msg = g_strdup(new_msg);
   g_idle_add(process_message_edited_cb, d);
 }
 
+/* Replaces a local-echo transaction id in the recent-event slots with the
+ * event id the server assigned. Returns TRUE if a slot matched. */
+static gboolean matrix_rekey_recent_event(PurpleConversation *conv,
+                                          const char *txn_id,
+                                          const char *event_id) {
+  int i;
+  char key_id[64];
+
+  if (!conv || !txn_id || !*txn_id || !event_id || !*event_id)
+    return FALSE;
+
+  for (i = 0; i < MATRIX_RECENT_EVENT_SLOTS; ++i) {
+    const char *v;
+    g_snprintf(key_id, sizeof(key_id), "matrix_recent_event_id_%d", i);
+    v = purple_conversation_get_data(conv, key_id);
+    if (v && strcmp(v, txn_id) == 0) {
+      matrix_conv_data_replace(conv, key_id, event_id);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static gboolean process_message_sent_cb(gpointer data) {
+  MatrixSentData *d = (MatrixSentData *)data;
+  PurpleAccount *account = find_matrix_account_by_id(d->user_id);
+  if (account) {
+    size_t room_len = strlen(d->room_id);
+    GList *l;
+    /* The echo lives either in the room itself or in one of its thread
+     * conversations ("room_id|thread_root"). */
+    for (l = purple_get_conversations(); l; l = l->next) {
+      PurpleConversation *conv = l->data;
+      const char *name = purple_conversation_get_name(conv);
+      if (purple_conversation_get_account(conv) != account || !name ||
+          strncmp(name, d->room_id, room_len) != 0 ||
+          (name[room_len] != '\0' && name[room_len] != '|'))
+        continue;
+      if (matrix_rekey_recent_event(conv, d->txn_id, d->event_id)) {
+        matrix_debug_verbose("matrix", "Local echo %s is event %s\n",
+                             d->txn_id, d->event_id);
+        break;
+      }
+    }
+  }
+  g_free(d->room_id_buf);
+  g_free(d->txn_id);
+  g_free(d->event_id);
+  g_free(d);
+  return FALSE;
+}
+
+void message_sent_callback(const char *user_id, const char *room_id,
+                           const char *txn_id, const char *event_id) {
+  MatrixSentData *d;
+  if (!user_id || !room_id || !txn_id || !event_id)
+    return;
+  d = g_new0(MatrixSentData, 1);
+  d->user_id = g_intern_string(user_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
+  d->txn_id = g_strdup(txn_id);
+  d->event_id = g_strdup(event_id);
+  g_idle_add(process_message_sent_cb, d);
+}
+
 void reactions_changed_callback(const char *user_id, const char *room_id,
                                 const char *event_id,
                                 const char *reactions_text) {
   MatrixReactionsData *d = g_new0(MatrixReactionsData, 1);
-  d->user_id = g_strdup(user_id);
-  d->room_id = g_strdup(room_id);
+  d->user_id = g_intern_string(user_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
   d->event_id = g_strdup(event_id);
   d->reactions_text = g_strdup(reactions_text);
   g_idle_add(process_reactions_changed_cb, d);
@@ -442,9 +506,9 @@ void reactions_changed_callback(const char *user_id, const char *room_id,
 void typing_callback(const char *user_id, const char *room_id, const char *who,
                      bool is_typing) {
   MatrixTypingData *d = g_new0(MatrixTypingData, 1);
-  d->user_id = g_strdup(user_id);
-  d->room_id = g_strdup(room_id);
-  d->who = g_strdup(who);
+  d->user_id = g_intern_string(user_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
+  d->who = g_intern_string(who);
   d->is_typing = is_typing;
   g_idle_add(process_typing_cb, d);
 }
@@ -468,10 +532,8 @@ static gboolean process_read_marker_cb(gpointer data) {
       }
     }
   }
-  g_free(d->user_id);
-  g_free(d->room_id);
+  g_free(d->room_id_buf);
   g_free(d->event_id);
-  g_free(d->who);
   g_free(d);
   return FALSE;
 }
@@ -479,10 +541,10 @@ static gboolean process_read_marker_cb(gpointer data) {
 void read_marker_cb(const char *user_id, const char *room_id,
                     const char *event_id, const char *who) {
   MatrixReadMarkerData *d = g_new0(MatrixReadMarkerData, 1);
-  d->user_id = g_strdup(user_id);
-  d->room_id = g_strdup(room_id);
+  d->user_id = g_intern_string(user_id);
+  d->room_id = matrix_room_id_ref(room_id, &d->room_id_buf);
   d->event_id = g_strdup(event_id);
-  d->who = g_strdup(who);
+  d->who = g_intern_string(who);
   g_idle_add(process_read_marker_cb, d);
 }
 
@@ -519,7 +581,7 @@ void matrix_join_chat(PurpleConnection *gc, GHashTable *data) {
     serv_got_joined_chat(gc, chat_id, room_id);
     conv = purple_find_chat(gc, chat_id);
     if (conv) {
-      PurpleChat *blist_chat = purple_blist_find_chat(account, room_id);
+      PurpleChat *blist_chat = matrix_blist_find_chat(account, room_id);
       if (blist_chat && blist_chat->alias) {
         purple_conversation_set_title(conv, blist_chat->alias);
       } else {
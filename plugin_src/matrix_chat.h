@@ -14,7 +14,10 @@ void reactions_changed_callback(const char *user_id, const char *room_id,
                                  const char *event_id,
                                  const char *reactions_text);
 void message_edited_callback(const char *user_id, const char *room_id,
-                             const char *event_id, const char *new_msg);void typing_callback(const char *user_id, const char *room_id, const char *who, bool is_typing);
+                             const char *event_id, const char *new_msg);
+void message_sent_callback(const char *user_id, const char *room_id,
+                           const char *txn_id, const char *event_id);
+void typing_callback(const char *user_id, const char *room_id, const char *who, bool is_typing);
 void read_marker_cb(const char *user_id, const char *room_id, const char *event_id, const char *who);
 
 GList *matrix_chat_info(PurpleConnection *gc);
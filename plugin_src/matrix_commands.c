@@ -121,6 +121,12 @@ static PurpleCmdRet cmd_my_profile(PurpleConversation *conv, const gchar *cmd,
                                    gchar **args, gchar **error, void *data);
 static PurpleCmdRet cmd_server_info(PurpleConversation *conv, const gchar *cmd,
                                     gchar **args, gchar **error, void *data);
+static PurpleCmdRet cmd_perf(PurpleConversation *conv, const gchar *cmd,
+                             gchar **args, gchar **error, void *data);
+static PurpleCmdRet cmd_log_filter(PurpleConversation *conv, const gchar *cmd,
+                                   gchar **args, gchar **error, void *data);
+static PurpleCmdRet cmd_replay(PurpleConversation *conv, const gchar *cmd,
+                               gchar **args, gchar **error, void *data);
 static PurpleCmdRet cmd_resync_recent(PurpleConversation *conv,
                                       const gchar *cmd, gchar **args,
                                       gchar **error, void *data);
@@ -511,7 +517,7 @@ static void dash_choice_cb(void *user_data, PurpleRequestFields *fields) {
       break;
     case 5: {
       PurpleBlistNode *node =
-          (PurpleBlistNode *)purple_blist_find_chat(account, room_id);
+          (PurpleBlistNode *)matrix_blist_find_chat(account, room_id);
       if (node)
         menu_action_room_settings_cb(node, NULL);
       break;
@@ -1457,7 +1463,7 @@ void matrix_ui_action_room_settings(const char *room_id) {
   if (!account || !room_id || !*room_id)
     return;
   PurpleBlistNode *node =
-      (PurpleBlistNode *)purple_blist_find_chat(account, room_id);
+      (PurpleBlistNode *)matrix_blist_find_chat(account, room_id);
   if (node)
     menu_action_room_settings_cb(node, NULL);
 }
@@ -3642,6 +3648,11 @@ static PurpleCmdRet cmd_help(PurpleConversation *conv, const gchar *cmd,
       "  /matrix_debug_crypto - Show detailed encryption status for this "
       "session<br/>"
       "  /matrix_server_info - Show homeserver capabilities and versions<br/>"
+      "  /matrix_perf - Show backend performance counters<br/>"
+      "  /matrix_log_filter [filter] - Set backend log filter (empty = "
+      "default)<br/>"
+      "  /matrix_replay &lt;file&gt; [speed] - Replay an event recording "
+      "(0 = as fast as possible)<br/>"
       "  /matrix_profile - Refresh and display your profile info<br/>"
       "<b>Moderation/Admin:</b><br/>"
       "  /report &lt;event_id&gt; [reason] - Report abusive content<br/>"
@@ -4148,6 +4159,56 @@ static PurpleCmdRet cmd_server_info(PurpleConversation *conv, const gchar *cmd,
   return PURPLE_CMD_RET_OK;
 }
 
+static PurpleCmdRet cmd_perf(PurpleConversation *conv, const gchar *cmd,
+                             gchar **args, gchar **error, void *data) {
+  PurpleAccount *account = purple_conversation_get_account(conv);
+  if (!account)
+    account = find_matrix_account();
+  if (!account) {
+    *error = g_strdup("No Matrix account found.");
+    return PURPLE_CMD_RET_FAILED;
+  }
+  purple_matrix_rust_get_perf_stats(purple_account_get_username(account));
+  return PURPLE_CMD_RET_OK;
+}
+
+static PurpleCmdRet cmd_log_filter(PurpleConversation *conv, const gchar *cmd,
+                                   gchar **args, gchar **error, void *data) {
+  const char *directives = (args && args[0]) ? args[0] : "";
+  if (!purple_matrix_rust_set_log_filter(directives)) {
+    *error = g_strdup("Invalid log filter (example: info,matrix_sdk=debug).");
+    return PURPLE_CMD_RET_FAILED;
+  }
+  return PURPLE_CMD_RET_OK;
+}
+
+static PurpleCmdRet cmd_replay(PurpleConversation *conv, const gchar *cmd,
+                               gchar **args, gchar **error, void *data) {
+  PurpleAccount *account = purple_conversation_get_account(conv);
+  double speed = 1.0;
+  if (!account)
+    account = find_matrix_account();
+  if (!account) {
+    *error = g_strdup("No Matrix account found.");
+    return PURPLE_CMD_RET_FAILED;
+  }
+  if (!args || !args[0] || !*args[0]) {
+    *error = g_strdup("Usage: /matrix_replay <file> [speed] (0 = as fast as "
+                      "possible)");
+    return PURPLE_CMD_RET_FAILED;
+  }
+  if (args[1] && *args[1])
+    speed = g_ascii_strtod(args[1], NULL);
+  if (speed < 0)
+    speed = 1.0;
+  if (!purple_matrix_rust_replay_events(purple_account_get_username(account),
+                                        args[0], speed)) {
+    *error = g_strdup("Not an event recording (see the debug log).");
+    return PURPLE_CMD_RET_FAILED;
+  }
+  return PURPLE_CMD_RET_OK;
+}
+
 static PurpleCmdRet cmd_resync_recent(PurpleConversation *conv,
                                       const gchar *cmd, gchar **args,
                                       gchar **error, void *data) {
@@ -4619,6 +4680,23 @@ void register_matrix_commands(PurplePlugin *plugin) {
                       PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT,
                       "prpl-matrix-rust", cmd_server_info,
                       "matrix_server_info: Query server capabilities", NULL);
+  purple_cmd_register("matrix_perf", "", PURPLE_CMD_P_PLUGIN,
+                      PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT,
+                      "prpl-matrix-rust", cmd_perf,
+                      "matrix_perf: Show backend performance counters", NULL);
+  purple_cmd_register("matrix_log_filter", "S", PURPLE_CMD_P_PLUGIN,
+                      PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT |
+                          PURPLE_CMD_FLAG_ALLOW_WRONG_ARGS,
+                      "prpl-matrix-rust", cmd_log_filter,
+                      "matrix_log_filter [filter]: Set the backend log filter",
+                      NULL);
+  purple_cmd_register("matrix_replay", "ws", PURPLE_CMD_P_PLUGIN,
+                      PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT |
+                          PURPLE_CMD_FLAG_ALLOW_WRONG_ARGS,
+                      "prpl-matrix-rust", cmd_replay,
+                      "matrix_replay &lt;file&gt; [speed]: Replay an event "
+                      "recording into this account",
+                      NULL);
   purple_cmd_register(
       "matrix_login", "www", PURPLE_CMD_P_PLUGIN,
       PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT, "prpl-matrix-rust",
@@ -3,6 +3,7 @@
 #include "matrix_blist.h"
 #include "matrix_chat.h"
 #include "matrix_commands.h"
+#include "matrix_dispatch.h"
 #include "matrix_ffi_wrappers.h"
 #include "matrix_globals.h"
 #include "matrix_types.h"
@@ -31,11 +32,17 @@ GHashTable *room_id_map = NULL;
 #define MATRIX_PREF_HOMESERVER "/plugins/prpl/matrix_rust/homeserver"
 #define MATRIX_PREF_USERNAME "/plugins/prpl/matrix_rust/username"
 #define MATRIX_PREF_SESSION_ACTION "/plugins/prpl/matrix_rust/session_action"
+#define MATRIX_PREF_METRICS_LISTEN "/plugins/prpl/matrix_rust/metrics_listen"
+#define MATRIX_PREF_EVENT_RECORD "/plugins/prpl/matrix_rust/event_record_path"
 
 static PurplePluginPrefFrame *
 matrix_get_plugin_pref_frame(PurplePlugin *plugin);
 static void matrix_pref_changed_cb(const char *name, PurplePrefType type,
                                     gconstpointer val, gpointer data);
+static void matrix_metrics_pref_cb(const char *name, PurplePrefType type,
+                                   gconstpointer val, gpointer data);
+static void matrix_event_record_pref_cb(const char *name, PurplePrefType type,
+                                        gconstpointer val, gpointer data);
 static gboolean plugin_unload(PurplePlugin *plugin);
 
 static PurplePluginUiInfo prefs_info = {    .get_plugin_pref_frame = matrix_get_plugin_pref_frame,
@@ -69,6 +76,18 @@ matrix_get_plugin_pref_frame(PurplePlugin *plugin) {
   purple_plugin_pref_add_choice(pref, "Clear session cache now", "clear");
   purple_plugin_pref_frame_add(frame, pref);
 
+  pref = purple_plugin_pref_new_with_name_and_label(
+      MATRIX_PREF_METRICS_LISTEN,
+      "Metrics Export (loopback port or socket path, empty = off)");
+  purple_plugin_pref_set_type(pref, PURPLE_PLUGIN_PREF_STRING_FORMAT);
+  purple_plugin_pref_frame_add(frame, pref);
+
+  pref = purple_plugin_pref_new_with_name_and_label(
+      MATRIX_PREF_EVENT_RECORD,
+      "Record Events To (file, bodies redacted, empty = off)");
+  purple_plugin_pref_set_type(pref, PURPLE_PLUGIN_PREF_STRING_FORMAT);
+  purple_plugin_pref_frame_add(frame, pref);
+
   pref = purple_plugin_pref_new_with_label(
       "Tip: use /matrix_clear_session or 'Clear Session Cache...' in account "
       "actions for immediate reset.");
@@ -93,6 +112,21 @@ static void matrix_pref_changed_cb(const char *name, PurplePrefType type,
   }
 }
 
+/* The exporter is process-wide, so it follows the plugin pref; an empty value
+ * stops it. */
+static void matrix_metrics_pref_cb(const char *name, PurplePrefType type,
+                                   gconstpointer val, gpointer data) {
+  purple_matrix_rust_set_metrics_listen(
+      purple_prefs_get_string(MATRIX_PREF_METRICS_LISTEN));
+}
+
+/* Same for the event recorder, which sees every account's events. */
+static void matrix_event_record_pref_cb(const char *name, PurplePrefType type,
+                                        gconstpointer val, gpointer data) {
+  purple_matrix_rust_set_event_record(
+      purple_prefs_get_string(MATRIX_PREF_EVENT_RECORD));
+}
+
 static void conversation_displayed_cb(PurpleConversation *conv) {
   PurpleAccount *account = purple_conversation_get_account(conv);
   if (account && strcmp(purple_account_get_protocol_id(account),
@@ -123,6 +157,11 @@ static int imgstore_add_cb(const void *data, size_t size) {
   return purple_imgstore_add_with_id(g_memdup2(data, size), size, NULL);
 }
 
+static void account_gone_cb(PurpleAccount *account) {
+  matrix_forget_account_id(account);
+  matrix_blist_forget_account(account);
+}
+
 static void connect_signals(void) {
   void *conv_handle = purple_conversations_get_handle();
   if (conv_handle) {
@@ -133,6 +172,20 @@ static void connect_signals(void) {
     purple_signal_connect(conv_handle, "conversation-extended-menu", my_plugin,
                           PURPLE_CALLBACK(conversation_extended_menu_cb), NULL);
   }
+  void *blist_handle = purple_blist_get_handle();
+  if (blist_handle) {
+    purple_signal_connect(blist_handle, "blist-node-added", my_plugin,
+                          PURPLE_CALLBACK(matrix_blist_node_added_cb), NULL);
+    purple_signal_connect(blist_handle, "blist-node-removed", my_plugin,
+                          PURPLE_CALLBACK(matrix_blist_node_removed_cb), NULL);
+  }
+  void *accounts_handle = purple_accounts_get_handle();
+  if (accounts_handle) {
+    purple_signal_connect(accounts_handle, "account-removed", my_plugin,
+                          PURPLE_CALLBACK(account_gone_cb), NULL);
+    purple_signal_connect(accounts_handle, "account-disabled", my_plugin,
+                          PURPLE_CALLBACK(account_gone_cb), NULL);
+  }
 }
 
 static void core_initialized_cb(void) { connect_signals(); }
@@ -589,201 +642,6 @@ static void handle_room_activity_marshal(PurpleCallback cb, va_list args,
   callback(arg1, arg2, arg3, data);
 }
 
-static gboolean poll_rust_channel_cb(gpointer user_data) {
-  int ev_type = -1;
-  void *data = NULL;
-
-  int events_processed = 0;
-  while (purple_matrix_rust_poll_event(&ev_type, &data) &&
-         events_processed < 50) {
-    if (!data)
-      continue;
-
-    purple_debug_info("matrix-ffi", "Received FFI event type %d\n", ev_type);
-    switch (ev_type) {
-    case FFI_EVENT_MESSAGE_RECEIVED: {
-      CMessageReceived *s = (CMessageReceived *)data;
-      msg_callback(s->user_id, s->sender, s->msg, s->room_id, s->thread_root_id,
-                   s->event_id, s->timestamp, s->encrypted);
-      break;
-    }
-    case FFI_EVENT_TYPING: {
-      CTyping *s = (CTyping *)data;
-      typing_callback(s->user_id, s->room_id, s->who, s->is_typing);
-      break;
-    }
-    case FFI_EVENT_ROOM_JOINED: {
-      CRoomJoined *s = (CRoomJoined *)data;
-      room_joined_callback(s->user_id, s->room_id, s->name, s->group_name,
-                           s->avatar_url, s->topic, s->encrypted,
-                           s->member_count);
-      break;
-    }
-    case FFI_EVENT_ROOM_LEFT: {
-      CRoomLeft *s = (CRoomLeft *)data;
-      room_left_callback(s->user_id, s->room_id);
-      break;
-    }
-    case FFI_EVENT_READ_MARKER: {
-      CReadMarker *s = (CReadMarker *)data;
-      read_marker_cb(s->user_id, s->room_id, s->event_id, s->who);
-      break;
-    }
-    case FFI_EVENT_PRESENCE: {
-      CPresence *s = (CPresence *)data;
-      presence_callback(s->user_id, s->target_user_id, s->is_online);
-      break;
-    }
-    case FFI_EVENT_CHAT_TOPIC: {
-      CChatTopic *s = (CChatTopic *)data;
-      chat_topic_callback(s->user_id, s->room_id, s->topic, s->sender);
-      break;
-    }
-    case FFI_EVENT_CHAT_USER: {
-      CChatUser *s = (CChatUser *)data;
-      chat_user_callback(s->user_id, s->room_id, s->member_id, s->add, s->alias,
-                         s->avatar_path);
-      break;
-    }
-    case FFI_EVENT_INVITE: {
-      CInvite *s = (CInvite *)data;
-      invite_callback(s->user_id, s->room_id, s->inviter);
-      break;
-    }
-    case FFI_EVENT_ROOM_LIST_ADD: {
-      CRoomListAdd *s = (CRoomListAdd *)data;
-      roomlist_add_cb(s->user_id, s->name, s->room_id, s->topic,
-                      s->member_count, s->is_space, s->parent_id);
-      break;
-    }
-    case FFI_EVENT_ROOM_PREVIEW: {
-      CRoomPreview *s = (CRoomPreview *)data;
-      room_preview_cb(s->user_id, s->room_id_or_alias, s->html_body);
-      break;
-    }
-    case FFI_EVENT_LOGIN_FAILED: {
-      CLoginFailed *s = (CLoginFailed *)data;
-      login_failed_cb(s->message);
-      break;
-    }
-    case FFI_EVENT_SHOW_USER_INFO: {
-      CShowUserInfo *s = (CShowUserInfo *)data;
-      show_user_info_cb(s->user_id, s->display_name, s->avatar_url,
-                        s->target_user_id, s->is_online);
-      break;
-    }
-    case FFI_EVENT_THREAD_LIST: {
-      CThreadList *s = (CThreadList *)data;
-      thread_list_cb(s->user_id, s->room_id, s->thread_root_id, s->latest_msg,
-                     s->count, s->ts);
-      break;
-    }
-    case FFI_EVENT_POLL_LIST: {
-      CPollList *s = (CPollList *)data;
-      poll_list_cb(s->user_id, s->room_id, s->event_id, s->question, s->sender,
-                   s->options_str);
-      break;
-    }
-    case FFI_EVENT_SEARCH: {
-      CSearch *s = (CSearch *)data;
-      search_result_cb(s->user_id, s->room_id, s->sender, s->message,
-                       s->timestamp_str);
-      break;
-    }
-    case FFI_EVENT_REACTIONS_CHANGED: {
-      CReactionsChanged *s = (CReactionsChanged *)data;
-      reactions_changed_callback(s->user_id, s->room_id, s->event_id,
-                                 s->reactions_text);
-      break;
-    }
-    case FFI_EVENT_MESSAGE_EDITED: {
-      CMessageEdited *s = (CMessageEdited *)data;
-      message_edited_callback(s->user_id, s->room_id, s->event_id, s->new_msg);
-      break;
-    }
-    case FFI_EVENT_ROOM_MUTE: {
-      CRoomMute *s = (CRoomMute *)data;
-      room_mute_callback(s->user_id, s->room_id, s->muted);
-      break;
-    }
-    case FFI_EVENT_ROOM_TAG: {
-      CRoomTag *s = (CRoomTag *)data;
-      room_tag_callback(s->user_id, s->room_id, s->tag);
-      break;
-    }
-    case FFI_EVENT_POWER_LEVEL_UPDATE: {
-      CPowerLevelUpdate *s = (CPowerLevelUpdate *)data;
-      power_level_update_callback(s->user_id, s->room_id, s->is_admin,
-                                  s->can_kick, s->can_ban, s->can_redact,
-                                  s->can_invite);
-      break;
-    }
-    case FFI_EVENT_UPDATE_BUDDY: {
-      CUpdateBuddy *s = (CUpdateBuddy *)data;
-      update_buddy_callback(s->user_id, s->alias, s->avatar_url);
-      break;
-    }
-    case FFI_EVENT_STICKER_PACK: {
-      CStickerPack *s = (CStickerPack *)data;
-      void (*cb)(const char *, const char *, const char *, void *) =
-          (void *)s->cb_ptr;
-      if (cb)
-        cb(s->user_id, s->pack_id, s->pack_name, (void *)s->user_data);
-      break;
-    }
-    case FFI_EVENT_STICKER: {
-      CSticker *s = (CSticker *)data;
-      void (*cb)(const char *, const char *, const char *, const char *,
-                 void *) = (void *)s->cb_ptr;
-      if (cb)
-        cb(s->user_id, s->sticker_id, s->description, s->url,
-           (void *)s->user_data);
-      break;
-    }
-    case FFI_EVENT_STICKER_DONE: {
-      CStickerDone *s = (CStickerDone *)data;
-      void (*cb)(void *) = (void *)s->cb_ptr;
-      if (cb)
-        cb((void *)s->user_data);
-      break;
-    }
-    case FFI_EVENT_SSO: {
-      CSso *s = (CSso *)data;
-      sso_url_cb(s->url);
-      break;
-    }
-    case FFI_EVENT_CONNECTED: {
-      CConnected *s = (CConnected *)data;
-      connected_cb(s->user_id);
-      break;
-    }
-    case FFI_EVENT_SAS_REQUEST: {
-      CSasRequest *s = (CSasRequest *)data;
-      sas_request_cb(s->user_id, s->target_user_id, s->flow_id);
-      break;
-    }
-    case FFI_EVENT_SAS_HAVE_EMOJI: {
-      CSasHaveEmoji *s = (CSasHaveEmoji *)data;
-      sas_emoji_cb(s->user_id, s->target_user_id, s->flow_id, s->emojis);
-      break;
-    }
-    case FFI_EVENT_SHOW_VERIFICATION_QR: {
-      CShowVerificationQr *s = (CShowVerificationQr *)data;
-      show_verification_qr_cb(s->user_id, s->target_user_id, s->html_data);
-      break;
-    }
-    default:
-      purple_debug_error("matrix-rust", "Ignored unknown event type %d\n",
-                         ev_type);
-    }
-
-    purple_matrix_rust_free_event(ev_type, data);
-    events_processed++;
-  }
-
-  return TRUE; // keep timer running
-}
-
 static guint rust_poll_timer_id = 0;
 
 static gboolean plugin_load(PurplePlugin *plugin) {
@@ -1202,6 +1060,14 @@ static gboolean plugin_load(PurplePlugin *plugin) {
 
   purple_prefs_connect_callback(plugin, MATRIX_PREF_SESSION_ACTION,
                                 matrix_pref_changed_cb, NULL);
+  purple_prefs_connect_callback(plugin, MATRIX_PREF_METRICS_LISTEN,
+                                matrix_metrics_pref_cb, NULL);
+  matrix_metrics_pref_cb(MATRIX_PREF_METRICS_LISTEN, PURPLE_PREF_STRING, NULL,
+                         NULL);
+  purple_prefs_connect_callback(plugin, MATRIX_PREF_EVENT_RECORD,
+                                matrix_event_record_pref_cb, NULL);
+  matrix_event_record_pref_cb(MATRIX_PREF_EVENT_RECORD, PURPLE_PREF_STRING,
+                              NULL, NULL);
 
   return TRUE;
 }
@@ -1285,6 +1151,10 @@ static void init_plugin(PurplePlugin *plugin) {
   o = purple_account_option_string_new("History Page Size", "history_page_size",
                                        "50");
   prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, o);
+  o = purple_account_option_string_new(
+      "Downscale Sent Images Above (px, 0 = off)", "upload_max_image_dim",
+      "2048");
+  prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, o);
 
   if (!purple_prefs_exists(MATRIX_PREF_ROOT))
     purple_prefs_add_none(MATRIX_PREF_ROOT);
@@ -1294,6 +1164,10 @@ static void init_plugin(PurplePlugin *plugin) {
     purple_prefs_add_string(MATRIX_PREF_USERNAME, "");
   if (!purple_prefs_exists(MATRIX_PREF_SESSION_ACTION))
     purple_prefs_add_string(MATRIX_PREF_SESSION_ACTION, "none");
+  if (!purple_prefs_exists(MATRIX_PREF_METRICS_LISTEN))
+    purple_prefs_add_string(MATRIX_PREF_METRICS_LISTEN, "");
+  if (!purple_prefs_exists(MATRIX_PREF_EVENT_RECORD))
+    purple_prefs_add_string(MATRIX_PREF_EVENT_RECORD, "");
 }
 
 static gboolean plugin_unload(PurplePlugin *plugin) {
@@ -1312,6 +1186,7 @@ static gboolean plugin_unload(PurplePlugin *plugin) {
   }
 
   matrix_utils_cleanup();
+  matrix_blist_cleanup();
 
   if (prpl_info.protocol_options) {
     g_list_free_full(prpl_info.protocol_options,
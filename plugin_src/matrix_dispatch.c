@@ -0,0 +1,218 @@
+#include "matrix_dispatch.h"
+#include "matrix_account.h"
+#include "matrix_blist.h"
+#include "matrix_chat.h"
+#include "matrix_ffi_wrappers.h"
+#include "matrix_utils.h"
+
+#include <libpurple/debug.h>
+
+gboolean poll_rust_channel_cb(gpointer user_data) {
+  int ev_type = -1;
+  void *data = NULL;
+  guint64 span = 0;
+
+  int events_processed = 0;
+  gint64 drain_start = g_get_monotonic_time();
+  /* Check the budget first: an event polled past it would be dropped. */
+  while (events_processed < MATRIX_DISPATCH_BUDGET &&
+         purple_matrix_rust_poll_event(&ev_type, &data, &span)) {
+    if (!data)
+      continue;
+
+    matrix_debug_verbose("matrix-ffi", "Received FFI event type %d\n", ev_type);
+    matrix_set_current_span(span);
+    switch (ev_type) {
+    case FFI_EVENT_MESSAGE_RECEIVED: {
+      CMessageReceived *s = (CMessageReceived *)data;
+      msg_callback(s->user_id, s->sender, s->msg, s->room_id, s->thread_root_id,
+                   s->event_id, s->timestamp, s->encrypted);
+      break;
+    }
+    case FFI_EVENT_TYPING: {
+      CTyping *s = (CTyping *)data;
+      typing_callback(s->user_id, s->room_id, s->who, s->is_typing);
+      break;
+    }
+    case FFI_EVENT_ROOM_JOINED: {
+      CRoomJoined *s = (CRoomJoined *)data;
+      room_joined_callback(s->user_id, s->room_id, s->name, s->group_name,
+                           s->avatar_url, s->topic, s->encrypted,
+                           s->member_count);
+      break;
+    }
+    case FFI_EVENT_ROOM_LEFT: {
+      CRoomLeft *s = (CRoomLeft *)data;
+      room_left_callback(s->user_id, s->room_id);
+      break;
+    }
+    case FFI_EVENT_READ_MARKER: {
+      CReadMarker *s = (CReadMarker *)data;
+      read_marker_cb(s->user_id, s->room_id, s->event_id, s->who);
+      break;
+    }
+    case FFI_EVENT_PRESENCE: {
+      CPresence *s = (CPresence *)data;
+      presence_callback(s->user_id, s->target_user_id, s->is_online);
+      break;
+    }
+    case FFI_EVENT_CHAT_TOPIC: {
+      CChatTopic *s = (CChatTopic *)data;
+      chat_topic_callback(s->user_id, s->room_id, s->topic, s->sender);
+      break;
+    }
+    case FFI_EVENT_CHAT_USER: {
+      CChatUser *s = (CChatUser *)data;
+      chat_user_callback(s->user_id, s->room_id, s->member_id, s->add, s->alias,
+                         s->avatar_path);
+      break;
+    }
+    case FFI_EVENT_INVITE: {
+      CInvite *s = (CInvite *)data;
+      invite_callback(s->user_id, s->room_id, s->inviter);
+      break;
+    }
+    case FFI_EVENT_ROOM_LIST_ADD: {
+      CRoomListAdd *s = (CRoomListAdd *)data;
+      roomlist_add_cb(s->user_id, s->name, s->room_id, s->topic,
+                      s->member_count, s->is_space, s->parent_id);
+      break;
+    }
+    case FFI_EVENT_ROOM_PREVIEW: {
+      CRoomPreview *s = (CRoomPreview *)data;
+      room_preview_cb(s->user_id, s->room_id_or_alias, s->html_body);
+      break;
+    }
+    case FFI_EVENT_LOGIN_FAILED: {
+      CLoginFailed *s = (CLoginFailed *)data;
+      login_failed_cb(s->message);
+      break;
+    }
+    case FFI_EVENT_SHOW_USER_INFO: {
+      CShowUserInfo *s = (CShowUserInfo *)data;
+      show_user_info_cb(s->user_id, s->display_name, s->avatar_url,
+                        s->target_user_id, s->is_online);
+      break;
+    }
+    case FFI_EVENT_THREAD_LIST: {
+      CThreadList *s = (CThreadList *)data;
+      thread_list_cb(s->user_id, s->room_id, s->thread_root_id, s->latest_msg,
+                     s->count, s->ts);
+      break;
+    }
+    case FFI_EVENT_POLL_LIST: {
+      CPollList *s = (CPollList *)data;
+      poll_list_cb(s->user_id, s->room_id, s->event_id, s->question, s->sender,
+                   s->options_str);
+      break;
+    }
+    case FFI_EVENT_SEARCH: {
+      CSearch *s = (CSearch *)data;
+      search_result_cb(s->user_id, s->room_id, s->sender, s->message,
+                       s->timestamp_str);
+      break;
+    }
+    case FFI_EVENT_REACTIONS_CHANGED: {
+      CReactionsChanged *s = (CReactionsChanged *)data;
+      reactions_changed_callback(s->user_id, s->room_id, s->event_id,
+                                 s->reactions_text);
+      break;
+    }
+    case FFI_EVENT_MESSAGE_EDITED: {
+      CMessageEdited *s = (CMessageEdited *)data;
+      message_edited_callback(s->user_id, s->room_id, s->event_id, s->new_msg);
+      break;
+    }
+    case FFI_EVENT_MESSAGE_SENT: {
+      CMessageSent *s = (CMessageSent *)data;
+      message_sent_callback(s->user_id, s->room_id, s->txn_id, s->event_id);
+      break;
+    }
+    case FFI_EVENT_ROOM_MUTE: {
+      CRoomMute *s = (CRoomMute *)data;
+      room_mute_callback(s->user_id, s->room_id, s->muted);
+      break;
+    }
+    case FFI_EVENT_ROOM_TAG: {
+      CRoomTag *s = (CRoomTag *)data;
+      room_tag_callback(s->user_id, s->room_id, s->tag);
+      break;
+    }
+    case FFI_EVENT_POWER_LEVEL_UPDATE: {
+      CPowerLevelUpdate *s = (CPowerLevelUpdate *)data;
+      power_level_update_callback(s->user_id, s->room_id, s->is_admin,
+                                  s->can_kick, s->can_ban, s->can_redact,
+                                  s->can_invite);
+      break;
+    }
+    case FFI_EVENT_UPDATE_BUDDY: {
+      CUpdateBuddy *s = (CUpdateBuddy *)data;
+      update_buddy_callback(s->user_id, s->alias, s->avatar_url);
+      break;
+    }
+    case FFI_EVENT_STICKER_PACK: {
+      CStickerPack *s = (CStickerPack *)data;
+      void (*cb)(const char *, const char *, const char *, void *) =
+          (void *)s->cb_ptr;
+      if (cb)
+        cb(s->user_id, s->pack_id, s->pack_name, (void *)s->user_data);
+      break;
+    }
+    case FFI_EVENT_STICKER: {
+      CSticker *s = (CSticker *)data;
+      void (*cb)(const char *, const char *, const char *, const char *,
+                 void *) = (void *)s->cb_ptr;
+      if (cb)
+        cb(s->user_id, s->sticker_id, s->description, s->url,
+           (void *)s->user_data);
+      break;
+    }
+    case FFI_EVENT_STICKER_DONE: {
+      CStickerDone *s = (CStickerDone *)data;
+      void (*cb)(void *) = (void *)s->cb_ptr;
+      if (cb)
+        cb((void *)s->user_data);
+      break;
+    }
+    case FFI_EVENT_SSO: {
+      CSso *s = (CSso *)data;
+      sso_url_cb(s->url);
+      break;
+    }
+    case FFI_EVENT_CONNECTED: {
+      CConnected *s = (CConnected *)data;
+      connected_cb(s->user_id);
+      break;
+    }
+    case FFI_EVENT_SAS_REQUEST: {
+      CSasRequest *s = (CSasRequest *)data;
+      sas_request_cb(s->user_id, s->target_user_id, s->flow_id);
+      break;
+    }
+    case FFI_EVENT_SAS_HAVE_EMOJI: {
+      CSasHaveEmoji *s = (CSasHaveEmoji *)data;
+      sas_emoji_cb(s->user_id, s->target_user_id, s->flow_id, s->emojis);
+      break;
+    }
+    case FFI_EVENT_SHOW_VERIFICATION_QR: {
+      CShowVerificationQr *s = (CShowVerificationQr *)data;
+      show_verification_qr_cb(s->user_id, s->target_user_id, s->html_data);
+      break;
+    }
+    default:
+      purple_debug_error("matrix-rust", "Ignored unknown event type %d\n",
+                         ev_type);
+    }
+
+    purple_matrix_rust_trace_event(span, FFI_TRACE_DISPATCHED);
+    matrix_set_current_span(0);
+    purple_matrix_rust_free_event(ev_type, data);
+    events_processed++;
+  }
+
+  if (events_processed > 0)
+    purple_matrix_rust_record_drain(
+        (guint64)(g_get_monotonic_time() - drain_start), events_processed);
+
+  return TRUE; // keep timer running
+}
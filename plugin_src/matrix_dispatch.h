@@ -0,0 +1,12 @@
+#ifndef MATRIX_DISPATCH_H
+#define MATRIX_DISPATCH_H
+
+#include <glib.h>
+
+/* Events handed from the Rust channel to their C callbacks per poll tick. */
+#define MATRIX_DISPATCH_BUDGET 50
+
+/* Poll timer callback: drains up to MATRIX_DISPATCH_BUDGET FFI events. */
+gboolean poll_rust_channel_cb(gpointer user_data);
+
+#endif // MATRIX_DISPATCH_H
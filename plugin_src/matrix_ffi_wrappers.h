@@ -46,8 +46,19 @@ typedef enum {
   FFI_EVENT_POWER_LEVEL_UPDATE = 29,
   FFI_EVENT_REACTIONS_CHANGED = 30,
   FFI_EVENT_MESSAGE_EDITED = 31,
+  FFI_EVENT_MESSAGE_SENT = 32,
 } FfiEventType;
 
+/* Stages reported back for an event's span (purple_matrix_rust_trace_event) */
+typedef enum {
+  FFI_TRACE_DISPATCHED = 1,
+  FFI_TRACE_DISPLAYED = 2,
+  FFI_TRACE_DROPPED = 3, /* handled without being written anywhere */
+} FfiTraceStage;
+
+/* Event structs handed out by purple_matrix_rust_poll_event. Each is one
+ * allocation: the strings live right after the struct, so they are valid
+ * only until purple_matrix_rust_free_event and must be copied to keep. */
 typedef struct {
   char *user_id;
   char *sender;
@@ -156,6 +167,12 @@ typedef struct {
   char *event_id;
   char *new_msg;
 } CMessageEdited;
+typedef struct {
+  char *user_id;
+  char *room_id;
+  char *txn_id;
+  char *event_id;
+} CMessageSent;
 typedef struct {
   char *user_id;
   char *room_id;
@@ -236,8 +253,12 @@ typedef struct {
 } CShowVerificationQr;
 
 // Polling
-extern bool purple_matrix_rust_poll_event(int *out_type, void **out_data);
+extern bool purple_matrix_rust_poll_event(int *out_type, void **out_data,
+                                          guint64 *out_span);
 extern void purple_matrix_rust_free_event(int ev_type, void *data);
+extern void purple_matrix_rust_record_drain(guint64 micros, guint32 events);
+extern void purple_matrix_rust_trace_event(guint64 span, int stage);
+extern bool purple_matrix_rust_set_log_filter(const char *directives);
 
 extern void purple_matrix_rust_set_imgstore_add_callback(
     int (*cb)(const void *data, size_t size));
@@ -246,6 +267,10 @@ extern void purple_matrix_rust_set_imgstore_add_callback(
 extern void purple_matrix_rust_send_message(const char *user_id,
                                             const char *room_id,
                                             const char *text);
+extern void purple_matrix_rust_send_message_txn(const char *user_id,
+                                                const char *room_id,
+                                                const char *text,
+                                                const char *txn_id);
 extern void purple_matrix_rust_send_im(const char *account_user_id,
                                        const char *target_user_id,
                                        const char *text);
@@ -278,6 +303,13 @@ extern void purple_matrix_rust_fetch_room_preview(const char *user_id,
                                                   const char *room_id_or_alias);
 extern void purple_matrix_rust_send_file(const char *user_id, const char *who,
                                          const char *filename);
+extern void purple_matrix_rust_send_image_bytes(const char *user_id,
+                                                const char *who,
+                                                const char *filename,
+                                                const unsigned char *data,
+                                                size_t size);
+extern void purple_matrix_rust_set_upload_max_image_dim(const char *user_id,
+                                                        guint32 max_dim);
 extern void purple_matrix_rust_send_reply(const char *user_id,
                                           const char *room_id,
                                           const char *event_id,
@@ -425,6 +457,11 @@ extern void purple_matrix_rust_search_room_members(const char *user_id,
                                                    const char *term);
 extern void purple_matrix_rust_get_supported_versions(const char *user_id);
 extern void purple_matrix_rust_get_server_info(const char *user_id);
+extern void purple_matrix_rust_get_perf_stats(const char *user_id);
+extern void purple_matrix_rust_set_metrics_listen(const char *listen);
+extern void purple_matrix_rust_set_event_record(const char *path);
+extern bool purple_matrix_rust_replay_events(const char *user_id,
+                                             const char *path, double speed);
 extern void purple_matrix_rust_search_public_rooms(const char *user_id,
                                                    const char *search_term);
 extern void purple_matrix_rust_search_users(const char *user_id,
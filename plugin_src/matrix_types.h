@@ -5,37 +5,56 @@
 #include <libpurple/account.h>
 #include <stdbool.h>
 
-// Structs to marshal data to main thread
+// Structs to marshal data to main thread. Account, room and user ids in the
+// per-message structs are g_intern_string() copies: never freed, and
+// compared by content as usual. Unlike the Rust intern table, GLib's has no
+// cap, so it grows with every distinct sender seen this session; event ids
+// and "room|thread" ids must not go through it. Every room_id below may be a
+// conversation id, so each struct owns its copy in room_id_buf when it is one
+// (see matrix_room_id_ref).
 
 typedef struct {
-  char *user_id;
-  char *sender;
+  const char *user_id;
+  const char *sender;
   char *message;
-  char *room_id;
+  const char *room_id;
+  char *room_id_buf;
   char *thread_root_id;
   char *event_id;
   guint64 timestamp;
   gboolean encrypted;
+  guint64 span_id;
 } MatrixMsgData;
 
 typedef struct {
-  char *user_id;
-  char *room_id;
+  const char *user_id;
+  const char *room_id;
+  char *room_id_buf;
   char *event_id;
   char *reactions_text;
 } MatrixReactionsData;
 
 typedef struct {
-  char *user_id;
-  char *room_id;
+  const char *user_id;
+  const char *room_id;
+  char *room_id_buf;
   char *event_id;
   char *new_msg;
 } MatrixEditData;
 
 typedef struct {
-  char *user_id;
-  char *room_id;
-  char *who;
+  const char *user_id;
+  const char *room_id;
+  char *room_id_buf;
+  char *txn_id;
+  char *event_id;
+} MatrixSentData;
+
+typedef struct {
+  const char *user_id;
+  const char *room_id;
+  char *room_id_buf;
+  const char *who;
   bool is_typing;
 } MatrixTypingData;
 
@@ -48,8 +67,17 @@ typedef struct {
   char *topic;
   gboolean encrypted;
   guint64 member_count;
+  guint fields; /* MATRIX_ROOM_FIELD_* carried by this update */
 } MatrixRoomData;
 
+#define MATRIX_ROOM_FIELD_NAME (1u << 0)
+#define MATRIX_ROOM_FIELD_GROUP (1u << 1)
+#define MATRIX_ROOM_FIELD_AVATAR (1u << 2)
+#define MATRIX_ROOM_FIELD_TOPIC (1u << 3)
+#define MATRIX_ROOM_FIELD_ENCRYPTED (1u << 4)
+#define MATRIX_ROOM_FIELD_MEMBER_COUNT (1u << 5)
+#define MATRIX_ROOM_FIELD_ALL 0x3fu
+
 typedef struct {
   char *user_id;        /* The local account ID */
   char *target_user_id; /* The profile being viewed */
@@ -124,10 +152,11 @@ typedef struct {
 } MatrixInviteData;
 
 typedef struct {
-  char *user_id;
-  char *room_id;
+  const char *user_id;
+  const char *room_id;
+  char *room_id_buf;
   char *event_id;
-  char *who;
+  const char *who;
 } MatrixReadMarkerData;
 
 typedef struct {
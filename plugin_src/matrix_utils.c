@@ -70,9 +70,27 @@ typedef struct {
   guint64 ts;
 } ThreadData;
 
+/* An open "Active Room Threads" window. Kept per room in thread_dialogs so a
+ * refreshed list replaces the window on screen instead of stacking another. */
+typedef struct {
+  char *room_id;
+  void *handle;
+} MatrixThreadDialog;
+
+static GHashTable *thread_dialogs = NULL;
+
+static void thread_dialog_closed_cb(gpointer user_data) {
+  MatrixThreadDialog *dialog = (MatrixThreadDialog *)user_data;
+  if (thread_dialogs &&
+      g_hash_table_lookup(thread_dialogs, dialog->room_id) == dialog)
+    g_hash_table_remove(thread_dialogs, dialog->room_id);
+  g_free(dialog->room_id);
+  g_free(dialog);
+}
+
 static void thread_search_result_cb(PurpleConnection *gc, GList *row,
                                     gpointer user_data) {
-  char *room_id = (char *)user_data;
+  const char *room_id = ((MatrixThreadDialog *)user_data)->room_id;
   if (!row)
     return;
   /* Columns: 0:Alias/Latest, 1:Replies, 2:Last Mention, 3:Root ID */
@@ -111,10 +129,15 @@ static gboolean thread_list_ui_idle_cb(gpointer data) {
     g_hash_table_steal(thread_lists, d->room_id);
   g_mutex_unlock(&thread_lists_mutex);
 
+  MatrixThreadDialog *open_dialog =
+      thread_dialogs ? g_hash_table_lookup(thread_dialogs, d->room_id) : NULL;
+
   if (!list) {
-    purple_notify_info(
-        my_plugin, "Thread Discovery", "No threads found",
-        "No active threads were found in the recent history of this room.");
+    /* A refresh that emptied the list leaves the open window alone. */
+    if (!open_dialog)
+      purple_notify_info(
+          my_plugin, "Thread Discovery", "No threads found",
+          "No active threads were found in the recent history of this room.");
     g_free(d->user_id);
     g_free(d->room_id);
     g_free(d);
@@ -149,12 +172,26 @@ static gboolean thread_list_ui_idle_cb(gpointer data) {
     }
   }
 
-  purple_notify_searchresults(purple_account_get_connection(account),
-                              "Active Room Threads", "Thread Selection Wizard",
-                              "Please select a thread and click 'Forward' to "
-                              "open it in a new conversation tab.",
-                              results, notify_close_free_cb,
-                              g_strdup(d->room_id));
+  /* Closing runs thread_dialog_closed_cb, which drops the old entry. */
+  if (open_dialog)
+    purple_notify_close(PURPLE_NOTIFY_SEARCHRESULTS, open_dialog->handle);
+
+  MatrixThreadDialog *dialog = g_new0(MatrixThreadDialog, 1);
+  dialog->room_id = g_strdup(d->room_id);
+  void *handle = purple_notify_searchresults(
+      purple_account_get_connection(account), "Active Room Threads",
+      "Thread Selection Wizard",
+      "Please select a thread and click 'Forward' to "
+      "open it in a new conversation tab.",
+      results, thread_dialog_closed_cb, dialog);
+  /* Without a handle the UI showed nothing and already freed the dialog. */
+  if (handle) {
+    dialog->handle = handle;
+    if (!thread_dialogs)
+      thread_dialogs =
+          g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_replace(thread_dialogs, g_strdup(d->room_id), dialog);
+  }
 
   g_list_free_full(list, (GDestroyNotify)free_matrix_thread_info);
   g_free(d->user_id);
@@ -197,13 +234,13 @@ static gboolean process_thread_item_cb(gpointer user_data) {
     } else
       info->timestamp_str = g_strdup("Unknown");
 
-    GList *list = g_hash_table_lookup(thread_lists, d->room_id);
-    if (list) {
-      list = g_list_append(list, info);
-    } else {
-      list = g_list_append(NULL, info);
-      g_hash_table_insert(thread_lists, g_strdup(d->room_id), list);
-    }
+    /* Prepend: the list is sorted by timestamp before display anyway. */
+    gpointer key = NULL, list = NULL;
+    if (g_hash_table_lookup_extended(thread_lists, d->room_id, &key, &list))
+      g_hash_table_steal(thread_lists, d->room_id);
+    else
+      key = g_strdup(d->room_id);
+    g_hash_table_insert(thread_lists, key, g_list_prepend(list, info));
   }
   g_mutex_unlock(&thread_lists_mutex);
 
@@ -588,34 +625,94 @@ guint32 get_history_page_size(PurpleAccount *account) {
   return (guint32)n;
 }
 
+guint32 get_upload_max_image_dim(PurpleAccount *account) {
+  if (!account)
+    return 2048;
+  const char *raw =
+      purple_account_get_string(account, "upload_max_image_dim", "2048");
+  long n = raw ? strtol(raw, NULL, 10) : 2048;
+  if (n < 0)
+    n = 0;
+  if (n > 16384)
+    n = 16384;
+  return (guint32)n;
+}
+
+/* Transaction id for an outgoing message. Unique per process run, which is
+ * all the homeserver needs since it deduplicates per access token. */
+char *matrix_new_txn_id(void) {
+  static guint counter = 0;
+  return g_strdup_printf("pmr%" G_GINT64_FORMAT ".%u", g_get_real_time(),
+                         ++counter);
+}
+
+/* Span id of the FFI event being dispatched by the poll timer, so callbacks
+ * that defer display to an idle handler can report when it happened. Main
+ * thread only. */
+static guint64 current_span = 0;
+
+void matrix_set_current_span(guint64 span) { current_span = span; }
+
+guint64 matrix_current_span(void) { return current_span; }
+
+/* MXID (or login username) -> PurpleAccount*. Filled at login/connect and on
+ * first successful resolution; dropped when the account is disabled, removed
+ * or disconnected. */
+static GHashTable *account_by_id = NULL;
+
+void matrix_register_account_id(PurpleAccount *account, const char *user_id) {
+  if (!account || !user_id || !*user_id)
+    return;
+  if (!account_by_id)
+    account_by_id = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_replace(account_by_id, g_strdup(user_id), account);
+}
+
+static gboolean account_id_matches(gpointer key, gpointer value,
+                                   gpointer account) {
+  return value == account;
+}
+
+void matrix_forget_account_id(PurpleAccount *account) {
+  if (account_by_id && account)
+    g_hash_table_foreach_remove(account_by_id, account_id_matches, account);
+}
+
+static gboolean mxid_localpart_equals(const char *mxid, const char *username) {
+  /* "@bob:example.org" matches a "bob" login, but never "bo" or "ob". */
+  if (!mxid || mxid[0] != '@' || !username || !*username)
+    return FALSE;
+  const char *sep = strchr(mxid, ':');
+  size_t len = sep ? (size_t)(sep - mxid - 1) : strlen(mxid + 1);
+  return strlen(username) == len && strncmp(mxid + 1, username, len) == 0;
+}
+
 PurpleAccount *find_matrix_account_by_id(const char *user_id) {
-  if (!user_id || strlen(user_id) == 0)
+  if (!user_id || !*user_id)
     return NULL;
-  GList *l;
-  for (l = purple_accounts_get_all(); l != NULL; l = l->next) {
+  if (account_by_id) {
+    PurpleAccount *cached = g_hash_table_lookup(account_by_id, user_id);
+    if (cached)
+      return cached;
+  }
+
+  PurpleAccount *localpart_match = NULL;
+  for (GList *l = purple_accounts_get_all(); l != NULL; l = l->next) {
     PurpleAccount *account = (PurpleAccount *)l->data;
-    if (strcmp(purple_account_get_protocol_id(account), "prpl-matrix-rust") ==
-        0) {
-      const char *username = purple_account_get_username(account);
-      if (g_strcmp0(username, user_id) == 0)
-        return account;
-      // Robust MXID matching: extract localpart if needed, or match substring
-      if (user_id[0] == '@' && username) {
-        if (strstr(user_id, username))
-          return account;
-        char *mxid_local = g_strdup(user_id + 1);
-        char *sep = strchr(mxid_local, ':');
-        if (sep)
-          *sep = '\0';
-        if (g_strcmp0(username, mxid_local) == 0) {
-          g_free(mxid_local);
-          return account;
-        }
-        g_free(mxid_local);
-      }
+    if (strcmp(purple_account_get_protocol_id(account), "prpl-matrix-rust") !=
+        0)
+      continue;
+    const char *username = purple_account_get_username(account);
+    if (g_strcmp0(username, user_id) == 0) {
+      matrix_register_account_id(account, user_id);
+      return account;
     }
+    if (!localpart_match && mxid_localpart_equals(user_id, username))
+      localpart_match = account;
   }
-  return NULL;
+  if (localpart_match)
+    matrix_register_account_id(localpart_match, user_id);
+  return localpart_match;
 }
 
 PurpleAccount *find_matrix_account(void) {
@@ -700,6 +797,11 @@ char *matrix_get_chat_name(GHashTable *components) {
 }
 
 void matrix_utils_cleanup(void) {
+  if (account_by_id) {
+    g_hash_table_destroy(account_by_id);
+    account_by_id = NULL;
+  }
+
   g_mutex_lock(&thread_lists_mutex);
   if (thread_lists) {
     g_hash_table_destroy(thread_lists);
@@ -4,8 +4,26 @@
 #include <glib.h>
 #include <libpurple/account.h>
 #include <libpurple/request.h>
+#include <libpurple/debug.h>
 #include <stdbool.h>
 
+/* Per-event debug output. Formats nothing unless libpurple's verbose debugging
+ * is on, which plain -d does not do: run PURPLE_VERBOSE_DEBUG=1 pidgin -d (or
+ * finch) to see it. Compiles away entirely with MATRIX_NO_VERBOSE_DEBUG (make
+ * NO_VERBOSE_DEBUG=1). Anything a bug report needs, such as a dropped event,
+ * belongs in plain purple_debug_* instead. Never pass message bodies. */
+#ifdef MATRIX_NO_VERBOSE_DEBUG
+#define matrix_debug_verbose(category, ...)                                    \
+  do {                                                                         \
+  } while (0)
+#else
+#define matrix_debug_verbose(category, ...)                                    \
+  do {                                                                         \
+    if (G_UNLIKELY(purple_debug_is_verbose()))                                 \
+      purple_debug_info(category, __VA_ARGS__);                                \
+  } while (0)
+#endif
+
 int get_chat_id(const char *room_id);
 gboolean is_virtual_room_id(const char *room_id);
 char *dup_base_room_id(const char *room_id);
@@ -16,8 +34,14 @@ void matrix_request_field_set_help_string(PurpleRequestField *field,
                                           const char *hint);
 PurpleAccount *find_matrix_account(void);
 PurpleAccount *find_matrix_account_by_id(const char *user_id);
+void matrix_register_account_id(PurpleAccount *account, const char *user_id);
+void matrix_forget_account_id(PurpleAccount *account);
 char *matrix_get_chat_name(GHashTable *components);
 guint32 get_history_page_size(PurpleAccount *account);
+guint32 get_upload_max_image_dim(PurpleAccount *account);
+char *matrix_new_txn_id(void);
+void matrix_set_current_span(guint64 span);
+guint64 matrix_current_span(void);
 void matrix_ui_refresh_room_chips(PurpleConversation *conv);
 void matrix_utils_cleanup(void);
 
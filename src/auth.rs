@@ -128,7 +128,7 @@ async fn finish_sso_internal(client: Client, token: String) {
             } else {
                 // Notify user of non-mismatch error
                 let event = crate::ffi::FfiEvent::LoginFailed {
-                    user_id: pending_id,
+                    user_id: crate::intern::id(pending_id),
                     message: err_msg,
                 };
                 let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -450,7 +450,7 @@ async fn finish_login_success(client: Client) {
     }
     {
          let event = crate::ffi::FfiEvent::Connected {
-             user_id: username.clone(),
+             user_id: crate::intern::id(&username),
          };
          let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
     }
@@ -487,7 +487,7 @@ async fn finish_login_success(client: Client) {
 fn report_login_failure(msg: String) {
     log::error!("{}", msg);
     let event = crate::ffi::FfiEvent::LoginFailed {
-        user_id: "".to_string(), // we don't always have user ID here, fallback to empty
+        user_id: crate::intern::id(""), // we don't always have user ID here, fallback to empty
         message: msg,
     };
     let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -644,6 +644,12 @@ pub extern "C" fn purple_matrix_rust_logout(user_id: *const c_char) {
     // Just drop the client to stop the sync loop.
     if let Some((_, client)) = crate::CLIENTS.remove(&user_id_str) {
          log::info!("Dropping global client instance for disconnect.");
+         if let Some(uid) = client.user_id() {
+             crate::dm_rooms::forget_account(uid.as_str());
+             crate::history_state::forget_account(uid.as_str());
+             crate::decryption::forget_account(uid.as_str());
+             crate::thread_index::forget_account(uid.as_str());
+         }
          // Ensure client is dropped within the Tokio runtime context to prevent
          // "there is no reactor running" panics from internal components (e.g. deadpool).
          RUNTIME.spawn(async move {
@@ -0,0 +1,266 @@
+// Decryption stage for history pages, and deferred re-rendering.
+//
+// A page's encrypted events are decrypted concurrently (bounded) while the
+// output keeps timeline order. Events whose Megolm session is missing, live
+// or from history, are parked per (account, session id). Whenever the crypto
+// store gains keys (forwarded, shared late or restored from backup) the
+// parked events of those sessions are decrypted as one batch and their
+// "[Encrypted]" lines are replaced in place through MessageEdited.
+
+use dashmap::DashMap;
+use futures_util::stream::{self, StreamExt};
+use matrix_sdk::deserialized_responses::TimelineEvent;
+use matrix_sdk::ruma::events::AnySyncTimelineEvent;
+use matrix_sdk::{Client, Room};
+use once_cell::sync::Lazy;
+
+const DECRYPT_CONCURRENCY: usize = 8;
+// Per session; a session that never gets its key must not grow unbounded.
+const MAX_PENDING_PER_SESSION: usize = 512;
+
+struct Pending {
+    room_id: String,
+    // Conversation the placeholder was written to ("room_id" or "room_id|thread_root").
+    conv_id: String,
+    json: String,
+}
+
+// (account, megolm session id) -> events waiting for that session's key
+static PENDING: Lazy<DashMap<(String, String), Vec<Pending>>> = Lazy::new(DashMap::new);
+// account -> room key watcher task
+static WATCHERS: Lazy<DashMap<String, tokio::task::JoinHandle<()>>> = Lazy::new(DashMap::new);
+
+pub struct Decrypted {
+    pub event: Option<AnySyncTimelineEvent>,
+    pub was_encrypted: bool,
+    // Encrypted and we could not decrypt it (yet).
+    pub undecryptable: bool,
+}
+
+pub async fn decrypt_one(room: &Room, timeline_event: &TimelineEvent) -> Decrypted {
+    use matrix_sdk::ruma::events::AnySyncMessageLikeEvent;
+
+    let event: Option<AnySyncTimelineEvent> = timeline_event.raw().deserialize().ok();
+    if !matches!(event, Some(AnySyncTimelineEvent::MessageLike(AnySyncMessageLikeEvent::RoomEncrypted(_)))) {
+        return Decrypted { event, was_encrypted: false, undecryptable: false };
+    }
+
+    match decrypt_json(room, timeline_event.raw().json().get()).await {
+        Some(ev) => Decrypted { event: Some(ev), was_encrypted: true, undecryptable: false },
+        None => Decrypted { event, was_encrypted: true, undecryptable: true },
+    }
+}
+
+async fn decrypt_json(room: &Room, json: &str) -> Option<AnySyncTimelineEvent> {
+    let raw = matrix_sdk::ruma::serde::Raw::<matrix_sdk::ruma::events::room::encrypted::OriginalSyncRoomEncryptedEvent>::from_json_string(json.to_string()).ok()?;
+    let started = std::time::Instant::now();
+    let result = room.decrypt_event(&raw, None).await;
+    crate::metrics::DECRYPT.record(started.elapsed());
+    match result {
+        Ok(decrypted) => decrypted.raw().deserialize().ok(),
+        Err(e) => {
+            crate::metrics::DECRYPT_FAILURES.inc();
+            log::debug!("Failed to decrypt event in {}: {:?}", room.room_id(), e);
+            None
+        }
+    }
+}
+
+// Decrypts a page, `DECRYPT_CONCURRENCY` events at a time, in input order.
+pub async fn decrypt_page<'a, I>(room: &Room, events: I) -> Vec<Decrypted>
+where
+    I: IntoIterator<Item = &'a TimelineEvent>,
+{
+    stream::iter(events)
+        .map(|ev| decrypt_one(room, ev))
+        .buffered(DECRYPT_CONCURRENCY)
+        .collect()
+        .await
+}
+
+fn session_id(json: &str) -> Option<String> {
+    let v: serde_json::Value = serde_json::from_str(json).ok()?;
+    v.get("content")?.get("session_id")?.as_str().map(|s| s.to_string())
+}
+
+// Parks an undecryptable event until its session's key shows up.
+pub fn defer(room: &Room, conv_id: &str, json: &str) {
+    let Some(account) = room.client().user_id().map(|u| u.to_string()) else { return; };
+    let Some(session) = session_id(json) else { return; };
+    let mut waiting = PENDING.entry((account, session)).or_default();
+    if waiting.len() >= MAX_PENDING_PER_SESSION {
+        waiting.remove(0);
+    }
+    waiting.push(Pending {
+        room_id: room.room_id().to_string(),
+        conv_id: conv_id.to_string(),
+        json: json.to_string(),
+    });
+}
+
+// Parks a page's undecryptable events and asks key backup for the room's
+// keys once; whatever arrives is applied by the key watcher.
+pub fn retry_from_backup(room: Room, conv_id: String, failed: Vec<TimelineEvent>) {
+    if failed.is_empty() {
+        return;
+    }
+    let mut sessions = Vec::new();
+    for ev in &failed {
+        let json = ev.raw().json().get();
+        defer(&room, &conv_id, json);
+        if let Some(s) = session_id(json) {
+            if !sessions.contains(&s) {
+                sessions.push(s);
+            }
+        }
+    }
+    crate::RUNTIME.spawn(async move {
+        let backups = room.client().encryption().backups();
+        if !backups.are_enabled().await {
+            log::debug!("{} undecryptable events in {}, key backup not enabled", failed.len(), conv_id);
+            return;
+        }
+        log::info!("Requesting backup keys for {} undecryptable events in {}", failed.len(), conv_id);
+        if let Err(e) = backups.download_room_keys_for_room(room.room_id()).await {
+            log::warn!("Key backup download for {} failed: {:?}", room.room_id(), e);
+            return;
+        }
+        // Normally the watcher has already done this; a no-op then.
+        if let Some(account) = room.client().user_id().map(|u| u.to_string()) {
+            retry_sessions(&room.client(), &account, sessions).await;
+        }
+    });
+}
+
+// Starts following the account's room key updates. Replaces an earlier
+// watcher for the same account.
+pub fn watch_room_keys(client: Client) {
+    let Some(account) = client.user_id().map(|u| u.to_string()) else { return; };
+    let task_account = account.clone();
+    let handle = crate::RUNTIME.spawn(async move {
+        let Some(mut updates) = client.encryption().room_keys_received_stream().await else {
+            log::debug!("No room key stream for {}", task_account);
+            return;
+        };
+        while let Some(update) = updates.next().await {
+            let sessions: Vec<String> = match update {
+                Ok(infos) => infos.into_iter().map(|info| info.session_id).collect(),
+                // Missed some updates: retry everything parked for the account.
+                Err(_) => PENDING
+                    .iter()
+                    .filter(|e| e.key().0 == task_account)
+                    .map(|e| e.key().1.clone())
+                    .collect(),
+            };
+            retry_sessions(&client, &task_account, sessions).await;
+        }
+    });
+    if let Some(old) = WATCHERS.insert(account, handle) {
+        old.abort();
+    }
+}
+
+pub fn forget_account(account: &str) {
+    if let Some((_, handle)) = WATCHERS.remove(account) {
+        handle.abort();
+    }
+    PENDING.retain(|(a, _), _| a != account);
+}
+
+async fn retry_sessions(client: &Client, account: &str, sessions: Vec<String>) {
+    let mut batch = Vec::new();
+    for session in sessions {
+        if let Some((_, waiting)) = PENDING.remove(&(account.to_string(), session)) {
+            batch.extend(waiting);
+        }
+    }
+    if batch.is_empty() {
+        return;
+    }
+
+    let total = batch.len();
+    let results: Vec<(Pending, Option<AnySyncTimelineEvent>)> = stream::iter(batch)
+        .map(|p| async move {
+            let room = <&matrix_sdk::ruma::RoomId>::try_from(p.room_id.as_str()).ok().and_then(|id| client.get_room(id));
+            let event = match &room {
+                Some(room) => decrypt_json(room, &p.json).await,
+                None => None,
+            };
+            (p, event)
+        })
+        .buffered(DECRYPT_CONCURRENCY)
+        .collect()
+        .await;
+
+    let mut recovered = 0usize;
+    for (pending, event) in results {
+        let room = <&matrix_sdk::ruma::RoomId>::try_from(pending.room_id.as_str()).ok().and_then(|id| client.get_room(id));
+        let Some(room) = room else { continue; };
+        if event.is_none() {
+            // Key arrived but doesn't cover this index yet; keep waiting.
+            defer(&room, &pending.conv_id, &pending.json);
+            continue;
+        }
+        if let Some((body, thread)) = render_decrypted(&room, event.as_ref()).await {
+            recovered += 1;
+            emit_rerender(&room, &pending.conv_id, event.as_ref(), body, thread);
+        }
+    }
+    log::info!("Re-rendered {} of {} deferred events for {}", recovered, total, account);
+}
+
+// Body and thread root of a decrypted message, rendered like the history path.
+async fn render_decrypted(room: &Room, event: Option<&AnySyncTimelineEvent>) -> Option<(String, Option<String>)> {
+    use matrix_sdk::ruma::events::room::message::Relation;
+    use matrix_sdk::ruma::events::AnySyncMessageLikeEvent;
+    match event? {
+        AnySyncTimelineEvent::MessageLike(AnySyncMessageLikeEvent::RoomMessage(msg)) => {
+            let ev = msg.as_original()?;
+            let thread = match &ev.content.relates_to {
+                Some(Relation::Thread(t)) => Some(t.event_id.to_string()),
+                _ => None,
+            };
+            Some((crate::handlers::messages::render_room_message(ev, room).await, thread))
+        }
+        AnySyncTimelineEvent::MessageLike(AnySyncMessageLikeEvent::Sticker(sticker)) => {
+            Some((format!("[Sticker] {}", sticker.as_original()?.content.body), None))
+        }
+        _ => None,
+    }
+}
+
+fn emit_rerender(room: &Room, conv_id: &str, event: Option<&AnySyncTimelineEvent>, body: String, thread_root_id: Option<String>) {
+    let Some(event) = event else { return; };
+    let Some(user_id) = room.client().user_id().map(|u| u.to_string()) else { return; };
+    let event_id = event.event_id().to_string();
+
+    crate::event_store::append(&user_id, room.room_id().as_str(), crate::event_store::StoredEvent {
+        event_id: event_id.clone(),
+        sender: event.sender().to_string(),
+        body: body.clone(),
+        thread_root_id,
+        timestamp: event.origin_server_ts().0.into(),
+        encrypted: true,
+    });
+
+    let _ = crate::ffi::EVENTS_CHANNEL.0.send(crate::ffi::FfiEvent::MessageEdited {
+        user_id: crate::intern::id(&user_id),
+        room_id: crate::intern::id(conv_id),
+        event_id,
+        new_msg: body,
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_session_id_from_encrypted_event() {
+        let json = r#"{"type":"m.room.encrypted","event_id":"$e","sender":"@a:example.org","origin_server_ts":1,
+            "content":{"algorithm":"m.megolm.v1.aes-sha2","ciphertext":"AwgA","device_id":"DEV","sender_key":"k","session_id":"sess1"}}"#;
+        assert_eq!(session_id(json).as_deref(), Some("sess1"));
+        assert_eq!(session_id(r#"{"content":{}}"#), None);
+        assert_eq!(session_id("not json"), None);
+    }
+}
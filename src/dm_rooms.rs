@@ -0,0 +1,101 @@
+// Per-account map from a DM partner to the room we talk to them in.
+//
+// Filled from `m.direct` account data (seeded after the first sync and kept
+// current by the account-data handler) and from every successful resolution.
+// Entries are validated against the room's membership on lookup, and rooms we
+// leave are dropped, so stale ids never leak into the IM send path.
+
+use dashmap::DashMap;
+use matrix_sdk::ruma::{OwnedRoomId, RoomId, UserId};
+use matrix_sdk::{Client, Room, RoomState};
+use once_cell::sync::Lazy;
+
+// (account user_id, partner user_id) -> DM room
+static DM_ROOMS: Lazy<DashMap<(String, String), OwnedRoomId>> = Lazy::new(DashMap::new);
+
+fn account_of(client: &Client) -> String {
+    client.user_id().map(|u| u.to_string()).unwrap_or_default()
+}
+
+fn usable(client: &Client, room_id: &RoomId) -> Option<Room> {
+    client.get_room(room_id)
+        .filter(|r| matches!(r.state(), RoomState::Joined | RoomState::Invited))
+}
+
+fn record(client: &Client, target: &UserId, room_id: &RoomId) {
+    DM_ROOMS.insert((account_of(client), target.to_string()), room_id.to_owned());
+}
+
+// Returns the existing DM room with `target`, if any. Never creates one, so it
+// is safe for chatty callers such as typing notifications.
+pub fn lookup(client: &Client, target: &UserId) -> Option<Room> {
+    let key = (account_of(client), target.to_string());
+    if let Some(room_id) = DM_ROOMS.get(&key).map(|r| r.value().clone()) {
+        if let Some(room) = usable(client, &room_id) {
+            return Some(room);
+        }
+        DM_ROOMS.remove(&key);
+    }
+
+    // Slow path: the SDK walks every room's direct targets.
+    let room = client.get_dm_room(target)?;
+    record(client, target, room.room_id());
+    Some(room)
+}
+
+// Like `lookup`, but creates the DM when none exists yet.
+pub async fn resolve(client: &Client, target: &UserId) -> matrix_sdk::Result<Room> {
+    if let Some(room) = lookup(client, target) {
+        return Ok(room);
+    }
+    log::info!("No DM with {} yet, creating one", target);
+    let room = client.create_dm(target).await?;
+    record(client, target, room.room_id());
+    Ok(room)
+}
+
+// Applies an `m.direct` content map ({ user_id: [room_id, ...] }). The last
+// joined room listed for a user wins, matching the order clients append in.
+pub fn load_direct(client: &Client, content: &serde_json::Value) {
+    let Some(map) = content.as_object() else { return; };
+    let account = account_of(client);
+    let mut count = 0usize;
+    for (user, rooms) in map {
+        let Some(rooms) = rooms.as_array() else { continue; };
+        let chosen = rooms.iter()
+            .rev()
+            .filter_map(|r| r.as_str())
+            .filter_map(|r| <&RoomId>::try_from(r).ok())
+            .find(|r| usable(client, r).is_some());
+        if let Some(room_id) = chosen {
+            DM_ROOMS.insert((account.clone(), user.clone()), room_id.to_owned());
+            count += 1;
+        }
+    }
+    log::debug!("Loaded {} DM room mappings for {}", count, account);
+}
+
+// Seeds the map from the stored `m.direct` event; used once after the first
+// sync, since a resumed sync does not necessarily resend account data.
+pub async fn seed(client: &Client) {
+    use matrix_sdk::ruma::events::direct::DirectEventContent;
+    match client.account().account_data::<DirectEventContent>().await {
+        Ok(Some(raw)) => {
+            if let Ok(content) = raw.deserialize_as::<serde_json::Value>() {
+                load_direct(client, &content);
+            }
+        }
+        Ok(None) => {}
+        Err(e) => log::warn!("Failed to read m.direct: {:?}", e),
+    }
+}
+
+// Drops every mapping that points at `room_id` (we left or were banned).
+pub fn forget_room(client: &Client, room_id: &RoomId) {
+    let account = account_of(client);
+    DM_ROOMS.retain(|(acct, _), rid| !(*acct == account && rid.as_str() == room_id.as_str()));
+}
+
+pub fn forget_account(account: &str) {
+    DM_ROOMS.retain(|(acct, _), _| acct != account);
+}
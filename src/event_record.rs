@@ -0,0 +1,361 @@
+// Opt-in capture and replay of the FfiEvent stream.
+//
+// The recorder writes every event that reaches EVENTS_CHANNEL to a file as
+// MessagePack records of (microseconds since recording started, event),
+// after a magic header. Bodies, topics and display names are replaced with
+// filler of the same length and markup, so a recording shows a user's
+// event mix and sizes but not what they said; room and user ids are kept so
+// the room/sender distribution survives. Replay feeds a recording back into
+// EVENTS_CHANNEL at the original pace, scaled by a speed factor, so the C
+// and UI side can be profiled under a real load shape offline.
+
+use std::fs::File;
+use std::io::{BufRead, BufReader, BufWriter, Read, Write};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+use once_cell::sync::Lazy;
+
+use crate::ffi::FfiEvent;
+
+const MAGIC: &[u8; 8] = b"PMRREC1\n";
+// The C side renders messages with this prefix as system notices.
+const SYSTEM_PREFIX: &str = "[System] ";
+// Records buffered ahead of the writer thread before new ones are dropped.
+const QUEUE_DEPTH: usize = 65536;
+
+struct Recorder {
+    path: String,
+    start: Instant,
+    tx: crossbeam_channel::Sender<Vec<u8>>,
+}
+
+// Checked before taking the lock, so the send path pays one load when off.
+static RECORDING: AtomicBool = AtomicBool::new(false);
+static RECORDER: Lazy<Mutex<Option<Recorder>>> = Lazy::new(|| Mutex::new(None));
+static DROPPED: AtomicU64 = AtomicU64::new(0);
+
+// Same byte length, character count and markup: tag names, entities and a
+// leading "[System] " are kept, other letters and digits become 'x'/'0' and
+// non-ASCII characters a filler of the same UTF-8 width. Equal inputs give
+// equal output.
+pub fn filler(s: &str) -> String {
+    let mut out = String::with_capacity(s.len());
+    let rest = match s.strip_prefix(SYSTEM_PREFIX) {
+        Some(rest) => {
+            out.push_str(SYSTEM_PREFIX);
+            rest
+        }
+        None => s,
+    };
+    let (mut tag_name, mut entity) = (false, false);
+    for c in rest.chars() {
+        if tag_name && (c.is_ascii_alphanumeric() || c == '/') {
+            out.push(c);
+            continue;
+        }
+        if entity && (c.is_ascii_alphanumeric() || c == '#') {
+            out.push(c);
+            continue;
+        }
+        tag_name = c == '<';
+        entity = c == '&';
+        out.push(match c {
+            _ if c.is_ascii_digit() => '0',
+            _ if c.is_ascii_alphanumeric() => 'x',
+            _ if c.is_ascii() => c,
+            _ => match c.len_utf8() {
+                2 => 'ß',
+                3 => '…',
+                _ => '😀',
+            },
+        });
+    }
+    out
+}
+
+fn fill(s: &mut String) {
+    *s = filler(s);
+}
+
+fn fill_opt(s: &mut Option<String>) {
+    if let Some(s) = s {
+        fill(s);
+    }
+}
+
+fn redact(event: &mut FfiEvent) {
+    match event {
+        FfiEvent::MessageReceived { msg, .. } => fill(msg),
+        FfiEvent::MessageEdited { new_msg, .. } => fill(new_msg),
+        FfiEvent::RoomJoined { name, group_name, topic, .. } => {
+            fill(name);
+            fill(group_name);
+            fill_opt(topic);
+        }
+        FfiEvent::ChatTopic { topic, .. } => fill(topic),
+        FfiEvent::ChatUser { alias, .. } => fill_opt(alias),
+        FfiEvent::SearchResult { message, .. } => fill(message),
+        FfiEvent::PollList { question, options_str, .. } => {
+            fill_opt(question);
+            fill_opt(options_str);
+        }
+        FfiEvent::RoomListAdd { name, topic, .. } => {
+            fill(name);
+            fill(topic);
+        }
+        FfiEvent::RoomPreview { html_body, .. } => fill(html_body),
+        FfiEvent::ThreadList { latest_msg, .. } => fill_opt(latest_msg),
+        FfiEvent::ShowUserInfo { display_name, .. } => fill_opt(display_name),
+        FfiEvent::ReactionsChanged { reactions_text, .. } => fill(reactions_text),
+        _ => {}
+    }
+}
+
+// Login, verification and sticker events carry session state or C callback
+// pointers that mean nothing in another process; replaying them would
+// disconnect or crash the replaying client.
+fn recordable(event: &FfiEvent) -> bool {
+    !matches!(
+        event,
+        FfiEvent::LoginFailed { .. }
+            | FfiEvent::Connected { .. }
+            | FfiEvent::SsoUrl { .. }
+            | FfiEvent::SasRequest { .. }
+            | FfiEvent::SasHaveEmoji { .. }
+            | FfiEvent::ShowVerificationQr { .. }
+            | FfiEvent::StickerPack { .. }
+            | FfiEvent::StickerDone { .. }
+            | FfiEvent::Sticker { .. }
+    )
+}
+
+// Replayed events belong to whichever account is replaying them.
+fn set_account(event: &mut FfiEvent, account: &str) {
+    match event {
+        FfiEvent::MessageReceived { user_id, .. }
+        | FfiEvent::Typing { user_id, .. }
+        | FfiEvent::RoomJoined { user_id, .. }
+        | FfiEvent::RoomLeft { user_id, .. }
+        | FfiEvent::ReadMarker { user_id, .. }
+        | FfiEvent::Presence { user_id, .. }
+        | FfiEvent::ChatTopic { user_id, .. }
+        | FfiEvent::ChatUser { user_id, .. }
+        | FfiEvent::Invite { user_id, .. }
+        | FfiEvent::MessageEdited { user_id, .. }
+        | FfiEvent::MessageSent { user_id, .. }
+        | FfiEvent::SearchResult { user_id, .. }
+        | FfiEvent::PollList { user_id, .. }
+        | FfiEvent::PowerLevelUpdate { user_id, .. }
+        | FfiEvent::RoomListAdd { user_id, .. }
+        | FfiEvent::RoomPreview { user_id, .. }
+        | FfiEvent::ThreadList { user_id, .. }
+        | FfiEvent::ShowUserInfo { user_id, .. }
+        | FfiEvent::ReactionsChanged { user_id, .. } => *user_id = crate::intern::id(account),
+        _ => {}
+    }
+}
+
+fn write_record<W: Write>(w: &mut W, micros: u64, event: &FfiEvent) -> Result<(), rmp_serde::encode::Error> {
+    rmp_serde::encode::write(w, &(micros, event))
+}
+
+// None at a clean end of file.
+fn read_record<R: BufRead>(r: &mut R) -> Result<Option<(u64, FfiEvent)>, Box<dyn std::error::Error + Send + Sync>> {
+    if r.fill_buf()?.is_empty() {
+        return Ok(None);
+    }
+    Ok(Some(rmp_serde::decode::from_read(r)?))
+}
+
+fn read_header<R: Read>(r: &mut R) -> std::io::Result<()> {
+    let mut magic = [0u8; 8];
+    r.read_exact(&mut magic)?;
+    if &magic != MAGIC {
+        return Err(std::io::Error::new(std::io::ErrorKind::InvalidData, "not an event recording"));
+    }
+    Ok(())
+}
+
+// Called for every event on its way into EVENTS_CHANNEL.
+pub fn record(event: &FfiEvent) {
+    if !RECORDING.load(Ordering::Relaxed) || !recordable(event) {
+        return;
+    }
+    // Stamped and queued under the lock so records stay in timestamp order.
+    let guard = RECORDER.lock().unwrap_or_else(|e| e.into_inner());
+    let Some(rec) = guard.as_ref() else { return; };
+    let mut event = event.clone();
+    redact(&mut event);
+    let mut buf = Vec::with_capacity(256);
+    if let Err(e) = write_record(&mut buf, rec.start.elapsed().as_micros() as u64, &event) {
+        log::debug!("Failed to encode recorded event: {}", e);
+        return;
+    }
+    if rec.tx.try_send(buf).is_err() {
+        DROPPED.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+fn write_loop(path: String, mut out: BufWriter<File>, rx: crossbeam_channel::Receiver<Vec<u8>>) {
+    let mut written = 0u64;
+    for buf in rx.iter() {
+        if let Err(e) = out.write_all(&buf) {
+            log::warn!("Event recording to {} failed: {}", path, e);
+            return;
+        }
+        written += 1;
+        // Keep the file usable if the client dies mid-session.
+        if rx.is_empty() {
+            let _ = out.flush();
+        }
+    }
+    let _ = out.flush();
+    log::info!(
+        "Event recording to {} finished: {} events, {} dropped",
+        path, written, DROPPED.swap(0, Ordering::Relaxed)
+    );
+}
+
+// Starts, moves or stops recording. An existing file at `path` is replaced;
+// an empty path turns recording off.
+pub fn configure(path: &str) {
+    let path = path.trim();
+    let mut guard = RECORDER.lock().unwrap_or_else(|e| e.into_inner());
+    if guard.as_ref().map(|r| r.path.as_str()) == Some(path) {
+        return;
+    }
+    // Dropping the sender ends the old writer thread once it has drained.
+    if guard.take().is_some() {
+        RECORDING.store(false, Ordering::Relaxed);
+    }
+    if path.is_empty() {
+        return;
+    }
+
+    let mut out = match File::create(path) {
+        Ok(f) => BufWriter::new(f),
+        Err(e) => {
+            log::warn!("Failed to start event recording to {}: {}", path, e);
+            return;
+        }
+    };
+    if let Err(e) = out.write_all(MAGIC) {
+        log::warn!("Failed to start event recording to {}: {}", path, e);
+        return;
+    }
+    let (tx, rx) = crossbeam_channel::bounded(QUEUE_DEPTH);
+    let writer_path = path.to_string();
+    if let Err(e) = std::thread::Builder::new()
+        .name("event-record".to_string())
+        .spawn(move || write_loop(writer_path, out, rx))
+    {
+        log::warn!("Failed to start event recording thread: {}", e);
+        return;
+    }
+    log::info!("Recording FFI events to {}", path);
+    *guard = Some(Recorder { path: path.to_string(), start: Instant::now(), tx });
+    RECORDING.store(true, Ordering::Relaxed);
+}
+
+// Feeds the recording at `path` into EVENTS_CHANNEL as events of `account`.
+// `speed` scales the recorded pace (2.0 is twice as fast); 0 sends
+// everything as fast as the channel takes it. Returns once the file header
+// has been checked; the events follow from a background thread.
+pub fn replay(path: &str, account: &str, speed: f64) -> std::io::Result<()> {
+    let mut reader = BufReader::new(File::open(path)?);
+    read_header(&mut reader)?;
+    let (path, account) = (path.to_string(), account.to_string());
+    std::thread::Builder::new()
+        .name("event-replay".to_string())
+        .spawn(move || {
+            let start = Instant::now();
+            let mut sent = 0u64;
+            loop {
+                let (micros, mut event) = match read_record(&mut reader) {
+                    Ok(Some(r)) => r,
+                    Ok(None) => break,
+                    Err(e) => {
+                        log::warn!("Event replay of {} stopped after {} events: {}", path, sent, e);
+                        break;
+                    }
+                };
+                if speed > 0.0 {
+                    let due = Duration::from_secs_f64(micros as f64 / 1_000_000.0 / speed);
+                    if let Some(wait) = due.checked_sub(start.elapsed()) {
+                        std::thread::sleep(wait);
+                    }
+                }
+                set_account(&mut event, &account);
+                // Not recorded again if a recording is running alongside.
+                if crate::ffi::EVENTS_CHANNEL.0.send_unrecorded(event).is_err() {
+                    break;
+                }
+                sent += 1;
+            }
+            log::info!("Replayed {} events from {} in {:.1} s", sent, path, start.elapsed().as_secs_f64());
+        })?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_filler_preserves_shape() {
+        let body = "<a href=\"https://example.org/x\">Hi Bob</a> &amp; 42 🎉 ünï…";
+        let filled = filler(body);
+        assert_eq!(filled.len(), body.len());
+        assert_eq!(filled.chars().count(), body.chars().count());
+        assert!(filled.starts_with("<a xxxx=\"xxxxx://xxxxxxx.xxx/x\">xx xxx</a> &amp; 00 "));
+        assert!(!filled.contains("Bob") && !filled.contains("example"));
+        assert_eq!(filler(body), filled);
+
+        let notice = "[System] @bob:example.org joined the room.";
+        assert_eq!(filler(notice), "[System] @xxx:xxxxxxx.xxx xxxxxx xxx xxxx.");
+    }
+
+    #[test]
+    fn test_record_roundtrip() {
+        let mut event = FfiEvent::MessageReceived {
+            user_id: crate::intern::id("@me:example.org"),
+            sender: crate::intern::id("@bob:example.org"),
+            msg: "secret plans".to_string(),
+            room_id: Some(crate::intern::id("!room:example.org")),
+            thread_root_id: None,
+            event_id: "$ev".to_string(),
+            timestamp: 1700000000000,
+            encrypted: true,
+        };
+        redact(&mut event);
+
+        let mut buf = MAGIC.to_vec();
+        write_record(&mut buf, 1500, &event).unwrap();
+        write_record(&mut buf, 2500, &FfiEvent::RoomLeft {
+            user_id: crate::intern::id("@me:example.org"),
+            room_id: crate::intern::id("!room:example.org"),
+        }).unwrap();
+
+        let mut reader = std::io::Cursor::new(buf);
+        read_header(&mut reader).unwrap();
+        let (micros, mut event) = read_record(&mut reader).unwrap().unwrap();
+        assert_eq!(micros, 1500);
+        set_account(&mut event, "@replay:localhost");
+        match event {
+            FfiEvent::MessageReceived { user_id, msg, sender, .. } => {
+                assert_eq!(&*user_id, "@replay:localhost");
+                assert_eq!(&*sender, "@bob:example.org");
+                assert_eq!(msg, "xxxxxx xxxxx");
+            }
+            _ => panic!("wrong variant"),
+        }
+        assert!(matches!(read_record(&mut reader).unwrap(), Some((2500, FfiEvent::RoomLeft { .. }))));
+        assert!(read_record(&mut reader).unwrap().is_none());
+    }
+
+    #[test]
+    fn test_read_header_rejects_other_files() {
+        assert!(read_header(&mut std::io::Cursor::new(b"\x89PNG\r\n\x1a\n".to_vec())).is_err());
+    }
+}
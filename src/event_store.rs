@@ -0,0 +1,517 @@
+// Persistent per-room store of rendered timeline events.
+//
+// Each room gets an append-only segment of JSON lines (`<room>.seg`) plus a
+// compact index of little-endian (timestamp, record offset) u64 pairs
+// (`<room>.tix`). Segment order is arrival order, with history pages landing
+// after newer live events, so the newest N by timestamp are picked from the
+// index and read with one seek each instead of parsing the segment. The back-
+// pagination token reached so far is kept alongside (`<room>.tok`), as are
+// edits and redactions of stored events (`<room>.amd`), applied on load. Opening a
+// conversation paints from here and only asks the server for the gap since.
+// Writes go through one background thread; nothing on the sync path touches
+// the disk. Once a room's amendments pile up, that thread compacts it: the
+// segment is rewritten in timestamp order with edits folded in, redacted and
+// duplicate events dropped, and the index rebuilt.
+
+use std::collections::{HashMap, HashSet};
+use std::fs::{File, OpenOptions};
+use std::io::{BufRead, BufReader, BufWriter, Seek, SeekFrom, Write};
+use std::path::PathBuf;
+use std::sync::Mutex;
+use crossbeam_channel::{unbounded, Receiver, Sender};
+use once_cell::sync::Lazy;
+use serde::{Deserialize, Serialize};
+
+// How many stored events are painted when a conversation opens.
+pub const PAINT_LIMIT: usize = 200;
+const INDEX_ENTRY: usize = 16;
+// Rooms whose recent event ids the writer keeps for deduplication.
+const KNOWN_ROOMS: usize = 64;
+// How many of a room's newest stored events are checked for duplicates;
+// older duplicates are dropped by compaction instead.
+const KNOWN_WINDOW: usize = 1000;
+// Amendment bytes written to a room since it was last compacted that
+// trigger the next compaction.
+const COMPACT_AMENDMENTS: u64 = 64 * 1024;
+
+#[derive(Clone, Debug, Serialize, Deserialize, PartialEq)]
+pub struct StoredEvent {
+    pub event_id: String,
+    pub sender: String,
+    pub body: String,
+    pub thread_root_id: Option<String>,
+    pub timestamp: u64,
+    pub encrypted: bool,
+}
+
+#[derive(Default)]
+pub struct StoredRoom {
+    // Oldest first.
+    pub events: Vec<StoredEvent>,
+    pub token: Option<String>,
+    // Older stored events may remain past `events`.
+    pub more: bool,
+}
+
+// A later change to a stored event: its new body after an edit, or None once
+// it was redacted.
+#[derive(Debug, Serialize, Deserialize, PartialEq)]
+struct Amendment {
+    target: String,
+    body: Option<String>,
+}
+
+enum Op {
+    Append { dir: PathBuf, room: String, event: StoredEvent },
+    Amend { dir: PathBuf, room: String, amendment: Amendment },
+    Token { dir: PathBuf, room: String, token: String },
+}
+
+// Held while a compaction swaps a room's files and while a reader opens them,
+// so a reader never pairs an old segment with a new index.
+static FILES: Lazy<Mutex<()>> = Lazy::new(|| Mutex::new(()));
+
+static WRITER: Lazy<Sender<Op>> = Lazy::new(|| {
+    let (tx, rx) = unbounded();
+    if let Err(e) = std::thread::Builder::new()
+        .name("event-store".to_string())
+        .spawn(move || run_writer(rx))
+    {
+        log::error!("Failed to start event store writer: {}", e);
+    }
+    tx
+});
+
+pub fn safe_name(s: &str) -> String {
+    s.chars().map(|c| if c.is_ascii_alphanumeric() || c == '.' || c == '-' { c } else { '_' }).collect()
+}
+
+fn account_dir(account: &str) -> Option<PathBuf> {
+    let mut path = crate::DATA_PATH.lock().unwrap_or_else(|e| e.into_inner()).clone()?;
+    path.push("events");
+    path.push(safe_name(account));
+    Some(path)
+}
+
+fn room_file(dir: &PathBuf, room: &str, ext: &str) -> PathBuf {
+    dir.join(format!("{}.{}", safe_name(room), ext))
+}
+
+// Queues a rendered event for `room_id` (no thread suffix). Placeholders for
+// undecryptable events are not stored so they are retried from the network.
+pub fn append(account: &str, room_id: &str, event: StoredEvent) {
+    if event.event_id.is_empty() || event.body.is_empty() || event.body == "[Encrypted]" {
+        return;
+    }
+    let Some(dir) = account_dir(account) else { return; };
+    let _ = WRITER.send(Op::Append { dir, room: room_id.to_string(), event });
+}
+
+// Replaces the body of a stored event (an edit arrived).
+pub fn replace(account: &str, room_id: &str, event_id: &str, body: &str) {
+    amend(account, room_id, Amendment { target: event_id.to_string(), body: Some(body.to_string()) });
+}
+
+// Drops a stored event (it was redacted).
+pub fn redact(account: &str, room_id: &str, event_id: &str) {
+    amend(account, room_id, Amendment { target: event_id.to_string(), body: None });
+}
+
+fn amend(account: &str, room_id: &str, amendment: Amendment) {
+    if amendment.target.is_empty() {
+        return;
+    }
+    let Some(dir) = account_dir(account) else { return; };
+    let _ = WRITER.send(Op::Amend { dir, room: room_id.to_string(), amendment });
+}
+
+// Remembers how far back the room has been paginated.
+pub fn save_token(account: &str, room_id: &str, token: &str) {
+    let Some(dir) = account_dir(account) else { return; };
+    let _ = WRITER.send(Op::Token { dir, room: room_id.to_string(), token: token.to_string() });
+}
+
+// Reads the `limit` newest stored events (oldest first) and the saved token.
+// Blocking.
+pub fn load_tail(account: &str, room_id: &str, limit: usize) -> StoredRoom {
+    let Some(dir) = account_dir(account) else { return StoredRoom::default(); };
+    load_page_in(&dir, room_id, None, limit)
+}
+
+// The next page back: the `limit` newest stored events older than the one at
+// (`timestamp`, `event_id`). Blocking.
+pub fn load_before(account: &str, room_id: &str, timestamp: u64, event_id: &str, limit: usize) -> StoredRoom {
+    let Some(dir) = account_dir(account) else { return StoredRoom::default(); };
+    load_page_in(&dir, room_id, Some((timestamp, event_id)), limit)
+}
+
+fn load_page_in(dir: &PathBuf, room_id: &str, before: Option<(u64, &str)>, limit: usize) -> StoredRoom {
+    let token = std::fs::read_to_string(room_file(dir, room_id, "tok"))
+        .ok()
+        .map(|t| t.trim().to_string())
+        .filter(|t| !t.is_empty());
+    let guard = FILES.lock().unwrap_or_else(|e| e.into_inner());
+    let Ok(seg) = File::open(room_file(dir, room_id, "seg")) else {
+        return StoredRoom { events: Vec::new(), token, more: false };
+    };
+    let mut seg = BufReader::new(seg);
+    let index = std::fs::read(room_file(dir, room_id, "tix"));
+    let amendments = load_amendments(&room_file(dir, room_id, "amd"));
+    drop(guard);
+
+    let mut entries = match index {
+        Ok(bytes) => parse_index(&bytes),
+        // Written before the index existed; the writer rebuilds it.
+        Err(_) => index_segment(&mut seg),
+    };
+    if let Some((before_ts, _)) = before {
+        entries.retain(|(timestamp, _)| *timestamp <= before_ts);
+    }
+
+    // Newest first; equal timestamps are settled by event id below, so every
+    // candidate sharing the cut-off timestamp is read.
+    entries.sort_unstable_by(|a, b| b.cmp(a));
+    let mut events: Vec<StoredEvent> = Vec::new();
+    let mut seen = HashSet::new();
+    let mut more = false;
+    for (timestamp, offset) in entries {
+        if events.len() >= limit && events.last().is_some_and(|e| timestamp < e.timestamp) {
+            more = true;
+            break;
+        }
+        let Some(mut ev) = read_at(&mut seg, offset) else { continue; };
+        if before.is_some_and(|(ts, id)| (ev.timestamp, ev.event_id.as_str()) >= (ts, id)) {
+            continue;
+        }
+        if !seen.insert(ev.event_id.clone()) {
+            continue;
+        }
+        match amendments.get(&ev.event_id) {
+            Some(Some(body)) => ev.body = body.clone(),
+            Some(None) => continue,
+            None => {}
+        }
+        events.push(ev);
+    }
+    events.sort_by(|a, b| (b.timestamp, &b.event_id).cmp(&(a.timestamp, &a.event_id)));
+    more |= events.len() > limit;
+    events.truncate(limit);
+    events.reverse();
+    StoredRoom { events, token, more }
+}
+
+fn index_entry(timestamp: u64, offset: u64) -> [u8; INDEX_ENTRY] {
+    let mut entry = [0u8; INDEX_ENTRY];
+    entry[..8].copy_from_slice(&timestamp.to_le_bytes());
+    entry[8..].copy_from_slice(&offset.to_le_bytes());
+    entry
+}
+
+// A torn entry at the end (crash mid-append) is ignored.
+fn parse_index(bytes: &[u8]) -> Vec<(u64, u64)> {
+    bytes
+        .chunks_exact(INDEX_ENTRY)
+        .map(|c| {
+            let (ts, off) = c.split_at(8);
+            (u64::from_le_bytes(ts.try_into().unwrap_or_default()), u64::from_le_bytes(off.try_into().unwrap_or_default()))
+        })
+        .collect()
+}
+
+// (timestamp, offset) of every record, by reading the whole segment.
+fn index_segment(seg: &mut BufReader<File>) -> Vec<(u64, u64)> {
+    let mut entries = Vec::new();
+    if seg.seek(SeekFrom::Start(0)).is_err() {
+        return entries;
+    }
+    let (mut offset, mut line) = (0u64, String::new());
+    loop {
+        line.clear();
+        match seg.read_line(&mut line) {
+            Ok(0) | Err(_) => break,
+            Ok(n) => {
+                if let Ok(ev) = serde_json::from_str::<StoredEvent>(&line) {
+                    entries.push((ev.timestamp, offset));
+                }
+                offset += n as u64;
+            }
+        }
+    }
+    entries
+}
+
+fn read_at(seg: &mut BufReader<File>, offset: u64) -> Option<StoredEvent> {
+    seg.seek(SeekFrom::Start(offset)).ok()?;
+    let mut line = String::new();
+    seg.read_line(&mut line).ok()?;
+    serde_json::from_str(&line).ok()
+}
+
+// event id -> latest amendment; later lines win.
+fn load_amendments(path: &PathBuf) -> HashMap<String, Option<String>> {
+    let mut amendments = HashMap::new();
+    if let Ok(file) = File::open(path) {
+        for line in BufReader::new(file).lines().map_while(Result::ok) {
+            if let Ok(a) = serde_json::from_str::<Amendment>(&line) {
+                // A redaction is final; an edit relayed after it must not revive the event.
+                if amendments.get(&a.target) != Some(&None) {
+                    amendments.insert(a.target, a.body);
+                }
+            }
+        }
+    }
+    amendments
+}
+
+fn append_in(dir: &PathBuf, room: &str, event: &StoredEvent) -> std::io::Result<()> {
+    std::fs::create_dir_all(dir)?;
+    let mut line = serde_json::to_string(event)?;
+    line.push('\n');
+
+    let mut seg = OpenOptions::new().create(true).append(true).open(room_file(dir, room, "seg"))?;
+    let offset = seg.metadata()?.len();
+    seg.write_all(line.as_bytes())?;
+    // Segment first: an index entry must never point past the data.
+    let mut tix = OpenOptions::new().create(true).append(true).open(room_file(dir, room, "tix"))?;
+    tix.write_all(&index_entry(event.timestamp, offset))
+}
+
+// Rewrites the room's segment oldest first with its amendments folded in and
+// redacted or duplicate events dropped, and rebuilds the index (replacing the
+// offset-only one of older stores). Amendments for events not stored (yet)
+// are kept.
+fn compact_in(dir: &PathBuf, room: &str) -> std::io::Result<()> {
+    if !room_file(dir, room, "seg").exists() {
+        return Ok(());
+    }
+    let mut amendments = load_amendments(&room_file(dir, room, "amd"));
+    let mut events = Vec::new();
+    let mut seen = HashSet::new();
+    for line in BufReader::new(File::open(room_file(dir, room, "seg"))?).lines().map_while(Result::ok) {
+        let Ok(mut ev) = serde_json::from_str::<StoredEvent>(&line) else { continue; };
+        if !seen.insert(ev.event_id.clone()) {
+            continue;
+        }
+        match amendments.remove(&ev.event_id) {
+            Some(Some(body)) => ev.body = body,
+            Some(None) => continue,
+            None => {}
+        }
+        events.push(ev);
+    }
+    events.sort_by(|a, b| (a.timestamp, &a.event_id).cmp(&(b.timestamp, &b.event_id)));
+
+    let (seg_tmp, tix_tmp, amd_tmp) = (room_file(dir, room, "seg.tmp"), room_file(dir, room, "tix.tmp"), room_file(dir, room, "amd.tmp"));
+    let mut seg = BufWriter::new(File::create(&seg_tmp)?);
+    let mut tix = BufWriter::new(File::create(&tix_tmp)?);
+    let mut offset = 0u64;
+    for ev in &events {
+        let mut line = serde_json::to_string(ev)?;
+        line.push('\n');
+        seg.write_all(line.as_bytes())?;
+        tix.write_all(&index_entry(ev.timestamp, offset))?;
+        offset += line.len() as u64;
+    }
+    seg.flush()?;
+    tix.flush()?;
+    let mut amd = BufWriter::new(File::create(&amd_tmp)?);
+    for (target, body) in amendments {
+        let mut line = serde_json::to_string(&Amendment { target, body })?;
+        line.push('\n');
+        amd.write_all(line.as_bytes())?;
+    }
+    amd.flush()?;
+    drop((seg, tix, amd));
+
+    // Index out first: a crash between the renames leaves a segment without
+    // one, which is scanned and compacted again, never a stale index.
+    let _guard = FILES.lock().unwrap_or_else(|e| e.into_inner());
+    for ext in ["tix", "idx"] {
+        match std::fs::remove_file(room_file(dir, room, ext)) {
+            Err(e) if e.kind() != std::io::ErrorKind::NotFound => return Err(e),
+            _ => {}
+        }
+    }
+    std::fs::rename(&seg_tmp, room_file(dir, room, "seg"))?;
+    std::fs::rename(&tix_tmp, room_file(dir, room, "tix"))?;
+    std::fs::rename(&amd_tmp, room_file(dir, room, "amd"))
+}
+
+fn file_len(path: &PathBuf) -> u64 {
+    std::fs::metadata(path).map(|m| m.len()).unwrap_or(0)
+}
+
+// What the writer remembers about a room it wrote to recently.
+struct RoomState {
+    // Ids among the newest KNOWN_WINDOW stored events, plus those appended since.
+    ids: HashSet<String>,
+    // Size of the amendment file when the room was last compacted or loaded.
+    amendments_base: u64,
+    last_used: u64,
+}
+
+fn room_state<'a>(rooms: &'a mut HashMap<PathBuf, RoomState>, dir: &PathBuf, room: &str, tick: u64) -> &'a mut RoomState {
+    let seg = room_file(dir, room, "seg");
+    if !rooms.contains_key(&seg) {
+        if rooms.len() >= KNOWN_ROOMS {
+            if let Some(lru) = rooms.iter().min_by_key(|(_, r)| r.last_used).map(|(k, _)| k.clone()) {
+                rooms.remove(&lru);
+            }
+        }
+        // Stored before the timestamp index existed.
+        if seg.exists() && !room_file(dir, room, "tix").exists() {
+            if let Err(e) = compact_in(dir, room) {
+                log::warn!("Failed to index stored events for {}: {}", room, e);
+            }
+        }
+    }
+    let state = rooms.entry(seg).or_insert_with(|| RoomState {
+        ids: load_page_in(dir, room, None, KNOWN_WINDOW).events.into_iter().map(|e| e.event_id).collect(),
+        amendments_base: file_len(&room_file(dir, room, "amd")),
+        last_used: tick,
+    });
+    state.last_used = tick;
+    state
+}
+
+fn amend_in(dir: &PathBuf, room: &str, amendment: &Amendment) -> std::io::Result<()> {
+    std::fs::create_dir_all(dir)?;
+    let mut line = serde_json::to_string(amendment)?;
+    line.push('\n');
+    OpenOptions::new().create(true).append(true).open(room_file(dir, room, "amd"))?.write_all(line.as_bytes())
+}
+
+fn run_writer(rx: Receiver<Op>) {
+    // segment path -> state, for the KNOWN_ROOMS rooms written most recently
+    let mut rooms: HashMap<PathBuf, RoomState> = HashMap::new();
+    let mut tick = 0u64;
+    while let Ok(op) = rx.recv() {
+        tick += 1;
+        match op {
+            Op::Append { dir, room, event } => {
+                let state = room_state(&mut rooms, &dir, &room, tick);
+                if state.ids.contains(&event.event_id) {
+                    continue;
+                }
+                match append_in(&dir, &room, &event) {
+                    Ok(()) => {
+                        state.ids.insert(event.event_id);
+                        // Reloaded from the recent window on the next write.
+                        if state.ids.len() > KNOWN_WINDOW * 2 {
+                            rooms.remove(&room_file(&dir, &room, "seg"));
+                        }
+                    }
+                    Err(e) => log::warn!("Failed to store event for {}: {}", room, e),
+                }
+            }
+            Op::Amend { dir, room, amendment } => {
+                if let Err(e) = amend_in(&dir, &room, &amendment) {
+                    log::warn!("Failed to store amendment for {}: {}", room, e);
+                    continue;
+                }
+                let amd = room_file(&dir, &room, "amd");
+                let state = room_state(&mut rooms, &dir, &room, tick);
+                if file_len(&amd) > state.amendments_base + COMPACT_AMENDMENTS {
+                    if let Err(e) = compact_in(&dir, &room) {
+                        log::warn!("Failed to compact stored events for {}: {}", room, e);
+                    }
+                    state.amendments_base = file_len(&amd);
+                }
+            }
+            Op::Token { dir, room, token } => {
+                let _ = std::fs::create_dir_all(&dir);
+                if let Err(e) = std::fs::write(room_file(&dir, &room, "tok"), token) {
+                    log::warn!("Failed to store pagination token for {}: {}", room, e);
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn ev(id: &str, ts: u64) -> StoredEvent {
+        StoredEvent {
+            event_id: id.to_string(),
+            sender: "@alice:example.org".to_string(),
+            body: format!("message {}", id),
+            thread_root_id: None,
+            timestamp: ts,
+            encrypted: false,
+        }
+    }
+
+    #[test]
+    fn test_tail_reads_newest_events_via_index() {
+        let dir = std::env::temp_dir().join(format!("pmr_event_store_{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        let room = "!room:example.org";
+
+        assert!(load_page_in(&dir, room, None, 10).events.is_empty());
+
+        // Out of order on purpose: history pages land after live events.
+        for (id, ts) in [("$3", 30), ("$4", 40), ("$1", 10), ("$2", 20), ("$5", 50)] {
+            append_in(&dir, room, &ev(id, ts)).unwrap();
+        }
+        let tail = load_page_in(&dir, room, None, 2);
+        let ids: Vec<&str> = tail.events.iter().map(|e| e.event_id.as_str()).collect();
+        assert_eq!(ids, vec!["$4", "$5"]);
+        assert!(tail.more);
+
+        let page = load_page_in(&dir, room, Some((40, "$4")), 2);
+        let ids: Vec<&str> = page.events.iter().map(|e| e.event_id.as_str()).collect();
+        assert_eq!(ids, vec!["$2", "$3"]);
+        assert!(page.more);
+        let page = load_page_in(&dir, room, Some((20, "$2")), 2);
+        assert_eq!(page.events, vec![ev("$1", 10)]);
+        assert!(!page.more);
+
+        let all = load_page_in(&dir, room, None, 100);
+        assert_eq!(all.events.len(), 5);
+        assert!(!all.more);
+        assert_eq!(all.events[0], ev("$1", 10));
+        assert!(all.token.is_none());
+
+        // Stores from before the index are read by scanning, then indexed.
+        std::fs::remove_file(room_file(&dir, room, "tix")).unwrap();
+        assert_eq!(load_page_in(&dir, room, None, 2).events, tail.events);
+        compact_in(&dir, room).unwrap();
+        assert_eq!(load_page_in(&dir, room, None, 2).events, tail.events);
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_edits_and_redactions_apply_on_load() {
+        let dir = std::env::temp_dir().join(format!("pmr_event_store_amend_{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        let room = "!room:example.org";
+
+        for (id, ts) in [("$1", 10), ("$2", 20), ("$3", 30)] {
+            append_in(&dir, room, &ev(id, ts)).unwrap();
+        }
+        amend_in(&dir, room, &Amendment { target: "$1".to_string(), body: Some("fixed".to_string()) }).unwrap();
+        amend_in(&dir, room, &Amendment { target: "$2".to_string(), body: None }).unwrap();
+        amend_in(&dir, room, &Amendment { target: "$2".to_string(), body: Some("late edit".to_string()) }).unwrap();
+
+        let tail = load_page_in(&dir, room, None, 10);
+        let bodies: Vec<(&str, &str)> = tail.events.iter().map(|e| (e.event_id.as_str(), e.body.as_str())).collect();
+        assert_eq!(bodies, vec![("$1", "fixed"), ("$3", "message $3")]);
+
+        // Compaction folds all that into the segment and keeps the edit of
+        // an event not stored yet.
+        append_in(&dir, room, &ev("$3", 30)).unwrap();
+        amend_in(&dir, room, &Amendment { target: "$9".to_string(), body: Some("early edit".to_string()) }).unwrap();
+        compact_in(&dir, room).unwrap();
+        assert_eq!(load_page_in(&dir, room, None, 10).events, tail.events);
+        let seg = std::fs::read_to_string(room_file(&dir, room, "seg")).unwrap();
+        assert_eq!(seg.lines().count(), 2);
+        let amendments = load_amendments(&room_file(&dir, room, "amd"));
+        assert_eq!(amendments.len(), 1);
+        assert_eq!(amendments.get("$9"), Some(&Some("early edit".to_string())));
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
@@ -0,0 +1,110 @@
+// Receive-to-display tracing for events crossing into C.
+//
+// Every FfiEvent gets a span id when it is queued. When the C poll timer
+// takes it, the span is opened with the enqueue instant. C reports back
+// through `purple_matrix_rust_trace_event`: once when the event has been
+// dispatched, and for messages again when the line has been written to a
+// conversation. That gives enqueue->dispatch and enqueue->display latency.
+// A message handled without being written anywhere (no open conversation,
+// unknown account) is closed as dropped. Should C still leak spans, the
+// oldest open ones are evicted once MAX_OPEN is reached.
+
+use std::collections::BTreeMap;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::time::Instant;
+use once_cell::sync::Lazy;
+
+pub const STAGE_DISPATCHED: i32 = 1;
+pub const STAGE_DISPLAYED: i32 = 2;
+pub const STAGE_DROPPED: i32 = 3;
+
+const MAX_OPEN: usize = 4096;
+
+struct Open {
+    enqueued: Instant,
+    // Closed on display rather than on dispatch.
+    displayable: bool,
+}
+
+static NEXT_SPAN: AtomicU64 = AtomicU64::new(1);
+// Span ids grow with enqueue order, so the first key is the oldest span.
+static OPEN: Lazy<Mutex<BTreeMap<u64, Open>>> = Lazy::new(|| Mutex::new(BTreeMap::new()));
+
+fn open_spans() -> std::sync::MutexGuard<'static, BTreeMap<u64, Open>> {
+    OPEN.lock().unwrap_or_else(|e| e.into_inner())
+}
+
+pub fn next_span() -> u64 {
+    NEXT_SPAN.fetch_add(1, Ordering::Relaxed)
+}
+
+pub fn dequeued(span: u64, enqueued: Instant, displayable: bool) {
+    let mut open = open_spans();
+    while open.len() >= MAX_OPEN {
+        open.pop_first();
+    }
+    open.insert(span, Open { enqueued, displayable });
+}
+
+pub fn report(span: u64, stage: i32) {
+    let mut open = open_spans();
+    match stage {
+        STAGE_DISPATCHED => {
+            let Some(o) = open.get(&span) else { return; };
+            crate::metrics::DISPATCH.record(o.enqueued.elapsed());
+            if !o.displayable {
+                open.remove(&span);
+            }
+        }
+        STAGE_DISPLAYED => {
+            if let Some(o) = open.remove(&span) {
+                crate::metrics::RECEIVE_TO_DISPLAY.record(o.enqueued.elapsed());
+            }
+        }
+        STAGE_DROPPED => {
+            open.remove(&span);
+        }
+        _ => {}
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // One test: both halves share the global span table.
+    #[test]
+    fn test_span_lifecycle() {
+        let (a, b) = (next_span(), next_span());
+        assert_ne!(a, b);
+
+        dequeued(a, Instant::now(), false);
+        report(a, STAGE_DISPATCHED);
+        assert!(!open_spans().contains_key(&a));
+
+        dequeued(b, Instant::now(), true);
+        report(b, STAGE_DISPATCHED);
+        assert!(open_spans().contains_key(&b));
+        report(b, STAGE_DISPLAYED);
+        assert!(!open_spans().contains_key(&b));
+        // Unknown or already closed spans are ignored.
+        report(b, STAGE_DISPLAYED);
+
+        let c = next_span();
+        dequeued(c, Instant::now(), true);
+        report(c, STAGE_DISPATCHED);
+        report(c, STAGE_DROPPED);
+        assert!(!open_spans().contains_key(&c));
+
+        // A full table evicts the oldest spans first.
+        let spans: Vec<u64> = (0..MAX_OPEN + 1).map(|_| next_span()).collect();
+        for &s in &spans {
+            dequeued(s, Instant::now(), true);
+        }
+        let open = open_spans();
+        assert!(open.len() <= MAX_OPEN);
+        assert!(!open.contains_key(&spans[0]));
+        assert!(open.contains_key(&spans[MAX_OPEN]));
+    }
+}
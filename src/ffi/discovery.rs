@@ -19,8 +19,8 @@ pub extern "C" fn purple_matrix_rust_fetch_public_rooms_for_list(user_id: *const
                  Ok(response) => {
                      for room in response.chunk {
                          let event = crate::ffi::FfiEvent::RoomListAdd {
-                             user_id: user_id_str.clone(),
-                             room_id: room.room_id.to_string(),
+                             user_id: crate::intern::id(&user_id_str),
+                             room_id: crate::intern::id(&room.room_id),
                              name: room.name.unwrap_or_default(),
                              topic: room.topic.unwrap_or_default(),
                              member_count: u64::from(room.num_joined_members) as usize,
@@ -55,7 +55,7 @@ pub extern "C" fn purple_matrix_rust_fetch_room_preview(user_id: *const c_char,
                                 let html = format!("<b>Room Preview:</b><br/>ID: {}<br/>Server: {:?}", room_id, response.servers);
                                 
                                 let event = crate::ffi::FfiEvent::RoomPreview {
-                                    user_id: user_id_str.clone(),
+                                    user_id: crate::intern::id(&user_id_str),
                                     room_id_or_alias: room_id_or_alias_str.clone(),
                                     html_body: html,
                                 };
@@ -68,7 +68,7 @@ pub extern "C" fn purple_matrix_rust_fetch_room_preview(user_id: *const c_char,
                     // It's already a Room ID
                     let html = format!("<b>Room Info:</b><br/>ID: {}", room_id_or_alias_str);
                     let event = crate::ffi::FfiEvent::RoomPreview {
-                        user_id: user_id_str.clone(),
+                        user_id: crate::intern::id(&user_id_str),
                         room_id_or_alias: room_id_or_alias_str.clone(),
                         html_body: html,
                     };
@@ -101,8 +101,8 @@ pub extern "C" fn purple_matrix_rust_search_public_rooms(user_id: *const c_char,
                  Ok(response) => {
                      for room in response.chunk {
                          let event = crate::ffi::FfiEvent::RoomListAdd {
-                             user_id: user_id_str.clone(),
-                             room_id: room.room_id.to_string(),
+                             user_id: crate::intern::id(&user_id_str),
+                             room_id: crate::intern::id(&room.room_id),
                              name: room.name.unwrap_or_default(),
                              topic: room.topic.unwrap_or_default(),
                              member_count: u64::from(room.num_joined_members) as usize,
@@ -1,26 +1,57 @@
-use std::ffi::CString;
-use std::os::raw::c_char;
+use std::borrow::Cow;
+use std::os::raw::{c_char, c_void};
 
-pub fn to_c_char(s: &str) -> *mut c_char {
-    match CString::new(crate::sanitize_string(s)) {
-        Ok(c) => c.into_raw(),
-        Err(_) => CString::new("").unwrap_or_default().into_raw()
-    }
-}
+pub use crate::intern::Id;
 
-pub fn to_c_char_opt(s: &Option<String>) -> *mut c_char {
-    if let Some(val) = s {
-        to_c_char(val)
+// Text as C sees it, matching CString::new(sanitize_string(s)): characters
+// outside the BMP become spaces, an empty string becomes " " and one with an
+// interior NUL becomes "". Only the first of those needs a copy.
+fn c_text(s: &str) -> Cow<'_, str> {
+    if s.is_empty() {
+        Cow::Borrowed(" ")
+    } else if s.contains('\0') {
+        Cow::Borrowed("")
+    } else if s.bytes().any(|b| b >= 0xF0) {
+        Cow::Owned(crate::sanitize_string(s))
     } else {
-        std::ptr::null_mut()
+        Cow::Borrowed(s)
     }
 }
 
-pub fn free_c_char(ptr: *mut c_char) {
-    if !ptr.is_null() {
-        unsafe {
-            let _ = CString::from_raw(ptr);
+// Lays an event out in one malloc: the C struct, then its NUL-terminated
+// strings, which the struct's pointers refer to (None stays NULL). `build`
+// gets those pointers in the order the strings were given. The C side reads
+// the fields in place and purple_matrix_rust_free_event releases the lot
+// with a single free.
+pub fn pack<T, const N: usize>(strings: [Option<&str>; N], build: impl FnOnce([*mut c_char; N]) -> T) -> *mut c_void {
+    let strings = strings.map(|s| s.map(c_text));
+    let header = std::mem::size_of::<T>();
+    let total = header + strings.iter().flatten().map(|s| s.len() + 1).sum::<usize>();
+    unsafe {
+        // malloc's alignment covers every C* struct.
+        let base = libc::malloc(total) as *mut u8;
+        if base.is_null() {
+            std::alloc::handle_alloc_error(std::alloc::Layout::from_size_align_unchecked(total, std::mem::align_of::<T>()));
         }
+        let mut ptrs = [std::ptr::null_mut(); N];
+        let mut at = base.add(header);
+        for (ptr, s) in ptrs.iter_mut().zip(strings.iter()) {
+            if let Some(s) = s {
+                std::ptr::copy_nonoverlapping(s.as_ptr(), at, s.len());
+                *at.add(s.len()) = 0;
+                *ptr = at as *mut c_char;
+                at = at.add(s.len() + 1);
+            }
+        }
+        std::ptr::write(base as *mut T, build(ptrs));
+        base as *mut c_void
+    }
+}
+
+// Releases a struct built by `pack`.
+pub fn free_packed(data: *mut c_void) {
+    if !data.is_null() {
+        unsafe { libc::free(data) };
     }
 }
 
@@ -232,6 +263,23 @@ pub struct CMessageEdited {
     pub new_msg: *mut c_char,
 }
 
+#[repr(C)]
+pub struct CSearch {
+    pub user_id: *mut c_char,
+    pub room_id: *mut c_char,
+    pub sender: *mut c_char,
+    pub message: *mut c_char,
+    pub timestamp_str: *mut c_char,
+}
+
+#[repr(C)]
+pub struct CMessageSent {
+    pub user_id: *mut c_char,
+    pub room_id: *mut c_char,
+    pub txn_id: *mut c_char,
+    pub event_id: *mut c_char,
+}
+
 #[repr(C)]
 pub struct CReactionsChanged {
     pub user_id: *mut c_char,
@@ -240,26 +288,30 @@ pub struct CReactionsChanged {
     pub reactions_text: *mut c_char,
 }
 
+// Serde is for the event recorder (event_record.rs). Account, room and the
+// busiest user ids are interned (crate::intern) so building an event does
+// not allocate them again.
+#[derive(Clone, serde::Serialize, serde::Deserialize)]
 pub enum FfiEvent {
     MessageReceived {
-        user_id: String,
-        sender: String,
+        user_id: Id,
+        sender: Id,
         msg: String,
-        room_id: Option<String>,
+        room_id: Option<Id>,
         thread_root_id: Option<String>,
         event_id: String,
         timestamp: u64,
         encrypted: bool,
     },
     Typing {
-        user_id: String,
-        room_id: String,
-        who: String,
+        user_id: Id,
+        room_id: Id,
+        who: Id,
         is_typing: bool,
     },
     RoomJoined {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         name: String,
         group_name: String,
         avatar_url: Option<String>,
@@ -268,82 +320,96 @@ pub enum FfiEvent {
         member_count: u64,
     },
     RoomLeft {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
     },
     ReadMarker {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         event_id: String,
-        who: String,
+        who: Id,
     },
     Presence {
-        user_id: String,
-        target_user_id: String,
+        user_id: Id,
+        target_user_id: Id,
         is_online: bool,
     },
     ChatTopic {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         topic: String,
         sender: String,
     },
     ChatUser {
-        user_id: String,
-        room_id: String,
-        member_id: String,
+        user_id: Id,
+        room_id: Id,
+        member_id: Id,
         add: bool,
         alias: Option<String>,
         avatar_path: Option<String>,
     },
     Invite {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         inviter: String,
     },
     LoginFailed {
-        user_id: String,
+        user_id: Id,
         message: String,
     },
     Connected {
-        user_id: String,
+        user_id: Id,
     },
     SsoUrl {
         url: String,
     },
     MessageEdited {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         event_id: String,
         new_msg: String,
     },
+    MessageSent {
+        user_id: Id,
+        room_id: Id,
+        txn_id: String,
+        event_id: String,
+    },
+    // One row of a message search; `sender: None` terminates the result set.
+    SearchResult {
+        user_id: Id,
+        room_id: Id,
+        sender: Option<String>,
+        message: String,
+        timestamp_str: String,
+    },
     SasRequest {
-        user_id: String,
-        target_user_id: String,
+        user_id: Id,
+        target_user_id: Id,
         flow_id: String,
     },
     SasHaveEmoji {
-        user_id: String,
-        target_user_id: String,
+        user_id: Id,
+        target_user_id: Id,
         flow_id: String,
         emojis: String,
     },
     ShowVerificationQr {
-        user_id: String,
-        target_user_id: String,
+        user_id: Id,
+        target_user_id: Id,
         html_data: String,
     },
     PollList {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         event_id: Option<String>,
         question: Option<String>,
         sender: Option<String>,
         options_str: Option<String>,
     },
     PowerLevelUpdate {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         is_admin: bool,
         can_kick: bool,
         can_ban: bool,
@@ -351,8 +417,8 @@ pub enum FfiEvent {
         can_invite: bool,
     },
     RoomListAdd {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         name: String,
         topic: String,
         member_count: usize,
@@ -360,28 +426,28 @@ pub enum FfiEvent {
         parent_id: Option<String>,
     },
     RoomPreview {
-        user_id: String,
+        user_id: Id,
         room_id_or_alias: String,
         html_body: String,
     },
     ThreadList {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         thread_root_id: Option<String>,
         latest_msg: Option<String>,
         count: u64,
         ts: u64,
     },
     ShowUserInfo {
-        user_id: String,
-        target_user_id: String,
+        user_id: Id,
+        target_user_id: Id,
         display_name: Option<String>,
         avatar_url: Option<String>,
         is_online: bool,
     },
     StickerPack {
         cb_ptr: usize,
-        user_id: String,
+        user_id: Id,
         pack_id: String,
         pack_name: String,
         user_data: usize,
@@ -392,7 +458,7 @@ pub enum FfiEvent {
     },
     Sticker {
         cb_ptr: usize,
-        user_id: String,
+        user_id: Id,
         pack_id: String,
         sticker_id: String,
         uri: String,
@@ -400,8 +466,8 @@ pub enum FfiEvent {
         user_data: usize,
     },
     ReactionsChanged {
-        user_id: String,
-        room_id: String,
+        user_id: Id,
+        room_id: Id,
         event_id: String,
         reactions_text: String,
     }
@@ -19,31 +19,19 @@ pub extern "C" fn purple_matrix_rust_send_read_receipt(user_id: *const c_char, r
         
         RUNTIME.spawn(async move {
             use matrix_sdk::ruma::{RoomId, EventId};
-            use matrix_sdk::ruma::events::receipt::ReceiptThread;
-            use matrix_sdk::ruma::api::client::receipt::create_receipt::v3::ReceiptType;
 
             if let Ok(room_id) = <&RoomId>::try_from(room_id_str.as_str()) {
                 if let Some(room) = client.get_room(room_id) {
                     
-                    let target_event_id = if let Some(id) = event_id_str {
+                    // Queued on the coalescing worker; the latest event is resolved at flush time
+                    if let Some(id) = event_id_str {
                         if let Ok(eid) = <&EventId>::try_from(id.as_str()) {
-                            Some(eid.to_owned())
+                            crate::read_receipts::mark_event(&room, eid.to_owned());
                         } else {
                             log::warn!("Invalid provided event ID for receipt: {}", id);
-                            None
                         }
                     } else {
-                        // Find latest event
-                        room.latest_event().and_then(|ev| ev.event_id().map(|e| e.to_owned()))
-                    };
-
-                    if let Some(eid) = target_event_id {
-                        log::info!("Sending Read Receipt for event {} in room {}", eid, room_id_str);
-                        if let Err(e) = room.send_single_receipt(ReceiptType::Read, ReceiptThread::Unthreaded, eid).await {
-                            log::error!("Failed to send read receipt: {:?}", e);
-                        }
-                    } else {
-                        log::warn!("No event found to mark as read in room {}", room_id_str);
+                        crate::read_receipts::mark_latest(&room);
                     }
                 }
             }
@@ -55,90 +43,95 @@ pub extern "C" fn purple_matrix_rust_send_read_receipt(user_id: *const c_char, r
 
 #[no_mangle]
 pub extern "C" fn purple_matrix_rust_send_message(user_id: *const c_char, room_id: *const c_char, text: *const c_char) {
+    purple_matrix_rust_send_message_txn(user_id, room_id, text, std::ptr::null());
+}
+
+// Like send_message, but `txn_id` is the transaction id the caller tagged its
+// local echo with. The remote echo carries it back (see MessageSent).
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_send_message_txn(user_id: *const c_char, room_id: *const c_char, text: *const c_char, txn_id: *const c_char) {
     if user_id.is_null() || room_id.is_null() || text.is_null() { return; }
     let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
     let id_str = unsafe { CStr::from_ptr(room_id).to_string_lossy().into_owned() };
     let text_str = unsafe { CStr::from_ptr(text).to_string_lossy().into_owned() };
+    let txn_id_opt = if txn_id.is_null() {
+        None
+    } else {
+        Some(unsafe { CStr::from_ptr(txn_id).to_string_lossy().into_owned() })
+    };
 
     with_client(&user_id_str.clone(), |client| {
-        
+        use matrix_sdk::ruma::RoomId;
+
+        // Parse ID for Thread Support: "room_id|thread_root_id"
+        let (room_id_str, thread_root_id_opt) = match id_str.split_once('|') {
+            Some((r, t)) if !t.is_empty() => (r, Some(t.to_string())),
+            _ => (id_str.as_str(), None),
+        };
+        let Ok(room_id_ruma) = <&RoomId>::try_from(room_id_str) else { return };
+
+        // Slash commands may hit the network before producing any text, so
+        // only they go through the runtime. Everything else is queued right
+        // here on the caller's thread: two quick messages to one room must
+        // reach the send queue in the order they were typed.
+        let is_command = text_str.starts_with('/') && !text_str.starts_with("//") && !text_str.starts_with("/me ");
+        if !is_command {
+            let text = if text_str.starts_with("//") { text_str[1..].to_string() } else { text_str };
+            queue_text(&client, room_id_ruma, thread_root_id_opt.as_deref(), text, txn_id_opt);
+            return;
+        }
+
+        let room_id_owned = room_id_ruma.to_owned();
         RUNTIME.spawn(async move {
-            use matrix_sdk::ruma::{events::room::message::Relation, RoomId, EventId};
-
-            // Parse ID for Thread Support: "room_id|thread_root_id"
-            let (room_id_str, thread_root_id_opt) = match id_str.split_once('|') {
-                Some((r, t)) if !t.is_empty() => (r, Some(t)),
-                _ => (id_str.as_str(), None),
+            // Slash Command Interception
+            let final_text = match crate::handlers::commands::handle_slash_command(&client, &room_id_owned, &text_str).await {
+                 Ok(crate::handlers::commands::CommandResult::Handled) => return,
+                 Ok(crate::handlers::commands::CommandResult::Continue(t)) => t,
+                 Err(e) => {
+                     log::error!("Error handling slash command: {:?}", e);
+                     let msg = format!("Command Error: {:?}", e);
+                     crate::ffi::send_system_message(&user_id_str, &msg);
+                     return;
+                 }
             };
+            queue_text(&client, &room_id_owned, thread_root_id_opt.as_deref(), final_text, txn_id_opt);
+        });
+    });
+}
 
-            if let Ok(room_id_ruma) = <&RoomId>::try_from(room_id_str) {
-                
-                // Slash Command Interception
-                let final_text = if text_str.starts_with('/') {
-                    match crate::handlers::commands::handle_slash_command(&client, room_id_ruma, &text_str).await {
-                         Ok(crate::handlers::commands::CommandResult::Handled) => return,
-                         Ok(crate::handlers::commands::CommandResult::Continue(t)) => t,
-                         Err(e) => {
-                             log::error!("Error handling slash command: {:?}", e);
-                             let msg = format!("Command Error: {:?}", e);
-                             crate::ffi::send_system_message(&user_id_str, &msg);
-                             return;
-                         }
-                    }
-                } else {
-                    text_str
-                };
+fn queue_text(client: &matrix_sdk::Client, room_id: &matrix_sdk::ruma::RoomId, thread_root_id_opt: Option<&str>, final_text: String, txn_id_opt: Option<String>) {
+    use matrix_sdk::ruma::{events::room::message::Relation, EventId};
 
-                if let Some(room) = client.get_room(room_id_ruma) {
-                    // Implicit Read Receipt
-                     if let Some(latest_event) = room.latest_event() {
-                         use matrix_sdk::ruma::events::receipt::ReceiptThread;
-                         use matrix_sdk::ruma::api::client::receipt::create_receipt::v3::ReceiptType;
-                         
-                         if let Some(event_id) = latest_event.event_id() {
-                             let event_id = event_id.to_owned();
-                             // log::info!("Marking room {} as read up to {}", room_id_str, event_id);
-                             if let Err(e) = room.send_single_receipt(ReceiptType::Read, ReceiptThread::Unthreaded, event_id).await {
-                                 log::warn!("Failed to send read receipt: {:?}", e);
-                             }
-                         }
-                     }
-                    
-                    let mut content = if final_text.starts_with("/me ") {
-                        let emote_body = final_text.strip_prefix("/me ").unwrap_or(&final_text).to_string();
-                        matrix_sdk::ruma::events::room::message::RoomMessageEventContent::new(
-                            matrix_sdk::ruma::events::room::message::MessageType::Emote(
-                                matrix_sdk::ruma::events::room::message::EmoteMessageEventContent::plain(emote_body)
-                            )
-                        )
-                    } else {
-                        crate::create_message_content(final_text)
-                    };
-                    
-                    // Attach Thread Relation if present
-                    if let Some(thread_id_str) = thread_root_id_opt {
-                        if let Ok(root_id) = <&EventId>::try_from(thread_id_str) {
-                             log::info!("Sending message to thread {} in room {}", thread_id_str, room_id_str);
-                             
-                             content.relates_to = Some(Relation::Thread(matrix_sdk::ruma::events::relation::Thread::plain(root_id.to_owned(), root_id.to_owned())));
-                        } else {
-                            log::warn!("Invalid Event ID for thread root: {}", thread_id_str);
-                        }
-                    }
+    let Some(room) = client.get_room(room_id) else {
+        log::error!("Failed to find room {} to send message.", room_id);
+        return;
+    };
+    // Implicit Read Receipt (coalesced, never awaited here)
+    crate::read_receipts::mark_latest(&room);
+
+    let mut content = if final_text.starts_with("/me ") {
+        let emote_body = final_text.strip_prefix("/me ").unwrap_or(&final_text).to_string();
+        matrix_sdk::ruma::events::room::message::RoomMessageEventContent::new(
+            matrix_sdk::ruma::events::room::message::MessageType::Emote(
+                matrix_sdk::ruma::events::room::message::EmoteMessageEventContent::plain(emote_body)
+            )
+        )
+    } else {
+        crate::create_message_content(final_text)
+    };
 
-                    if let Err(e) = room.send(content).await {
-                        log::error!("Failed to send message to room {}: {:?}", room_id_str, e);
-                        let msg = format!("Failed to send message: {:?}", e);
-                        crate::ffi::send_system_message(&user_id_str, &msg);
-                    } else {
-                        log::info!("Message sent successfully to room {}", room_id_str);
-                    }
-                } else {
-                    log::error!("Failed to find room {} to send message.", room_id_str);
-                }
-            }
-        });
-    });
+    // Attach Thread Relation if present
+    if let Some(thread_id_str) = thread_root_id_opt {
+        if let Ok(root_id) = <&EventId>::try_from(thread_id_str) {
+             log::info!("Sending message to thread {} in room {}", thread_id_str, room_id);
+
+             content.relates_to = Some(Relation::Thread(matrix_sdk::ruma::events::relation::Thread::plain(root_id.to_owned(), root_id.to_owned())));
+        } else {
+            log::warn!("Invalid Event ID for thread root: {}", thread_id_str);
+        }
+    }
+
+    crate::send_queue::enqueue(&room, content, txn_id_opt);
 }
 
 #[no_mangle]
@@ -156,9 +149,7 @@ pub extern "C" fn purple_matrix_rust_send_im(account_user_id: *const c_char, tar
             use matrix_sdk::ruma::UserId;
 
             if let Ok(user_id_ruma) = <&UserId>::try_from(target_user_id_str.as_str()) {   
-                log::info!("Resolving DM for {}", target_user_id_str);
-                // Compiler says create_dm takes &UserId (single), not slice.
-                match client.create_dm(user_id_ruma).await {
+                match crate::dm_rooms::resolve(&client, user_id_ruma).await {
                     Ok(room) => {
                          // Force the type to break inference cycle
                          let room: matrix_sdk::Room = room;
@@ -168,7 +159,9 @@ pub extern "C" fn purple_matrix_rust_send_im(account_user_id: *const c_char, tar
                          // Check if the target user is actually in the room.
                          let target_user = user_id_ruma; 
                          
-                         let needs_invite = match room.get_member(target_user).await {
+                         // Local store only: this runs on every IM and must not
+                         // trigger a /members request.
+                         let needs_invite = match room.get_member_no_sync(target_user).await {
                              Ok(Some(member)) => {
                                  use matrix_sdk::ruma::events::room::member::MembershipState;
                                  match member.membership() {
@@ -196,13 +189,7 @@ pub extern "C" fn purple_matrix_rust_send_im(account_user_id: *const c_char, tar
                          // Ensure C side knows about this room (emit callback if it's new-ish)
                          
                          let content = crate::create_message_content(text);
-                         if let Err(e) = room.send(content).await {
-                             log::error!("Failed to send DM message: {:?}", e);
-                             let msg = format!("Failed to send DM: {:?}", e);
-                             crate::ffi::send_system_message(&account_user_id_str, &msg);
-                         } else {
-                             log::info!("DM Sent!");
-                         }
+                         crate::send_queue::enqueue(&room, content, None);
                     },
                     Err(e) => {
                          log::error!("Failed to get or create DM with {}: {:?}", target_user_id_str, e);
@@ -223,62 +210,26 @@ pub extern "C" fn purple_matrix_rust_send_typing(user_id: *const c_char, room_id
     let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
     let id_str = unsafe { CStr::from_ptr(room_id_or_user_id).to_string_lossy().into_owned() };
 
-    with_client(&user_id_str.clone(), |client| {
-        
-        RUNTIME.spawn(async move {
-            use matrix_sdk::ruma::{RoomId, UserId};
-
-            // Case 1: It's a Room ID
-            if let Ok(room_id) = <&RoomId>::try_from(id_str.as_str()) {
-                if let Some(room) = client.get_room(room_id) {
-                     // Implicit Read Receipt
-                     if is_typing {
-                         if let Some(latest_event) = room.latest_event() {
-                             use matrix_sdk::ruma::events::receipt::ReceiptThread;
-                             use matrix_sdk::ruma::api::client::receipt::create_receipt::v3::ReceiptType;
-                             
-                             if let Some(event_id) = latest_event.event_id() {
-                                 let event_id = event_id.to_owned();
-                                 if let Err(e) = room.send_single_receipt(ReceiptType::Read, ReceiptThread::Unthreaded, event_id).await {
-                                     log::debug!("Failed to send read receipt on typing: {:?}", e);
-                                 }
-                             }
-                         }
-                     }
-                    let _ = room.typing_notice(is_typing).await;
-                }
-            } 
-            // Case 2: It's a User ID (DM)
-            else if let Ok(user_id) = <&UserId>::try_from(id_str.as_str()) {
-                 match client.create_dm(user_id).await {
-                      Ok(room) => {
-                          let room: matrix_sdk::Room = room; // Type fix
-                          
-                           // Implicit Read Receipt
-                             if is_typing {
-                                 if let Some(latest_event) = room.latest_event() {
-                                     use matrix_sdk::ruma::events::receipt::ReceiptThread;
-                                     use matrix_sdk::ruma::api::client::receipt::create_receipt::v3::ReceiptType;
-                                     
-                                     if let Some(event_id) = latest_event.event_id() {
-                                         let event_id = event_id.to_owned();
-                                         if let Err(e) = room.send_single_receipt(ReceiptType::Read, ReceiptThread::Unthreaded, event_id).await {
-                                             log::debug!("Failed to send read receipt on typing (DM): {:?}", e);
-                                         }
-                                     }
-                                 }
-                             }
-                          let _ = room.typing_notice(is_typing).await;
-                      },
-                      Err(e) => {
-                          log::error!("Failed to resolve DM for typing to {}: {:?}", id_str, e);
-                      }
-                  }
-            }
-            else {
-                log::warn!("Invalid ID for typing: {}", id_str);
-            }
-        });
+    // Resolved synchronously: repeated reports of the same state must not
+    // spawn anything (see typing_notices).
+    with_client(&user_id_str, |client| {
+        use matrix_sdk::ruma::{RoomId, UserId};
+
+        // Thread conversations are "room_id|thread_root"; typing is per room.
+        let target = id_str.split('|').next().unwrap_or(&id_str);
+        let room = if let Ok(room_id) = <&RoomId>::try_from(target) {
+            client.get_room(room_id)
+        } else if let Ok(user_id) = <&UserId>::try_from(target) {
+            // Typing never creates a DM; the first message does.
+            crate::dm_rooms::lookup(&client, user_id)
+        } else {
+            log::warn!("Invalid ID for typing: {}", id_str);
+            None
+        };
+
+        if let Some(room) = room {
+            crate::typing_notices::set_typing(&room, is_typing);
+        }
     });
 }
 
@@ -360,6 +311,68 @@ pub extern "C" fn purple_matrix_rust_send_sticker(user_id: *const c_char, room_i
     });
 }
 
+async fn resolve_attachment_room(client: &matrix_sdk::Client, id_str: &str) -> Option<matrix_sdk::Room> {
+    use matrix_sdk::ruma::{RoomId, UserId};
+
+    if let Ok(room_id) = <&RoomId>::try_from(id_str) {
+        client.get_room(room_id)
+    } else if let Ok(user_id) = <&UserId>::try_from(id_str) {
+        // Try to Open/Create DM
+        match crate::dm_rooms::resolve(client, user_id).await {
+            Ok(r) => Some(r),
+            Err(e) => {
+                log::error!("Failed to find/create DM for {}: {:?}", user_id, e);
+                None
+            }
+        }
+    } else {
+        None
+    }
+}
+
+async fn send_attachment_bytes(user_id_str: &str, room: &matrix_sdk::Room, file_name: &str, mime: mime_guess::mime::Mime, bytes: Vec<u8>) {
+    let max_dim = crate::media_helper::UPLOAD_MAX_IMAGE_DIM.get(user_id_str).map(|v| *v).unwrap_or(0);
+    let original_mime = mime.clone();
+    // Decoding, scaling and thumbnailing are CPU-bound; keep them off the async workers.
+    let prepared = match tokio::task::spawn_blocking(move || crate::media_helper::prepare_attachment(bytes, mime, max_dim)).await {
+        Ok(p) => p,
+        Err(e) => {
+            log::error!("Attachment preparation for {} failed: {:?}", file_name, e);
+            return;
+        }
+    };
+    // A re-encode can change the format (a BMP goes out as PNG); keep the name in step.
+    let renamed;
+    let file_name = if prepared.mime != original_mime {
+        let ext = if prepared.mime == mime_guess::mime::IMAGE_JPEG { "jpg" } else { "png" };
+        renamed = std::path::Path::new(file_name).with_extension(ext).to_string_lossy().into_owned();
+        renamed.as_str()
+    } else {
+        file_name
+    };
+
+    log::info!("Sending attachment {} ({} bytes, mime: {})", file_name, prepared.data.len(), prepared.mime);
+
+    match room.send_attachment(file_name, &prepared.mime, prepared.data, prepared.config).await {
+        Ok(response) => {
+            log::info!("Attachment sent successfully: {:?}", response.event_id);
+        },
+        Err(e) => {
+            log::error!("Failed to send attachment {}: {:?}", file_name, e);
+            let msg = format!("Failed to send attachment: {:?}", e);
+            crate::ffi::send_system_message(user_id_str, &msg);
+        }
+    }
+}
+
+/// Sets the longest edge (px) above which outgoing photos are downscaled; 0 disables it.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_set_upload_max_image_dim(user_id: *const c_char, max_dim: u32) {
+    if user_id.is_null() { return; }
+    let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
+    crate::media_helper::UPLOAD_MAX_IMAGE_DIM.insert(user_id_str, max_dim);
+}
+
 #[no_mangle]
 pub extern "C" fn purple_matrix_rust_send_file(user_id: *const c_char, id: *const c_char, filename: *const c_char) {
     if user_id.is_null() || id.is_null() || filename.is_null() { return; }
@@ -370,26 +383,9 @@ pub extern "C" fn purple_matrix_rust_send_file(user_id: *const c_char, id: *cons
     with_client(&user_id_str.clone(), |client| {
         
         RUNTIME.spawn(async move {
-             use matrix_sdk::ruma::{RoomId, UserId};
              use std::path::Path;
-             
-             let room_opt = if let Ok(room_id) = <&RoomId>::try_from(id_str.as_str()) {
-                 client.get_room(room_id)
-             } else if let Ok(user_id) = <&UserId>::try_from(id_str.as_str()) {
-                 // Try to Open/Create DM
-                 log::info!("File send target is User {}, resolving DM...", user_id);
-                 match client.create_dm(user_id).await {
-                     Ok(r) => Some(r),
-                     Err(e) => {
-                         log::error!("Failed to find/create DM for {}: {:?}", user_id, e);
-                         None
-                     }
-                 }
-             } else {
-                 None
-             };
 
-             if let Some(room) = room_opt {
+             if let Some(room) = resolve_attachment_room(&client, &id_str).await {
                  let path = Path::new(&filename_str);
                  if !path.exists() {
                      log::error!("File does not exist: {}", filename_str);
@@ -398,29 +394,10 @@ pub extern "C" fn purple_matrix_rust_send_file(user_id: *const c_char, id: *cons
                      return;
                  }
                  
-                 if let Ok(bytes) = std::fs::read(path) {
+                 if let Ok(bytes) = tokio::fs::read(path).await {
                      let mime = mime_guess::from_path(path).first_or_octet_stream();
                      let file_name = path.file_name().unwrap_or_default().to_string_lossy().into_owned();
-                     log::info!("Sending attachment {} ({} bytes, mime: {})", file_name, bytes.len(), mime);
-                     
-                     use matrix_sdk::attachment::AttachmentConfig;
-                     let config = AttachmentConfig::new();
-                     
-                     match room.send_attachment(&file_name, &mime, bytes, config).await {
-                         Ok(response) => {
-                             log::info!("Attachment sent successfully: {:?}", response.event_id);
-                             // Delete temporary pasted images
-                             if file_name.starts_with("matrix_pasted_") {
-                                 log::info!("Cleaning up temporary pasted file: {}", filename_str);
-                                 let _ = std::fs::remove_file(path);
-                             }
-                         },
-                         Err(e) => {
-                             log::error!("Failed to send attachment {}: {:?}", file_name, e);
-                             let msg = format!("Failed to send attachment: {:?}", e);
-                             crate::ffi::send_system_message(&user_id_str, &msg);
-                         }
-                     }
+                     send_attachment_bytes(&user_id_str, &room, &file_name, mime, bytes).await;
                  }
              } else {
                  log::error!("Could not resolve target {} to a valid Room", id_str);
@@ -429,6 +406,34 @@ pub extern "C" fn purple_matrix_rust_send_file(user_id: *const c_char, id: *cons
     });
 }
 
+/// Uploads an in-memory image (e.g. a pasted imgstore entry) without staging it on disk.
+/// The bytes are copied once here because the caller's buffer is not guaranteed to
+/// outlive the upload task.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_send_image_bytes(user_id: *const c_char, id: *const c_char, filename: *const c_char, data: *const u8, len: usize) {
+    if user_id.is_null() || id.is_null() || data.is_null() || len == 0 { return; }
+    let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
+    let id_str = unsafe { CStr::from_ptr(id).to_string_lossy().into_owned() };
+    let file_name = if filename.is_null() {
+        "image".to_string()
+    } else {
+        unsafe { CStr::from_ptr(filename).to_string_lossy().into_owned() }
+    };
+    let bytes = unsafe { std::slice::from_raw_parts(data, len).to_vec() };
+
+    with_client(&user_id_str.clone(), |client| {
+
+        RUNTIME.spawn(async move {
+            if let Some(room) = resolve_attachment_room(&client, &id_str).await {
+                let mime = mime_guess::from_path(&file_name).first_or_octet_stream();
+                send_attachment_bytes(&user_id_str, &room, &file_name, mime, bytes).await;
+            } else {
+                log::error!("Could not resolve target {} to a valid Room", id_str);
+            }
+        });
+    });
+}
+
 #[no_mangle]
 pub extern "C" fn purple_matrix_rust_send_reply(user_id: *const c_char, room_id: *const c_char, event_id: *const c_char, text: *const c_char) {
     if user_id.is_null() || room_id.is_null() || event_id.is_null() || text.is_null() { return; }
@@ -585,60 +590,94 @@ pub extern "C" fn purple_matrix_rust_search_room_messages(user_id: *const c_char
     let term_str = unsafe { CStr::from_ptr(term).to_string_lossy().into_owned() };
 
     with_client(&user_id_str.clone(), |client| {
-        let client_clone = client.clone();
         RUNTIME.spawn(async move {
             use matrix_sdk::ruma::RoomId;
-            use matrix_sdk::ruma::api::client::search::search_events::v3::{
-                Request as SearchRequest,
-                Categories,
-                Criteria,
+
+            // Thread conversations search their parent room.
+            let base_room = room_id_str.split('|').next().unwrap_or(&room_id_str).to_string();
+            let Ok(rid) = <&RoomId>::try_from(base_room.as_str()) else { return; };
+            let account = client.user_id().map(|u| u.to_string()).unwrap_or_default();
+            log::info!("Searching messages in {}", room_id_str);
+
+            let local = {
+                let (account, room, term) = (account.clone(), base_room.clone(), term_str.clone());
+                tokio::task::spawn_blocking(move || crate::search_index::search(&account, &room, &term))
+                    .await
+                    .unwrap_or_default()
             };
-            use matrix_sdk::ruma::api::client::filter::RoomEventFilter;
-            use matrix_sdk::ruma::events::{AnyTimelineEvent, AnyMessageLikeEvent, room::message::RoomMessageEvent};
-            
-            if let Ok(rid) = <&RoomId>::try_from(room_id_str.as_str()) {
-                log::info!("Searching messages in {} for '{}'", room_id_str, term_str);
-                
-                let mut criteria = Criteria::new(term_str.clone());
-                let mut filter = RoomEventFilter::default();
-                filter.rooms = Some(vec![rid.to_owned()]);
-                criteria.filter = filter;
-                
-                let mut categories = Categories::new();
-                categories.room_events = Some(criteria);
-                let request = SearchRequest::new(categories);
-                
-                match client_clone.send(request).await {
-                    Ok(response) => {
-                        let mut msg = format!("<b>Search results for '{}' in {}</b>:<br/>", term_str, room_id_str);
-                        let results = &response.search_categories.room_events.results;
-                        if results.is_empty() {
-                            msg.push_str("No results found.");
-                        } else {
-                            for res in results {
-                                if let Some(raw) = &res.result {
-                                    let raw_ev: Result<AnyTimelineEvent, _> = raw.deserialize();
-                                    if let Ok(ev) = raw_ev {
-                                        if let AnyTimelineEvent::MessageLike(msg_ev) = ev {
-                                            let sender = msg_ev.sender().to_string();
-                                            let body = if let AnyMessageLikeEvent::RoomMessage(RoomMessageEvent::Original(ref o)) = msg_ev {
-                                                o.content.body().to_string()
-                                            } else { "Non-text message".to_string() };
-                                            msg.push_str(&format!("- <b>{}</b>: {}<br/>", sender, body));
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        crate::ffi::send_system_message_to_room(&user_id_str, &room_id_str, &msg);
-                    },
-                    Err(e) => log::error!("Search failed: {:?}", e),
+
+            let mut rows: Vec<(String, String, u64)> = local.into_iter().map(|h| (h.sender, h.body, h.ts)).collect();
+
+            // The index only knows what this device has seen; fall back to the
+            // server for older history, which it can only search in plaintext rooms.
+            if rows.is_empty() {
+                let encrypted = match client.get_room(rid) {
+                    Some(room) => room.get_state_event_static::<matrix_sdk::ruma::events::room::encryption::RoomEncryptionEventContent>().await.ok().flatten().is_some(),
+                    None => false,
+                };
+                if !encrypted {
+                    rows = server_search(&client, rid, &term_str).await;
                 }
             }
+
+            for (sender, body, ts) in rows {
+                let _ = crate::ffi::EVENTS_CHANNEL.0.send(crate::ffi::FfiEvent::SearchResult {
+                    user_id: crate::intern::id(&user_id_str),
+                    room_id: crate::intern::id(&room_id_str),
+                    sender: Some(sender),
+                    message: body,
+                    timestamp_str: crate::search_index::format_timestamp(ts),
+                });
+            }
+            let _ = crate::ffi::EVENTS_CHANNEL.0.send(crate::ffi::FfiEvent::SearchResult {
+                user_id: crate::intern::id(user_id_str),
+                room_id: crate::intern::id(room_id_str),
+                sender: None,
+                message: String::new(),
+                timestamp_str: String::new(),
+            });
         });
     });
 }
 
+async fn server_search(client: &matrix_sdk::Client, rid: &matrix_sdk::ruma::RoomId, term: &str) -> Vec<(String, String, u64)> {
+    use matrix_sdk::ruma::api::client::search::search_events::v3::{
+        Request as SearchRequest,
+        Categories,
+        Criteria,
+    };
+    use matrix_sdk::ruma::api::client::filter::RoomEventFilter;
+    use matrix_sdk::ruma::events::{AnyTimelineEvent, AnyMessageLikeEvent, room::message::RoomMessageEvent};
+
+    let mut criteria = Criteria::new(term.to_string());
+    let mut filter = RoomEventFilter::default();
+    filter.rooms = Some(vec![rid.to_owned()]);
+    criteria.filter = filter;
+
+    let mut categories = Categories::new();
+    categories.room_events = Some(criteria);
+    let request = SearchRequest::new(categories);
+
+    let mut rows = Vec::new();
+    match client.send(request).await {
+        Ok(response) => {
+            for res in &response.search_categories.room_events.results {
+                let Some(raw) = &res.result else { continue; };
+                if let Ok(AnyTimelineEvent::MessageLike(msg_ev)) = raw.deserialize() {
+                    let sender = msg_ev.sender().to_string();
+                    let ts: u64 = msg_ev.origin_server_ts().0.into();
+                    let body = if let AnyMessageLikeEvent::RoomMessage(RoomMessageEvent::Original(ref o)) = msg_ev {
+                        o.content.body().to_string()
+                    } else { "Non-text message".to_string() };
+                    rows.push((sender, body, ts));
+                }
+            }
+        }
+        Err(e) => log::error!("Search failed: {:?}", e),
+    }
+    rows
+}
+
 #[no_mangle]
 pub extern "C" fn purple_matrix_rust_bulk_redact(user_id: *const c_char, room_id: *const c_char, count: i32, target_user: *const c_char) {
     if user_id.is_null() || room_id.is_null() { return; }
@@ -14,13 +14,62 @@ pub mod encryption;
 pub mod aliases;
 pub mod discovery;
 pub mod events;
+pub mod perf;
 
 #[cfg(test)]
 mod tests;
 
 pub use events::*;
 
-pub static EVENTS_CHANNEL: Lazy<(crossbeam_channel::Sender<FfiEvent>, crossbeam_channel::Receiver<FfiEvent>)> = Lazy::new(|| crossbeam_channel::unbounded());
+// Events are stamped on the way in (monotonic instant plus a span id) so the
+// time spent waiting for the C poll timer, and later for display, can be
+// measured on the way out.
+pub struct Queued {
+    enqueued: std::time::Instant,
+    span: u64,
+    event: FfiEvent,
+}
+
+pub struct EventSender(crossbeam_channel::Sender<Queued>);
+pub struct EventReceiver(crossbeam_channel::Receiver<Queued>);
+
+impl EventSender {
+    pub fn send(&self, event: FfiEvent) -> Result<(), crossbeam_channel::SendError<Queued>> {
+        crate::event_record::record(&event);
+        self.send_unrecorded(event)
+    }
+
+    // For events replayed from a recording, which must not be recorded twice.
+    pub fn send_unrecorded(&self, event: FfiEvent) -> Result<(), crossbeam_channel::SendError<Queued>> {
+        crate::metrics::EVENTS_ENQUEUED.inc();
+        self.0.send(Queued { enqueued: std::time::Instant::now(), span: crate::event_trace::next_span(), event })
+    }
+}
+
+impl EventReceiver {
+    pub fn try_recv(&self) -> Result<FfiEvent, crossbeam_channel::TryRecvError> {
+        self.try_recv_traced().map(|(_, event)| event)
+    }
+
+    // Also opens the event's span; the caller hands the id to C.
+    pub fn try_recv_traced(&self) -> Result<(u64, FfiEvent), crossbeam_channel::TryRecvError> {
+        let queued = self.0.try_recv()?;
+        crate::metrics::EVENT_QUEUE_WAIT.record(queued.enqueued.elapsed());
+        crate::metrics::EVENTS_DELIVERED.inc();
+        let displayable = matches!(queued.event, FfiEvent::MessageReceived { .. });
+        crate::event_trace::dequeued(queued.span, queued.enqueued, displayable);
+        Ok((queued.span, queued.event))
+    }
+
+    pub fn len(&self) -> usize {
+        self.0.len()
+    }
+}
+
+pub static EVENTS_CHANNEL: Lazy<(EventSender, EventReceiver)> = Lazy::new(|| {
+    let (tx, rx) = crossbeam_channel::unbounded();
+    (EventSender(tx), EventReceiver(rx))
+});
 
 pub(crate) static IMGSTORE_ADD_CALLBACK: Lazy<std::sync::Mutex<Option<extern "C" fn(*const u8, usize) -> std::os::raw::c_int>>> = Lazy::new(|| std::sync::Mutex::new(None));
 
@@ -66,443 +115,296 @@ pub type ShowVerificationQrCallback = extern "C" fn(user_id: *const c_char, targ
 pub extern "C" fn purple_matrix_rust_poll_event(
     out_type: *mut i32,
     out_data: *mut *mut c_void,
+    out_span: *mut u64,
 ) -> bool {
-    if let Ok(event) = EVENTS_CHANNEL.1.try_recv() {
+    if let Ok((span, event)) = EVENTS_CHANNEL.1.try_recv_traced() {
         let (ev_type, ptr) = match event {
             FfiEvent::MessageReceived { user_id, sender, msg, room_id, thread_root_id, event_id, timestamp, encrypted } => (
                 1,
-                Box::into_raw(Box::new(CMessageReceived {
-                    user_id: to_c_char(&user_id),
-                    sender: to_c_char(&sender),
-                    msg: to_c_char(&msg),
-                    room_id: to_c_char_opt(&room_id),
-                    thread_root_id: to_c_char_opt(&thread_root_id),
-                    event_id: to_c_char(&event_id),
+                pack([Some(&*user_id), Some(&*sender), Some(msg.as_str()), room_id.as_deref(), thread_root_id.as_deref(), Some(event_id.as_str())], |s| CMessageReceived {
+                    user_id: s[0],
+                    sender: s[1],
+                    msg: s[2],
+                    room_id: s[3],
+                    thread_root_id: s[4],
+                    event_id: s[5],
                     timestamp,
                     encrypted,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::ReactionsChanged { user_id, room_id, event_id, reactions_text } => (
                 30,
-                Box::into_raw(Box::new(CReactionsChanged {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    event_id: to_c_char(&event_id),
-                    reactions_text: to_c_char(&reactions_text),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), Some(event_id.as_str()), Some(reactions_text.as_str())], |s| CReactionsChanged {
+                    user_id: s[0],
+                    room_id: s[1],
+                    event_id: s[2],
+                    reactions_text: s[3],
+                })
             ),
             FfiEvent::Typing { user_id, room_id, who, is_typing } => (
                 2,
-                Box::into_raw(Box::new(CTyping {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    who: to_c_char(&who),
+                pack([Some(&*user_id), Some(&*room_id), Some(&*who)], |s| CTyping {
+                    user_id: s[0],
+                    room_id: s[1],
+                    who: s[2],
                     is_typing,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::RoomJoined { user_id, room_id, name, group_name, avatar_url, topic, encrypted, member_count } => (
                 3,
-                Box::into_raw(Box::new(CRoomJoined {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    name: to_c_char(&name),
-                    group_name: to_c_char(&group_name),
-                    avatar_url: to_c_char_opt(&avatar_url),
-                    topic: to_c_char_opt(&topic),
+                pack([Some(&*user_id), Some(&*room_id), Some(name.as_str()), Some(group_name.as_str()), avatar_url.as_deref(), topic.as_deref()], |s| CRoomJoined {
+                    user_id: s[0],
+                    room_id: s[1],
+                    name: s[2],
+                    group_name: s[3],
+                    avatar_url: s[4],
+                    topic: s[5],
                     encrypted,
                     member_count,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::RoomLeft { user_id, room_id } => (
                 4,
-                Box::into_raw(Box::new(CRoomLeft {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id)], |s| CRoomLeft {
+                    user_id: s[0],
+                    room_id: s[1],
+                })
             ),
             FfiEvent::ReadMarker { user_id, room_id, event_id, who } => (
                 5,
-                Box::into_raw(Box::new(CReadMarker {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    event_id: to_c_char(&event_id),
-                    who: to_c_char(&who),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), Some(event_id.as_str()), Some(&*who)], |s| CReadMarker {
+                    user_id: s[0],
+                    room_id: s[1],
+                    event_id: s[2],
+                    who: s[3],
+                })
             ),
             FfiEvent::Presence { user_id, target_user_id, is_online } => (
                 6,
-                Box::into_raw(Box::new(CPresence {
-                    user_id: to_c_char(&user_id),
-                    target_user_id: to_c_char(&target_user_id),
+                pack([Some(&*user_id), Some(&*target_user_id)], |s| CPresence {
+                    user_id: s[0],
+                    target_user_id: s[1],
                     is_online,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::ChatTopic { user_id, room_id, topic, sender } => (
                 7,
-                Box::into_raw(Box::new(CChatTopic {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    topic: to_c_char(&topic),
-                    sender: to_c_char(&sender),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), Some(topic.as_str()), Some(sender.as_str())], |s| CChatTopic {
+                    user_id: s[0],
+                    room_id: s[1],
+                    topic: s[2],
+                    sender: s[3],
+                })
             ),
             FfiEvent::ChatUser { user_id, room_id, member_id, add, alias, avatar_path } => (
                 8,
-                Box::into_raw(Box::new(CChatUser {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    member_id: to_c_char(&member_id),
+                pack([Some(&*user_id), Some(&*room_id), Some(&*member_id), alias.as_deref(), avatar_path.as_deref()], |s| CChatUser {
+                    user_id: s[0],
+                    room_id: s[1],
+                    member_id: s[2],
                     add,
-                    alias: to_c_char_opt(&alias),
-                    avatar_path: to_c_char_opt(&avatar_path),
-                })) as *mut c_void
+                    alias: s[3],
+                    avatar_path: s[4],
+                })
             ),
             FfiEvent::Invite { user_id, room_id, inviter } => (
                 9,
-                Box::into_raw(Box::new(CInvite {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    inviter: to_c_char(&inviter),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), Some(inviter.as_str())], |s| CInvite {
+                    user_id: s[0],
+                    room_id: s[1],
+                    inviter: s[2],
+                })
             ),
             FfiEvent::LoginFailed { user_id, message } => (
                 12,
-                Box::into_raw(Box::new(CLoginFailed {
-                    user_id: to_c_char(&user_id),
-                    message: to_c_char(&message),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(message.as_str())], |s| CLoginFailed {
+                    user_id: s[0],
+                    message: s[1],
+                })
             ),
             FfiEvent::Connected { user_id } => (
                 25,
-                Box::into_raw(Box::new(CConnected {
-                    user_id: to_c_char(&user_id),
-                })) as *mut c_void
+                pack([Some(&*user_id)], |s| CConnected {
+                    user_id: s[0],
+                })
             ),
             FfiEvent::SsoUrl { url } => (
                 24,
-                Box::into_raw(Box::new(CSso {
-                    url: to_c_char(&url),
-                })) as *mut c_void
+                pack([Some(url.as_str())], |s| CSso {
+                    url: s[0],
+                })
             ),
             FfiEvent::MessageEdited { user_id, room_id, event_id, new_msg } => (
                 31,
-                Box::into_raw(Box::new(CMessageEdited {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    event_id: to_c_char(&event_id),
-                    new_msg: to_c_char(&new_msg),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), Some(event_id.as_str()), Some(new_msg.as_str())], |s| CMessageEdited {
+                    user_id: s[0],
+                    room_id: s[1],
+                    event_id: s[2],
+                    new_msg: s[3],
+                })
+            ),
+            FfiEvent::SearchResult { user_id, room_id, sender, message, timestamp_str } => (
+                16,
+                pack([Some(&*user_id), Some(&*room_id), sender.as_deref(), Some(message.as_str()), Some(timestamp_str.as_str())], |s| CSearch {
+                    user_id: s[0],
+                    room_id: s[1],
+                    sender: s[2],
+                    message: s[3],
+                    timestamp_str: s[4],
+                })
+            ),
+            FfiEvent::MessageSent { user_id, room_id, txn_id, event_id } => (
+                32,
+                pack([Some(&*user_id), Some(&*room_id), Some(txn_id.as_str()), Some(event_id.as_str())], |s| CMessageSent {
+                    user_id: s[0],
+                    room_id: s[1],
+                    txn_id: s[2],
+                    event_id: s[3],
+                })
             ),
             FfiEvent::SasRequest { user_id, target_user_id, flow_id } => (
                 26,
-                Box::into_raw(Box::new(CSasRequest {
-                    user_id: to_c_char(&user_id),
-                    target_user_id: to_c_char(&target_user_id),
-                    flow_id: to_c_char(&flow_id),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*target_user_id), Some(flow_id.as_str())], |s| CSasRequest {
+                    user_id: s[0],
+                    target_user_id: s[1],
+                    flow_id: s[2],
+                })
             ),
             FfiEvent::SasHaveEmoji { user_id, target_user_id, flow_id, emojis } => (
                 27,
-                Box::into_raw(Box::new(CSasHaveEmoji {
-                    user_id: to_c_char(&user_id),
-                    target_user_id: to_c_char(&target_user_id),
-                    flow_id: to_c_char(&flow_id),
-                    emojis: to_c_char(&emojis),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*target_user_id), Some(flow_id.as_str()), Some(emojis.as_str())], |s| CSasHaveEmoji {
+                    user_id: s[0],
+                    target_user_id: s[1],
+                    flow_id: s[2],
+                    emojis: s[3],
+                })
             ),
             FfiEvent::ShowVerificationQr { user_id, target_user_id, html_data } => (
                 28,
-                Box::into_raw(Box::new(CShowVerificationQr {
-                    user_id: to_c_char(&user_id),
-                    target_user_id: to_c_char(&target_user_id),
-                    html_data: to_c_char(&html_data),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*target_user_id), Some(html_data.as_str())], |s| CShowVerificationQr {
+                    user_id: s[0],
+                    target_user_id: s[1],
+                    html_data: s[2],
+                })
             ),
             FfiEvent::PollList { user_id, room_id, event_id, question, sender, options_str } => (
                 15,
-                Box::into_raw(Box::new(CPollList {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    event_id: to_c_char_opt(&event_id),
-                    question: to_c_char_opt(&question),
-                    sender: to_c_char_opt(&sender),
-                    options_str: to_c_char_opt(&options_str),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(&*room_id), event_id.as_deref(), question.as_deref(), sender.as_deref(), options_str.as_deref()], |s| CPollList {
+                    user_id: s[0],
+                    room_id: s[1],
+                    event_id: s[2],
+                    question: s[3],
+                    sender: s[4],
+                    options_str: s[5],
+                })
             ),
             FfiEvent::RoomListAdd { user_id, room_id, name, topic, member_count, is_space, parent_id } => (
                 10,
-                Box::into_raw(Box::new(CRoomListAdd {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    name: to_c_char(&name),
-                    topic: to_c_char(&topic),
+                pack([Some(&*user_id), Some(&*room_id), Some(name.as_str()), Some(topic.as_str()), parent_id.as_deref()], |s| CRoomListAdd {
+                    user_id: s[0],
+                    room_id: s[1],
+                    name: s[2],
+                    topic: s[3],
                     member_count,
                     is_space,
-                    parent_id: to_c_char_opt(&parent_id),
-                })) as *mut c_void
+                    parent_id: s[4],
+                })
             ),
             FfiEvent::RoomPreview { user_id, room_id_or_alias, html_body } => (
                 11,
-                Box::into_raw(Box::new(CRoomPreview {
-                    user_id: to_c_char(&user_id),
-                    room_id_or_alias: to_c_char(&room_id_or_alias),
-                    html_body: to_c_char(&html_body),
-                })) as *mut c_void
+                pack([Some(&*user_id), Some(room_id_or_alias.as_str()), Some(html_body.as_str())], |s| CRoomPreview {
+                    user_id: s[0],
+                    room_id_or_alias: s[1],
+                    html_body: s[2],
+                })
             ),
             FfiEvent::ThreadList { user_id, room_id, thread_root_id, latest_msg, count, ts } => (
                 14,
-                Box::into_raw(Box::new(CThreadList {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
-                    thread_root_id: to_c_char_opt(&thread_root_id),
-                    latest_msg: to_c_char_opt(&latest_msg),
+                pack([Some(&*user_id), Some(&*room_id), thread_root_id.as_deref(), latest_msg.as_deref()], |s| CThreadList {
+                    user_id: s[0],
+                    room_id: s[1],
+                    thread_root_id: s[2],
+                    latest_msg: s[3],
                     count,
                     ts,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::ShowUserInfo { user_id, target_user_id, display_name, avatar_url, is_online } => (
                 13,
-                Box::into_raw(Box::new(CShowUserInfo {
-                    user_id: to_c_char(&user_id),
-                    target_user_id: to_c_char(&target_user_id),
-                    display_name: to_c_char_opt(&display_name),
-                    avatar_url: to_c_char_opt(&avatar_url),
+                pack([Some(&*user_id), Some(&*target_user_id), display_name.as_deref(), avatar_url.as_deref()], |s| CShowUserInfo {
+                    user_id: s[0],
+                    target_user_id: s[1],
+                    display_name: s[2],
+                    avatar_url: s[3],
                     is_online,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::StickerPack { cb_ptr, user_id, pack_id, pack_name, user_data } => (
                 21,
-                Box::into_raw(Box::new(CStickerPack {
+                pack([Some(&*user_id), Some(pack_id.as_str()), Some(pack_name.as_str())], |s| CStickerPack {
                     cb_ptr,
-                    user_id: to_c_char(&user_id),
-                    pack_id: to_c_char(&pack_id),
-                    pack_name: to_c_char(&pack_name),
+                    user_id: s[0],
+                    pack_id: s[1],
+                    pack_name: s[2],
                     user_data,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::StickerDone { cb_ptr, user_data } => (
                 23,
-                Box::into_raw(Box::new(CStickerDone {
+                pack([], |_| CStickerDone {
                     cb_ptr,
                     user_data,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::Sticker { cb_ptr, user_id, pack_id, sticker_id, uri, description, user_data } => (
                 22,
-                Box::into_raw(Box::new(CSticker {
+                pack([Some(&*user_id), Some(pack_id.as_str()), Some(sticker_id.as_str()), Some(uri.as_str()), Some(description.as_str())], |s| CSticker {
                     cb_ptr,
-                    user_id: to_c_char(&user_id),
-                    pack_id: to_c_char(&pack_id),
-                    sticker_id: to_c_char(&sticker_id),
-                    uri: to_c_char(&uri),
-                    description: to_c_char(&description),
+                    user_id: s[0],
+                    pack_id: s[1],
+                    sticker_id: s[2],
+                    uri: s[3],
+                    description: s[4],
                     user_data,
-                })) as *mut c_void
+                })
             ),
             FfiEvent::PowerLevelUpdate { user_id, room_id, is_admin, can_kick, can_ban, can_redact, can_invite } => (
                 29,
-                Box::into_raw(Box::new(CPowerLevelUpdate {
-                    user_id: to_c_char(&user_id),
-                    room_id: to_c_char(&room_id),
+                pack([Some(&*user_id), Some(&*room_id)], |s| CPowerLevelUpdate {
+                    user_id: s[0],
+                    room_id: s[1],
                     is_admin,
                     can_kick,
                     can_ban,
                     can_redact,
                     can_invite,
-                })) as *mut c_void
+                })
             ),
         };
 
         unsafe {
             *out_type = ev_type;
             *out_data = ptr;
+            if !out_span.is_null() {
+                *out_span = span;
+            }
         }
         return true;
     }
     false
 }
 
+// Every event struct is a single allocation (see events::pack), so the type
+// is not needed to release it; it stays in the signature for the C side.
 #[no_mangle]
-pub extern "C" fn purple_matrix_rust_free_event(ev_type: i32, data: *mut c_void) {
-    if data.is_null() { return; }
-    unsafe {
-        match ev_type {
-            1 => {
-                let b = Box::from_raw(data as *mut CMessageReceived);
-                free_c_char(b.user_id);
-                free_c_char(b.sender);
-                free_c_char(b.msg);
-                free_c_char(b.room_id);
-                free_c_char(b.thread_root_id);
-                free_c_char(b.event_id);
-            },
-            2 => {
-                let b = Box::from_raw(data as *mut CTyping);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.who);
-            },
-            3 => {
-                let b = Box::from_raw(data as *mut CRoomJoined);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.name);
-                free_c_char(b.group_name);
-                free_c_char(b.avatar_url);
-                free_c_char(b.topic);
-            },
-            4 => {
-                let b = Box::from_raw(data as *mut CRoomLeft);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-            },
-            5 => {
-                let b = Box::from_raw(data as *mut CReadMarker);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.event_id);
-                free_c_char(b.who);
-            },
-            6 => {
-                let b = Box::from_raw(data as *mut CPresence);
-                free_c_char(b.user_id);
-                free_c_char(b.target_user_id);
-            },
-            7 => {
-                let b = Box::from_raw(data as *mut CChatTopic);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.topic);
-                free_c_char(b.sender);
-            },
-            8 => {
-                let b = Box::from_raw(data as *mut CChatUser);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.member_id);
-                free_c_char(b.alias);
-                free_c_char(b.avatar_path);
-            },
-            9 => {
-                let b = Box::from_raw(data as *mut CInvite);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.inviter);
-            },
-            12 => {
-                let b = Box::from_raw(data as *mut CLoginFailed);
-                free_c_char(b.user_id);
-                free_c_char(b.message);
-            },
-            25 => {
-                let b = Box::from_raw(data as *mut CConnected);
-                free_c_char(b.user_id);
-            },
-            24 => {
-                let b = Box::from_raw(data as *mut CSso);
-                free_c_char(b.url);
-            },
-            26 => {
-                let b = Box::from_raw(data as *mut CSasRequest);
-                free_c_char(b.user_id);
-                free_c_char(b.target_user_id);
-                free_c_char(b.flow_id);
-            },
-            27 => {
-                let b = Box::from_raw(data as *mut CSasHaveEmoji);
-                free_c_char(b.user_id);
-                free_c_char(b.target_user_id);
-                free_c_char(b.flow_id);
-                free_c_char(b.emojis);
-            },
-            28 => {
-                let b = Box::from_raw(data as *mut CShowVerificationQr);
-                free_c_char(b.user_id);
-                free_c_char(b.target_user_id);
-                free_c_char(b.html_data);
-            },
-            15 => {
-                let b = Box::from_raw(data as *mut CPollList);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.event_id);
-                free_c_char(b.question);
-                free_c_char(b.sender);
-                free_c_char(b.options_str);
-            },
-            30 => {
-                let b = Box::from_raw(data as *mut CReactionsChanged);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.event_id);
-                free_c_char(b.reactions_text);
-            },
-            31 => {
-                let b = Box::from_raw(data as *mut CMessageEdited);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.event_id);
-                free_c_char(b.new_msg);
-            },
-            10 => {
-                let b = Box::from_raw(data as *mut CRoomListAdd);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.name);
-                free_c_char(b.topic);
-                free_c_char(b.parent_id);
-            },
-            11 => {
-                let b = Box::from_raw(data as *mut CRoomPreview);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id_or_alias);
-                free_c_char(b.html_body);
-            },
-            14 => {
-                let b = Box::from_raw(data as *mut CThreadList);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-                free_c_char(b.thread_root_id);
-                free_c_char(b.latest_msg);
-            },
-            13 => {
-                let b = Box::from_raw(data as *mut CShowUserInfo);
-                free_c_char(b.user_id);
-                free_c_char(b.target_user_id);
-                free_c_char(b.display_name);
-                free_c_char(b.avatar_url);
-            },
-            21 => {
-                let b = Box::from_raw(data as *mut CStickerPack);
-                free_c_char(b.user_id);
-                free_c_char(b.pack_id);
-                free_c_char(b.pack_name);
-            },
-            23 => {
-                let _b = Box::from_raw(data as *mut CStickerDone);
-            },
-            22 => {
-                let b = Box::from_raw(data as *mut CSticker);
-                free_c_char(b.user_id);
-                free_c_char(b.pack_id);
-                free_c_char(b.sticker_id);
-                free_c_char(b.uri);
-                free_c_char(b.description);
-            },
-            29 => {
-                let b = Box::from_raw(data as *mut CPowerLevelUpdate);
-                free_c_char(b.user_id);
-                free_c_char(b.room_id);
-            },
-            _ => log::error!("Unknown FFI event type to free: {}", ev_type),
-        }
-    }
+pub extern "C" fn purple_matrix_rust_free_event(_ev_type: i32, data: *mut c_void) {
+    free_packed(data);
 }
 
 pub fn send_system_message(user_id: &str, msg: &str) {
     let event = FfiEvent::MessageReceived {
-        user_id: crate::sanitize_string(user_id),
-        sender: "System".to_string(),
+        user_id: crate::intern::id(user_id),
+        sender: crate::intern::id("System"),
         msg: format!("[System] {}", crate::sanitize_string(msg)),
         room_id: None,
         thread_root_id: None,
@@ -515,10 +417,10 @@ pub fn send_system_message(user_id: &str, msg: &str) {
 
 pub fn send_system_message_to_room(user_id: &str, room_id: &str, msg: &str) {
     let event = FfiEvent::MessageReceived {
-        user_id: crate::sanitize_string(user_id),
-        sender: "System".to_string(),
+        user_id: crate::intern::id(user_id),
+        sender: crate::intern::id("System"),
         msg: format!("[System] {}", crate::sanitize_string(msg)),
-        room_id: Some(crate::sanitize_string(room_id)),
+        room_id: Some(crate::intern::id(room_id)),
         thread_root_id: None,
         event_id: "system".to_string(),
         timestamp: 0,
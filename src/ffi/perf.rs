@@ -0,0 +1,63 @@
+use std::ffi::CStr;
+use std::os::raw::c_char;
+
+// Called by the C poll timer after each run that handled events.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_record_drain(micros: u64, events: u32) {
+    if events == 0 { return; }
+    crate::metrics::C_DRAIN.record_us(micros);
+}
+
+// Port number or absolute socket path for the OpenMetrics exporter; empty or
+// "0" turns it off.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_set_metrics_listen(listen: *const c_char) {
+    let listen_str = if listen.is_null() {
+        String::new()
+    } else {
+        unsafe { CStr::from_ptr(listen).to_string_lossy().into_owned() }
+    };
+    crate::metrics_export::configure(&listen_str);
+}
+
+// `stage` is FFI_TRACE_DISPATCHED, FFI_TRACE_DISPLAYED or FFI_TRACE_DROPPED.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_trace_event(span: u64, stage: i32) {
+    if span == 0 { return; }
+    crate::event_trace::report(span, stage);
+}
+
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_get_perf_stats(user_id: *const c_char) {
+    if user_id.is_null() { return; }
+    let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
+    let msg = format!("<b>Performance counters:</b><br/>{}", crate::metrics::report());
+    crate::ffi::send_system_message(&user_id_str, &msg);
+}
+
+// File to record the event stream to, bodies redacted; empty turns it off.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_set_event_record(path: *const c_char) {
+    let path_str = if path.is_null() {
+        String::new()
+    } else {
+        unsafe { CStr::from_ptr(path).to_string_lossy().into_owned() }
+    };
+    crate::event_record::configure(&path_str);
+}
+
+// Replays a recording as events of `user_id`. `speed` 1.0 is the recorded
+// pace, 0 is as fast as possible. False if the file is not a recording.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_replay_events(user_id: *const c_char, path: *const c_char, speed: f64) -> bool {
+    if user_id.is_null() || path.is_null() { return false; }
+    let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
+    let path_str = unsafe { CStr::from_ptr(path).to_string_lossy().into_owned() };
+    match crate::event_record::replay(&path_str, &user_id_str, speed) {
+        Ok(()) => true,
+        Err(e) => {
+            log::warn!("Cannot replay {}: {}", path_str, e);
+            false
+        }
+    }
+}
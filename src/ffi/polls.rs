@@ -132,8 +132,8 @@ pub extern "C" fn purple_matrix_rust_list_polls(user_id: *const c_char, room_id:
                                         let options_str = options.join(", ");
                                         
                                         let event = crate::ffi::FfiEvent::PollList {
-                                            user_id: user_id_str.clone(),
-                                            room_id: room_id_str.clone(),
+                                            user_id: crate::intern::id(&user_id_str),
+                                            room_id: crate::intern::id(&room_id_str),
                                             event_id: Some(ev.event_id.as_str().to_string()),
                                             sender: Some(ev.sender.as_str().to_string()),
                                             question: Some(question.to_string()),
@@ -148,8 +148,8 @@ pub extern "C" fn purple_matrix_rust_list_polls(user_id: *const c_char, room_id:
                     
                     // End of list marker
                     let event = crate::ffi::FfiEvent::PollList {
-                        user_id: user_id_str.clone(),
-                        room_id: room_id_str.clone(),
+                        user_id: crate::intern::id(&user_id_str),
+                        room_id: crate::intern::id(&room_id_str),
                         event_id: None,
                         question: None,
                         sender: None,
@@ -2,7 +2,6 @@ use std::ffi::CStr;
 use std::os::raw::c_char;
 use crate::{RUNTIME, with_client, sync_logic};
 
-use crate::{PAGINATION_TOKENS, HISTORY_FETCHED_ROOMS};
 use matrix_sdk::RoomState;
 
 #[no_mangle]
@@ -30,9 +29,9 @@ pub extern "C" fn purple_matrix_rust_fetch_room_members(user_id: *const c_char,
                             }
                             
                             let event = crate::ffi::FfiEvent::ChatUser {
-                                user_id: uid_async.clone(),
-                                room_id: room_id_str.clone(),
-                                member_id: user_id.to_string(),
+                                user_id: crate::intern::id(&uid_async),
+                                room_id: crate::intern::id(&room_id_str),
+                                member_id: crate::intern::id(&user_id),
                                 add: true,
                                 alias: Some(display_name.to_string()),
                                 avatar_path: avatar_path_str,
@@ -54,20 +53,17 @@ pub extern "C" fn purple_matrix_rust_fetch_history(user_id: *const c_char, room_
     let user_id_str = unsafe { CStr::from_ptr(user_id).to_string_lossy().into_owned() };
     let room_id_str = unsafe { CStr::from_ptr(room_id).to_string_lossy().into_owned() };
     
-    if HISTORY_FETCHED_ROOMS.contains(&room_id_str) {
-        return;
-    }
-    HISTORY_FETCHED_ROOMS.insert(room_id_str.clone());
-    
-    log::info!("Lazy fetching history for: {}", room_id_str);
-
     let _uid_async = user_id_str.clone();
     with_client(&user_id_str, move |client| {
+        let account = client.user_id().map(|u| u.to_string()).unwrap_or_default();
+        if !crate::history_state::mark_fetched(&account, &room_id_str) {
+            return;
+        }
+        log::info!("Lazy fetching history for: {}", room_id_str);
 
-        
         RUNTIME.spawn(async move {
             let actual_room_id = if let Ok(user_id) = <&matrix_sdk::ruma::UserId>::try_from(room_id_str.as_str()) {
-                if let Some(room) = client.get_dm_room(user_id) {
+                if let Some(room) = crate::dm_rooms::lookup(&client, user_id) {
                     Some(room.room_id().to_string())
                 } else {
                     log::warn!("Could not find DM room for user {}. History fetch skipped.", room_id_str);
@@ -111,11 +107,10 @@ pub extern "C" fn purple_matrix_rust_resync_recent_history(user_id: *const c_cha
         room_id_str = base.to_string();
     }
 
-    HISTORY_FETCHED_ROOMS.remove(&room_id_str);
-    PAGINATION_TOKENS.remove(&room_id_str);
-
     let _uid_async = user_id_str.clone();
     with_client(&user_id_str, move |client| {
+        let account = client.user_id().map(|u| u.to_string()).unwrap_or_default();
+        crate::history_state::reset_room(&account, &room_id_str);
 
         RUNTIME.spawn(async move {
             sync_logic::fetch_room_history_logic(client, room_id_str).await;
@@ -774,8 +769,8 @@ pub extern "C" fn purple_matrix_rust_get_space_hierarchy(user_id: *const c_char,
                             let r_id = room.summary.room_id.to_string();
                             let p_id = if r_id == space_id_str { None } else { Some(space_id_str.clone()) };
                             let event = crate::ffi::FfiEvent::RoomListAdd {
-                                user_id: uid_async.clone(),
-                                room_id: r_id,
+                                user_id: crate::intern::id(&uid_async),
+                                room_id: crate::intern::id(r_id),
                                 name: room.summary.name.unwrap_or_else(|| room.summary.room_id.to_string()),
                                 topic: room.summary.topic.unwrap_or_default(),
                                 member_count: u64::from(room.summary.num_joined_members) as usize,
@@ -820,9 +815,9 @@ pub extern "C" fn purple_matrix_rust_search_room_members(user_id: *const c_char,
                                 }
 
                                 let event = crate::ffi::FfiEvent::ChatUser {
-                                    user_id: uid_async.clone(),
-                                    room_id: room_id_str.clone(),
-                                    member_id: m_id.to_string(),
+                                    user_id: crate::intern::id(&uid_async),
+                                    room_id: crate::intern::id(&room_id_str),
+                                    member_id: crate::intern::id(&m_id),
                                     add: true,
                                     alias: Some(member.display_name().unwrap_or(m_id).to_string()),
                                     avatar_path: avatar_path_str,
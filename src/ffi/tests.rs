@@ -50,7 +50,7 @@ mod tests {
         use crate::ffi::{EVENTS_CHANNEL, FfiEvent};
         
         let event = FfiEvent::LoginFailed {
-            user_id: "test_user".to_string(),
+            user_id: crate::intern::id("test_user"),
             message: "test_message".to_string(),
         };
         
@@ -62,7 +62,7 @@ mod tests {
         assert!(received.is_ok(), "Failed to receive event from MPSC channel");
         
         if let Ok(FfiEvent::LoginFailed { user_id, message }) = received {
-            assert_eq!(user_id, "test_user");
+            assert_eq!(&*user_id, "test_user");
             assert_eq!(message, "test_message");
         } else {
             assert!(false, "Received wrong event type from channel");
@@ -74,8 +74,8 @@ mod tests {
         use crate::ffi::{EVENTS_CHANNEL, FfiEvent};
         
         let event = FfiEvent::RoomListAdd {
-            user_id: "u1".to_string(),
-            room_id: "r1".to_string(),
+            user_id: crate::intern::id("u1"),
+            room_id: crate::intern::id("r1"),
             name: "n1".to_string(),
             topic: "t1".to_string(),
             member_count: 5,
@@ -88,8 +88,8 @@ mod tests {
         assert!(received.is_ok());
         
         if let Ok(FfiEvent::RoomListAdd { user_id, room_id, name, topic, member_count, is_space, parent_id }) = received {
-            assert_eq!(user_id, "u1");
-            assert_eq!(room_id, "r1");
+            assert_eq!(&*user_id, "u1");
+            assert_eq!(&*room_id, "r1");
             assert_eq!(name, "n1");
             assert_eq!(topic, "t1");
             assert_eq!(member_count, 5);
@@ -99,4 +99,36 @@ mod tests {
             assert!(false, "Received wrong event type from channel");
         }
     }
+
+    #[test]
+    fn test_pack_single_allocation() {
+        use std::ffi::CStr;
+
+        let ptr = pack([Some("@me:example.org"), None, Some("hi 🎉"), Some(""), Some("a\0b")], |s| CRoomJoined {
+            user_id: s[0],
+            room_id: s[1],
+            name: s[2],
+            group_name: s[3],
+            avatar_url: s[4],
+            topic: std::ptr::null_mut(),
+            encrypted: true,
+            member_count: 3,
+        });
+        let ev = unsafe { &*(ptr as *const CRoomJoined) };
+        let text = |p: *mut c_char| unsafe { CStr::from_ptr(p).to_str().unwrap().to_string() };
+
+        assert_eq!(text(ev.user_id), "@me:example.org");
+        assert!(ev.room_id.is_null());
+        // Same output as sanitize_string + CString::new.
+        assert_eq!(text(ev.name), "hi  ");
+        assert_eq!(text(ev.group_name), " ");
+        assert_eq!(text(ev.avatar_url), "");
+        assert!(ev.encrypted && ev.member_count == 3);
+
+        // Strings sit right after the struct, in order, in the same block.
+        let base = ptr as usize + size_of::<CRoomJoined>();
+        assert_eq!(ev.user_id as usize, base);
+        assert_eq!(ev.name as usize, base + "@me:example.org".len() + 1);
+        free_packed(ptr);
+    }
 }
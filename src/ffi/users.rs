@@ -150,7 +150,7 @@ pub extern "C" fn purple_matrix_rust_add_buddy(account_user_id: *const c_char, b
             use matrix_sdk::ruma::UserId;
             if let Ok(uid) = <&UserId>::try_from(buddy_user_id_str.as_str()) {
                 log::info!("Adding buddy (Creating DM) for {}", buddy_user_id_str);
-                if let Err(e) = client.create_dm(uid).await {
+                if let Err(e) = crate::dm_rooms::resolve(&client, uid).await {
                     log::error!("Failed to create DM for added buddy {}: {:?}", buddy_user_id_str, e);
                 } else {
                     log::info!("DM created/ensured for buddy {}", buddy_user_id_str);
@@ -226,8 +226,8 @@ pub extern "C" fn purple_matrix_rust_get_user_info(account_user_id: *const c_cha
                         let is_online = false; 
 
                         let event = crate::ffi::FfiEvent::ShowUserInfo {
-                            user_id: account_user_id_str,
-                            target_user_id: user_id_str,
+                            user_id: crate::intern::id(account_user_id_str),
+                            target_user_id: crate::intern::id(user_id_str),
                             display_name: Some(display_name),
                             avatar_url: Some(avatar_url),
                             is_online,
@@ -237,8 +237,8 @@ pub extern "C" fn purple_matrix_rust_get_user_info(account_user_id: *const c_cha
                     Err(e) => {
                         log::error!("Failed to fetch profile for {}: {:?}", user_id_str, e);
                         let event = crate::ffi::FfiEvent::ShowUserInfo {
-                            user_id: account_user_id_str,
-                            target_user_id: user_id_str.clone(),
+                            user_id: crate::intern::id(account_user_id_str),
+                            target_user_id: crate::intern::id(&user_id_str),
                             display_name: Some(user_id_str),
                             avatar_url: Some("".to_string()),
                             is_online: false,
@@ -1,8 +1,16 @@
 use matrix_sdk::ruma::events::AnyGlobalAccountDataEvent;
 use matrix_sdk::Client;
 
-pub async fn handle_account_data(event: AnyGlobalAccountDataEvent, _client: Client) {
-    if let AnyGlobalAccountDataEvent::IgnoredUserList(ev) = event {
-        log::info!("Received updated ignored user list with {} users", ev.content.ignored_users.len());
+pub async fn handle_account_data(event: AnyGlobalAccountDataEvent, client: Client) {
+    match event {
+        AnyGlobalAccountDataEvent::IgnoredUserList(ev) => {
+            log::info!("Received updated ignored user list with {} users", ev.content.ignored_users.len());
+        }
+        AnyGlobalAccountDataEvent::Direct(ev) => {
+            if let Ok(content) = serde_json::to_value(&ev.content) {
+                crate::dm_rooms::load_direct(&client, &content);
+            }
+        }
+        _ => {}
     }
 }
@@ -67,7 +67,7 @@ pub async fn handle_slash_command(client: &Client, room_id: &RoomId, text: &str)
             Ok(CommandResult::Handled)
         },
         "poll" => {
-            log::info!("Handling /poll command: {}", args);
+            log::debug!("Handling /poll command in {}", room_id);
             let parts = parse_quoted_args(args);
             if parts.len() < 3 {
                  return Err(anyhow::anyhow!("Usage: /poll \"Question\" \"Option1\" \"Option2\"..."));
@@ -9,14 +9,32 @@ pub async fn handle_room_message(event: matrix_sdk::ruma::serde::Raw<SyncRoomMes
         let room_id = room.room_id().as_str();
         let timestamp: u64 = ev.origin_server_ts.0.into();
         let client = room.client();
-        let me = match client.user_id() {
-            Some(u) => u.as_str().to_string(),
+        let local_user_id = match client.user_id() {
+            Some(u) => crate::intern::id(u),
             None => {
                 log::warn!("Ignored message: Client user_id is missing");
                 return;
             }
         };
-        let local_user_id = me.clone();
+        crate::read_receipts::observe(&room, ev.event_id.as_str(), timestamp);
+        crate::metrics::room_message(room_id);
+
+        // Remote echo of something we sent: hand the real event id back so the
+        // C side can re-key the local echo it tagged with the transaction id.
+        if sender == &*local_user_id {
+            if let Some(txn_id) = raw_val.as_ref()
+                .and_then(|v| v.get("unsigned"))
+                .and_then(|u| u.get("transaction_id"))
+                .and_then(|t| t.as_str())
+            {
+                let _ = crate::ffi::EVENTS_CHANNEL.0.send(crate::ffi::FfiEvent::MessageSent {
+                    user_id: local_user_id.clone(),
+                    room_id: crate::intern::id(room_id),
+                    txn_id: txn_id.to_string(),
+                    event_id: ev.event_id.to_string(),
+                });
+            }
+        }
 
         // 0. Handle Edits (Replacements) - DO THIS FIRST
         let mut is_edit = false;
@@ -33,12 +51,13 @@ pub async fn handle_room_message(event: matrix_sdk::ruma::serde::Raw<SyncRoomMes
         }
 
         if is_edit && !target_id.is_empty() {
-            log::info!("Message replacement detected for {}", target_id);
+            log::debug!("Message replacement detected for {}", target_id);
             let body = render_room_message(&ev, &room).await;
             let edited_body = crate::html_fmt::style_edit(&body);
+            crate::event_store::replace(&local_user_id, room_id, &target_id, &edited_body);
             let ffi_ev = crate::ffi::FfiEvent::MessageEdited {
                 user_id: local_user_id,
-                room_id: room.room_id().to_string(),
+                room_id: crate::intern::id(room_id),
                 event_id: target_id,
                 new_msg: edited_body,
             };
@@ -48,7 +67,18 @@ pub async fn handle_room_message(event: matrix_sdk::ruma::serde::Raw<SyncRoomMes
 
         // Don't notify for our own messages (Pidgin echoes them)
         // UNLESS it's a reply, which Pidgin doesn't know how to echo.
-        if sender == local_user_id && ev.content.relates_to.is_none() { 
+        // They still go to the event store so reopened history includes them,
+        // without a render: nothing is displayed, so no media is fetched.
+        if sender == &*local_user_id && ev.content.relates_to.is_none() { 
+            let body = stored_own_body(&ev, &room);
+            crate::event_store::append(&local_user_id, room_id, crate::event_store::StoredEvent {
+                event_id: ev.event_id.to_string(),
+                sender: sender.to_string(),
+                body,
+                thread_root_id: None,
+                timestamp,
+                encrypted: false,
+            });
             return; 
         }
 
@@ -58,6 +88,9 @@ pub async fn handle_room_message(event: matrix_sdk::ruma::serde::Raw<SyncRoomMes
         }
 
         let mut body = render_room_message(&ev, &room).await;
+        if let Some(root) = &thread_root_id {
+            crate::thread_index::record_reply(&local_user_id, room_id, root, ev.event_id.as_str(), ev.content.body(), timestamp);
+        }
 
         // 1. Handle Replies
         let mut reply_to_id: Option<String> = None;
@@ -87,19 +120,30 @@ pub async fn handle_room_message(event: matrix_sdk::ruma::serde::Raw<SyncRoomMes
 
         let is_encrypted = room.get_state_event_static::<matrix_sdk::ruma::events::room::encryption::RoomEncryptionEventContent>().await.ok().flatten().is_some();
 
-        log::info!("Received msg from {} in {}: {} (Thread: {:?}, Enc: {})", sender, room_id, body, thread_root_id, is_encrypted);
+        // Never the body: this runs for every message and logs end up in bug reports.
+        log::debug!("Received {} from {} in {} ({} bytes, thread: {:?}, enc: {})", ev.event_id, sender, room_id, body.len(), thread_root_id, is_encrypted);
 
+        // Virtual thread ids embed an event id, so they stay out of the intern table.
         let target_room_id = if let Some(ref tid) = thread_root_id {
-            format!("{}|{}", room_id, tid)
+            crate::ffi::Id::from(format!("{}|{}", room_id, tid))
         } else {
-            room_id.to_string()
+            crate::intern::id(room_id)
         };
         
+        crate::event_store::append(&local_user_id, room_id, crate::event_store::StoredEvent {
+            event_id: ev.event_id.to_string(),
+            sender: sender.to_string(),
+            body: body.clone(),
+            thread_root_id: thread_root_id.clone(),
+            timestamp,
+            encrypted: is_encrypted,
+        });
+
         let display_body = format!("{} <font color='#ffffff' size='1'>(M:{})</font>", body, ev.event_id);
 
         let ffi_ev = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: sender.to_string(),
+            sender: crate::intern::id(sender),
             msg: display_body,
             room_id: Some(target_room_id),
             thread_root_id,
@@ -116,7 +160,10 @@ pub async fn handle_encrypted(event: matrix_sdk::ruma::serde::Raw<matrix_sdk::ru
      use matrix_sdk::ruma::events::AnySyncMessageLikeEvent;
      
      if let Ok(raw_original) = matrix_sdk::ruma::serde::Raw::<matrix_sdk::ruma::events::room::encrypted::OriginalSyncRoomEncryptedEvent>::from_json_string(event.json().get().to_string()) {
-         match room.decrypt_event(&raw_original, None).await {
+         let started = std::time::Instant::now();
+         let result = room.decrypt_event(&raw_original, None).await;
+         crate::metrics::DECRYPT.record(started.elapsed());
+         match result {
              Ok(decrypted) => {
                  if let Ok(any_event) = decrypted.raw().deserialize() {
                      if let AnySyncTimelineEvent::MessageLike(msg_like) = any_event {
@@ -141,24 +188,25 @@ pub async fn handle_encrypted(event: matrix_sdk::ruma::serde::Raw<matrix_sdk::ru
              }
          },
          Err(e) => {
+             crate::metrics::DECRYPT_FAILURES.inc();
              log::warn!("Failed to decrypt live event: {:?}", e);
+             crate::decryption::defer(&room, room.room_id().as_str(), event.json().get());
          }
      }
      }
 
      if let Ok(ev) = event.deserialize() {
          let client = room.client();
-         let me = match client.user_id() {
-             Some(u) => u.as_str().to_string(),
+         let local_user_id = match client.user_id() {
+             Some(u) => crate::intern::id(u),
              None => {
                  log::warn!("Ignored encrypted message: Client user_id is missing");
                  return;
              }
          };
-         let local_user_id = me.clone();
          let sender = ev.sender().as_str();
          
-         if sender == local_user_id { return; }
+         if sender == &*local_user_id { return; }
 
          let room_id = room.room_id().as_str();
          let timestamp: u64 = ev.origin_server_ts().0.into();
@@ -167,9 +215,9 @@ pub async fn handle_encrypted(event: matrix_sdk::ruma::serde::Raw<matrix_sdk::ru
          
          let ffi_ev = crate::ffi::FfiEvent::MessageReceived {
              user_id: local_user_id,
-             sender: sender.to_string(),
+             sender: crate::intern::id(sender),
              msg: body,
-             room_id: Some(room_id.to_string()),
+             room_id: Some(crate::intern::id(room_id)),
              thread_root_id: None,
              event_id: ev.event_id().to_string(),
              timestamp,
@@ -181,15 +229,19 @@ pub async fn handle_encrypted(event: matrix_sdk::ruma::serde::Raw<matrix_sdk::ru
 
 pub async fn handle_redaction(event: matrix_sdk::ruma::events::room::redaction::SyncRoomRedactionEvent, room: Room) {
     if let Some(ev) = event.as_original() {
-        let user_id = room.client().user_id().map(|u| u.as_str().to_string()).unwrap_or_default();
+        let user_id = crate::intern::id(room.client().user_id().map(|u| u.as_str()).unwrap_or_default());
         let room_id = room.room_id().as_str();
         let target_event_id = ev.redacts.as_ref().map(|id| id.as_str()).unwrap_or("");
-        
+        crate::event_store::redact(&user_id, room_id, target_event_id);
+        if !target_event_id.is_empty() {
+            crate::search_index::remove(&room, target_event_id);
+        }
+
         let ffi_ev = crate::ffi::FfiEvent::MessageReceived {
             user_id,
-            sender: "System".to_string(),
+            sender: crate::intern::id("System"),
             msg: format!("[System] [Redaction] Message {} was removed.", target_event_id),
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: ev.event_id.to_string(),
             timestamp: ev.origin_server_ts.0.into(),
@@ -209,7 +261,31 @@ fn sanitize_mime_ext(mime: &str, default: &str) -> String {
     }
 }
 
+// Media shown as a text label; images only when their thumbnail can't be fetched.
+fn media_label(msg_type: &matrix_sdk::ruma::events::room::message::MessageType) -> Option<String> {
+    use matrix_sdk::ruma::events::room::message::MessageType;
+    match msg_type {
+        MessageType::Image(content) => Some(format!("🖼️ [Image: {}]", crate::escape_html(&content.body))),
+        MessageType::Video(content) => Some(format!("🎞️ [Video: {}]", crate::escape_html(&content.body))),
+        MessageType::Audio(content) => Some(format!("🎵 [Audio: {}]", crate::escape_html(&content.body))),
+        MessageType::File(content) => Some(format!("📁 [File: {}]", crate::escape_html(&content.body))),
+        _ => None,
+    }
+}
+
+// Store copy of one of our own plain messages. Indexed like a rendered one.
+fn stored_own_body(ev: &matrix_sdk::ruma::events::room::message::OriginalSyncRoomMessageEvent, room: &Room) -> String {
+    crate::search_index::index_message(room, ev.event_id.as_str(), ev.sender.as_str(),
+        ev.origin_server_ts.0.into(), ev.content.msgtype.body());
+    media_label(&ev.content.msgtype).unwrap_or_else(|| crate::get_display_html(&ev.content))
+}
+
 pub async fn render_room_message(ev: &matrix_sdk::ruma::events::room::message::OriginalSyncRoomMessageEvent, room: &Room) -> String {
+    let _timer = crate::metrics::time(&crate::metrics::RENDER);
+    render_message_body(ev, room).await
+}
+
+async fn render_message_body(ev: &matrix_sdk::ruma::events::room::message::OriginalSyncRoomMessageEvent, room: &Room) -> String {
     use matrix_sdk::ruma::events::room::message::MessageType;
     use matrix_sdk::media::{MediaFormat, MediaRequestParameters};
 
@@ -219,6 +295,15 @@ pub async fn render_room_message(ev: &matrix_sdk::ruma::events::room::message::O
         &ev.content.msgtype
     };
 
+    // Every render path (live, backfill, history) runs after decryption.
+    if let Some(Relation::Replacement(ref repl)) = &ev.content.relates_to {
+        crate::search_index::index_edit(room, repl.event_id.as_str(), ev.sender.as_str(),
+            ev.origin_server_ts.0.into(), msg_type.body());
+    } else {
+        crate::search_index::index_message(room, ev.event_id.as_str(), ev.sender.as_str(),
+            ev.origin_server_ts.0.into(), msg_type.body());
+    }
+
     match msg_type {
         MessageType::Image(content) => {
             log::debug!("Attempting to render image: {}", content.body);
@@ -238,35 +323,28 @@ pub async fn render_room_message(ev: &matrix_sdk::ruma::events::room::message::O
                 MediaRequestParameters { source: content.source.clone(), format: MediaFormat::File }
             };
             
-            match room.client().media().get_media_content(&request, true).await {
+            let fetched = {
+                let _timer = crate::metrics::time(&crate::metrics::MEDIA_FETCH);
+                room.client().media().get_media_content(&request, true).await
+            };
+            match fetched {
                 Ok(bytes) => {
+                    crate::metrics::MEDIA_BYTES.add(bytes.len() as u64);
                     let cb_opt = {
                         let guard = crate::ffi::IMGSTORE_ADD_CALLBACK.lock().unwrap_or_else(|e| e.into_inner());
                         *guard
                     };
                     if let Some(cb) = cb_opt {
                         let id = cb(bytes.as_ptr() as *const u8, bytes.len());
-                        if id > 0 { format!("<img id=\"{}\" alt=\"{}\">", id, crate::escape_html(&content.body)) }
-                        else { format!("🖼️ [Image: {}]", crate::escape_html(&content.body)) }
-                    } else {
-                        format!("🖼️ [Image: {}]", crate::escape_html(&content.body))
+                        if id > 0 { return format!("<img id=\"{}\" alt=\"{}\">", id, crate::escape_html(&content.body)); }
                     }
                 },
                 Err(e) => {
                     log::warn!("Failed to get media content for {}: {:?}", content.body, e);
-                    format!("🖼️ [Image: {}]", crate::escape_html(&content.body))
                 }
             }
+            media_label(msg_type).unwrap_or_default()
         },
-        MessageType::Video(content) => {
-            format!("🎞️ [Video: {}]", crate::escape_html(&content.body))
-        },
-        MessageType::Audio(content) => {
-            format!("🎵 [Audio: {}]", crate::escape_html(&content.body))
-        },
-        MessageType::File(content) => {
-            format!("📁 [File: {}]", crate::escape_html(&content.body))
-        },
-        _ => crate::get_display_html(&ev.content),
+        _ => media_label(msg_type).unwrap_or_else(|| crate::get_display_html(&ev.content)),
     }
 }
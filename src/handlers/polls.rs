@@ -4,10 +4,10 @@ pub async fn handle_poll_start(event: matrix_sdk::ruma::events::poll::start::Syn
     if let matrix_sdk::ruma::events::poll::start::SyncPollStartEvent::Original(ev) = event {
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
         let sender = ev.sender.as_str();
         
-        if sender == local_user_id { return; }
+        if sender == &*local_user_id { return; }
 
         let room_id = room.room_id().as_str();
         let timestamp: u64 = ev.origin_server_ts.0.into();
@@ -18,9 +18,9 @@ pub async fn handle_poll_start(event: matrix_sdk::ruma::events::poll::start::Syn
         
         let event = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: sender.to_string(),
+            sender: crate::intern::id(sender),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: ev.event_id.to_string(),
             timestamp,
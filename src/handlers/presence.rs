@@ -2,7 +2,7 @@ use matrix_sdk::ruma::events::presence::PresenceEvent;
 use matrix_sdk::Client;
 
 pub async fn handle_presence(event: PresenceEvent, client: Client) {
-     let user_id = client.user_id().map(|u| u.as_str().to_string()).unwrap_or_default();
+     let user_id = crate::intern::id(client.user_id().map(|u| u.as_str()).unwrap_or_default());
      let target_user_id = event.sender.as_str();
      use matrix_sdk::ruma::presence::PresenceState;
      let is_online = match event.content.presence {
@@ -15,7 +15,7 @@ pub async fn handle_presence(event: PresenceEvent, client: Client) {
      
      let event = crate::ffi::FfiEvent::Presence {
          user_id,
-         target_user_id: target_user_id.to_string(),
+         target_user_id: crate::intern::id(target_user_id),
          is_online,
      };
      let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -2,11 +2,11 @@ use matrix_sdk::Room;
 
 pub async fn handle_reaction(event: matrix_sdk::ruma::events::reaction::SyncReactionEvent, room: Room) {
     if let matrix_sdk::ruma::events::reaction::SyncReactionEvent::Original(ev) = event {
-        log::info!("Reaction received: {} to event {} from {}", ev.content.relates_to.key, ev.content.relates_to.event_id, ev.sender);
+        log::debug!("Reaction to event {} from {}", ev.content.relates_to.event_id, ev.sender);
         
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
         
         let target_id = ev.content.relates_to.event_id.clone();
         
@@ -44,10 +44,10 @@ pub async fn handle_reaction(event: matrix_sdk::ruma::events::reaction::SyncReac
             summary = format!("{} 1", ev.content.relates_to.key);
         }
         
-        log::info!("Dispatching ReactionsChanged for {}: {}", target_id, summary);
+        log::debug!("Dispatching ReactionsChanged for {}", target_id);
         let event = crate::ffi::FfiEvent::ReactionsChanged {
             user_id: local_user_id,
-            room_id: room.room_id().to_string(),
+            room_id: crate::intern::id(room.room_id()),
             event_id: target_id.to_string(),
             reactions_text: format!("[System] [Reactions] {}", summary),
         };
@@ -59,10 +59,10 @@ pub async fn handle_sticker(event: matrix_sdk::ruma::events::sticker::SyncSticke
     if let matrix_sdk::ruma::events::sticker::SyncStickerEvent::Original(ev) = event {
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
         let sender = ev.sender.as_str();
         
-        if sender == local_user_id { return; }
+        if sender == &*local_user_id { return; }
 
         let room_id = room.room_id().as_str();
         let timestamp: u64 = ev.origin_server_ts.0.into();
@@ -71,9 +71,9 @@ pub async fn handle_sticker(event: matrix_sdk::ruma::events::sticker::SyncSticke
         
         let event = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: sender.to_string(),
+            sender: crate::intern::id(sender),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: ev.event_id.to_string(),
             timestamp,
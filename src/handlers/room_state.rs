@@ -11,15 +11,15 @@ pub async fn handle_room_topic(event: SyncRoomTopicEvent, room: Room) {
         let timestamp: u64 = ev.origin_server_ts.0.into();
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
 
         let body = format!("[System] {} set the topic to: {}", sender, topic);
 
         let event = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: "System".to_string(),
+            sender: crate::intern::id("System"),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: "".to_string(),
             timestamp,
@@ -38,7 +38,13 @@ pub async fn handle_room_member(event: SyncRoomMemberEvent, room: Room) {
         let timestamp: u64 = ev.origin_server_ts.0.into();
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
+
+        if target == &*local_user_id
+            && matches!(ev.content.membership, MembershipState::Leave | MembershipState::Ban)
+        {
+            crate::dm_rooms::forget_room(&client, room.room_id());
+        }
 
         let body = match ev.content.membership {
             MembershipState::Join => format!("[System] {} joined the room.", target),
@@ -50,9 +56,9 @@ pub async fn handle_room_member(event: SyncRoomMemberEvent, room: Room) {
 
         let event = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: "System".to_string(),
+            sender: crate::intern::id("System"),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: "".to_string(),
             timestamp,
@@ -73,15 +79,15 @@ pub async fn handle_tombstone(event: SyncRoomTombstoneEvent, room: Room) {
         let timestamp: u64 = ev.origin_server_ts.0.into();
         let client = room.client();
         let Some(me) = client.user_id() else { return; };
-        let local_user_id = me.as_str().to_string();
+        let local_user_id = crate::intern::id(me);
 
         let body = format!("[System] This room has been upgraded. New room ID: {}", new_room);
 
         let event = crate::ffi::FfiEvent::MessageReceived {
             user_id: local_user_id,
-            sender: "System".to_string(),
+            sender: crate::intern::id("System"),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(room_id)),
             thread_root_id: None,
             event_id: "".to_string(),
             timestamp,
@@ -95,8 +101,8 @@ pub async fn handle_power_levels(_event: matrix_sdk::ruma::events::room::power_l
     if let Ok(pl) = room.power_levels().await {
         let client = room.client();
         let Some(self_id) = client.user_id() else { return; };
-        let user_id = self_id.as_str().to_string();
-        let room_id = room.room_id().as_str().to_string();
+        let user_id = crate::intern::id(self_id);
+        let room_id = crate::intern::id(room.room_id());
         
         let my_level = pl.for_user(self_id);
         let is_admin = my_level >= matrix_sdk::ruma::int!(100);
@@ -50,13 +50,13 @@ pub async fn handle_typing(event: SyncTypingEvent, room: Room) {
     }
 
     // Emit callbacks
-    let user_id = room.client().user_id().map(|u| u.as_str().to_string()).unwrap_or_default();
+    let user_id = crate::intern::id(room.client().user_id().map(|u| u.as_str()).unwrap_or_default());
     
     for user in to_add {
         let event = crate::ffi::FfiEvent::Typing {
             user_id: user_id.clone(),
-            room_id: room_id.to_string(),
-            who: user,
+            room_id: crate::intern::id(room_id),
+            who: crate::intern::id(user),
             is_typing: true,
         };
         let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -65,8 +65,8 @@ pub async fn handle_typing(event: SyncTypingEvent, room: Room) {
     for user in to_remove {
         let event = crate::ffi::FfiEvent::Typing {
             user_id: user_id.clone(),
-            room_id: room_id.to_string(),
-            who: user,
+            room_id: crate::intern::id(room_id),
+            who: crate::intern::id(user),
             is_typing: false,
         };
         let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -0,0 +1,183 @@
+// Per-account history paging state.
+//
+// Which conversations have had their initial history fetched, and the back-
+// pagination token each one has reached, keyed by (account user_id, room id
+// or "room_id|thread_root"), so two accounts in the same room page
+// independently. Both maps are capped; past the cap the least recently used
+// entries are dropped, which only costs a refetch from the live end.
+// Whether a conversation was already painted from the local event store is
+// tracked apart from both, since losing that would paint the stored tail
+// into the conversation a second time. So is the gap between the stored
+// span and the live end until paging closes it, and after that how much of
+// the stored span is still unpainted.
+
+use std::collections::HashSet;
+use std::time::Instant;
+use dashmap::{DashMap, DashSet};
+use once_cell::sync::Lazy;
+
+const MAX_ENTRIES: usize = 2048;
+// Evict down to this many so a full scan happens once per batch of inserts.
+const EVICT_TO: usize = MAX_ENTRIES * 3 / 4;
+
+type Key = (String, String);
+
+static FETCHED: Lazy<DashMap<Key, Instant>> = Lazy::new(DashMap::new);
+static TOKENS: Lazy<DashMap<Key, (String, Instant)>> = Lazy::new(DashMap::new);
+// These three are not capped: one key per conversation opened this run.
+static PAINTED: Lazy<DashSet<Key>> = Lazy::new(DashSet::new);
+static GAPS: Lazy<DashMap<Key, Gap>> = Lazy::new(DashMap::new);
+static CURSORS: Lazy<DashMap<Key, StoreCursor>> = Lazy::new(DashMap::new);
+
+// A conversation painted from the event store that paging has not yet
+// reached: the painted event ids show where it meets the stored span, and
+// `stored_token` is where to resume from once it has. `oldest_painted` is
+// set when the store holds more than was painted.
+#[derive(Clone, Default)]
+pub struct Gap {
+    pub painted: HashSet<String>,
+    pub stored_token: Option<String>,
+    pub oldest_painted: Option<(u64, String)>,
+}
+
+// Paging position inside the event store once the gap is closed: stored
+// events older than (`timestamp`, `event_id`) come next, then the server
+// from `stored_token`.
+#[derive(Clone)]
+pub struct StoreCursor {
+    pub timestamp: u64,
+    pub event_id: String,
+    pub stored_token: Option<String>,
+}
+
+fn key(account: &str, room: &str) -> Key {
+    (account.to_string(), room.to_string())
+}
+
+fn evict<V>(map: &DashMap<Key, V>, last_used: impl Fn(&V) -> Instant) {
+    if map.len() <= MAX_ENTRIES {
+        return;
+    }
+    let mut ages: Vec<(Instant, Key)> = map.iter().map(|e| (last_used(e.value()), e.key().clone())).collect();
+    ages.sort_by_key(|(t, _)| *t);
+    let excess = ages.len().saturating_sub(EVICT_TO);
+    for (_, k) in ages.into_iter().take(excess) {
+        map.remove(&k);
+    }
+    log::debug!("Evicted {} history state entries", excess);
+}
+
+// Marks the conversation's initial history as fetched. Returns false if it
+// already was.
+pub fn mark_fetched(account: &str, room: &str) -> bool {
+    let fresh = FETCHED.insert(key(account, room), Instant::now()).is_none();
+    if fresh {
+        evict(&FETCHED, |t| *t);
+    }
+    fresh
+}
+
+// Marks the conversation as painted from the event store. Returns false if it
+// already was this run; resyncing a room does not clear it.
+pub fn mark_painted(account: &str, room: &str) -> bool {
+    PAINTED.insert(key(account, room))
+}
+
+pub fn gap(account: &str, room: &str) -> Option<Gap> {
+    GAPS.get(&key(account, room)).map(|g| g.clone())
+}
+
+pub fn open_gap(account: &str, room: &str, gap: Gap) {
+    GAPS.insert(key(account, room), gap);
+}
+
+pub fn close_gap(account: &str, room: &str) {
+    GAPS.remove(&key(account, room));
+}
+
+pub fn store_cursor(account: &str, room: &str) -> Option<StoreCursor> {
+    CURSORS.get(&key(account, room)).map(|c| c.clone())
+}
+
+pub fn set_store_cursor(account: &str, room: &str, cursor: StoreCursor) {
+    CURSORS.insert(key(account, room), cursor);
+}
+
+pub fn clear_store_cursor(account: &str, room: &str) {
+    CURSORS.remove(&key(account, room));
+}
+
+pub fn token(account: &str, room: &str) -> Option<String> {
+    TOKENS.get_mut(&key(account, room)).map(|mut e| {
+        e.1 = Instant::now();
+        e.0.clone()
+    })
+}
+
+pub fn has_token(account: &str, room: &str) -> bool {
+    TOKENS.contains_key(&key(account, room))
+}
+
+pub fn set_token(account: &str, room: &str, token: String) {
+    TOKENS.insert(key(account, room), (token, Instant::now()));
+    evict(&TOKENS, |(_, t)| *t);
+}
+
+// Forgets the fetched flag, the token and the store cursor for one
+// conversation.
+pub fn reset_room(account: &str, room: &str) {
+    let k = key(account, room);
+    FETCHED.remove(&k);
+    TOKENS.remove(&k);
+    CURSORS.remove(&k);
+}
+
+pub fn forget_account(account: &str) {
+    FETCHED.retain(|(a, _), _| a != account);
+    TOKENS.retain(|(a, _), _| a != account);
+    PAINTED.retain(|(a, _)| a != account);
+    GAPS.retain(|(a, _), _| a != account);
+    CURSORS.retain(|(a, _), _| a != account);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // One test: both halves touch the same global maps.
+    #[test]
+    fn test_scoping_and_eviction() {
+        let room = "!shared:example.org";
+        assert!(mark_fetched("@a:example.org", room));
+        assert!(!mark_fetched("@a:example.org", room));
+        assert!(mark_fetched("@b:example.org", room));
+
+        set_token("@a:example.org", room, "t_a".to_string());
+        assert_eq!(token("@a:example.org", room).as_deref(), Some("t_a"));
+        assert!(!has_token("@b:example.org", room));
+
+        assert!(mark_painted("@a:example.org", room));
+        assert!(!mark_painted("@a:example.org", room));
+
+        set_store_cursor("@a:example.org", room, StoreCursor {
+            timestamp: 10,
+            event_id: "$old".to_string(),
+            stored_token: None,
+        });
+        assert!(store_cursor("@b:example.org", room).is_none());
+
+        reset_room("@a:example.org", room);
+        assert!(token("@a:example.org", room).is_none());
+        assert!(store_cursor("@a:example.org", room).is_none());
+        assert!(!mark_fetched("@b:example.org", room));
+        forget_account("@b:example.org");
+        assert!(mark_fetched("@b:example.org", room));
+        assert!(!mark_painted("@a:example.org", room));
+
+        for i in 0..=MAX_ENTRIES {
+            set_token("@evict:example.org", &format!("!r{}:example.org", i), i.to_string());
+        }
+        assert!(TOKENS.len() <= MAX_ENTRIES);
+        assert!(has_token("@evict:example.org", &format!("!r{}:example.org", MAX_ENTRIES)));
+    }
+}
@@ -0,0 +1,52 @@
+// Interned identifiers.
+//
+// Account, room and user ids go into nearly every FfiEvent, and the same few
+// hundred of them repeat for the whole session. `id` hands out one shared
+// Arc<str> per distinct string, so building an event costs a refcount bump
+// instead of an allocation and copy. Only ids belong here, never bodies or
+// event ids: entries are kept for the life of the process. Virtual thread
+// conversation ids ("room_id|thread_root_id") embed an event id, so `id`
+// hands those out unshared, as it does any new string past MAX_IDS.
+
+use std::sync::Arc;
+use dashmap::DashSet;
+use once_cell::sync::Lazy;
+
+pub type Id = Arc<str>;
+
+const MAX_IDS: usize = 100_000;
+
+static IDS: Lazy<DashSet<Id>> = Lazy::new(DashSet::new);
+
+pub fn id(s: impl AsRef<str>) -> Id {
+    let s = s.as_ref();
+    if let Some(hit) = IDS.get(s) {
+        return hit.key().clone();
+    }
+    let fresh: Id = Arc::from(s);
+    if IDS.len() < MAX_IDS && !s.contains('|') {
+        IDS.insert(fresh.clone());
+    }
+    fresh
+}
+
+pub fn len() -> usize {
+    IDS.len()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_id_is_shared() {
+        let a = id("!intern-test:example.org");
+        let b = id(String::from("!intern-test:example.org"));
+        assert!(Arc::ptr_eq(&a, &b));
+        assert_eq!(&*a, "!intern-test:example.org");
+        assert!(!Arc::ptr_eq(&a, &id("!intern-other:example.org")));
+        let thread = "!intern-test:example.org|$root";
+        assert!(!Arc::ptr_eq(&id(thread), &id(thread)));
+        assert!(len() >= 2);
+    }
+}
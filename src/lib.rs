@@ -3,7 +3,7 @@ use std::sync::Mutex;
 use matrix_sdk::Client;
 use once_cell::sync::Lazy;
 use tokio::runtime::Runtime;
-use dashmap::{DashMap, DashSet};
+use dashmap::DashMap;
 
 pub mod ffi;
 
@@ -11,6 +11,20 @@ pub mod handlers;
 pub mod verification_logic;
 pub mod sync_logic;
 pub mod media_helper;
+pub mod read_receipts;
+pub mod send_queue;
+pub mod dm_rooms;
+pub mod typing_notices;
+pub mod search_index;
+pub mod event_store;
+pub mod history_state;
+pub mod decryption;
+pub mod thread_index;
+pub mod metrics;
+pub mod metrics_export;
+pub mod event_trace;
+pub mod event_record;
+pub mod intern;
 pub mod auth;
 pub mod grouping;
 pub mod html_fmt;
@@ -22,8 +36,6 @@ pub(crate) static RUNTIME: Lazy<Runtime> = Lazy::new(|| Runtime::new().unwrap_or
 }));
 // user_id -> Client
 pub(crate) static CLIENTS: Lazy<DashMap<String, Client>> = Lazy::new(DashMap::new);
-pub(crate) static HISTORY_FETCHED_ROOMS: Lazy<DashSet<String>> = Lazy::new(DashSet::new);
-pub(crate) static PAGINATION_TOKENS: Lazy<DashMap<String, String>> = Lazy::new(DashMap::new);
 pub(crate) static DATA_PATH: Lazy<Mutex<Option<std::path::PathBuf>>> = Lazy::new(|| Mutex::new(None));
 
 pub(crate) fn with_client<F, R>(user_id: &str, f: F) -> Option<R>
@@ -53,10 +65,22 @@ pub struct MatrixClientHandle;
 
 #[no_mangle]
 pub extern "C" fn purple_matrix_rust_init() {
-    let _ = tracing_subscriber::fmt()
-        .with_env_filter("info,matrix_sdk=debug,reqwest=debug,matrix_sdk_crypto=debug")
-        .with_writer(std::io::stderr)
-        .try_init();
+    use tracing_subscriber::prelude::*;
+
+    // PURPLE_MATRIX_LOG overrides the default at startup;
+    // purple_matrix_rust_set_log_filter changes it at runtime.
+    let filter = tracing_subscriber::EnvFilter::try_from_env("PURPLE_MATRIX_LOG")
+        .unwrap_or_else(|_| tracing_subscriber::EnvFilter::new(DEFAULT_LOG_FILTER));
+    let (filter, handle) = tracing_subscriber::reload::Layer::new(filter);
+    let installed = tracing_subscriber::registry()
+        .with(filter)
+        .with(tracing_subscriber::fmt::layer().with_writer(std::io::stderr))
+        .try_init()
+        .is_ok();
+    if installed {
+        let _ = LOG_FILTER.set(handle);
+        sync_log_max_level();
+    }
     
     log::info!("Rust backend initialized (tracing_subscriber configured)");
     
@@ -65,6 +89,56 @@ pub extern "C" fn purple_matrix_rust_init() {
     });
 }
 
+// SDK debug logging is itself costly on the sync path, so it is opt-in.
+const DEFAULT_LOG_FILTER: &str = "info";
+
+type LogFilterHandle = tracing_subscriber::reload::Handle<tracing_subscriber::EnvFilter, tracing_subscriber::Registry>;
+static LOG_FILTER: once_cell::sync::OnceCell<LogFilterHandle> = once_cell::sync::OnceCell::new();
+
+// Keeps the `log` crate's own gate in step with the tracing filter, so
+// disabled `log::debug!` calls are skipped before any formatting.
+fn sync_log_max_level() {
+    use tracing_subscriber::filter::LevelFilter;
+    let current = LevelFilter::current();
+    let level = if current == LevelFilter::OFF {
+        log::LevelFilter::Off
+    } else if current == LevelFilter::ERROR {
+        log::LevelFilter::Error
+    } else if current == LevelFilter::WARN {
+        log::LevelFilter::Warn
+    } else if current == LevelFilter::INFO {
+        log::LevelFilter::Info
+    } else if current == LevelFilter::DEBUG {
+        log::LevelFilter::Debug
+    } else {
+        log::LevelFilter::Trace
+    };
+    log::set_max_level(level);
+}
+
+// Replaces the log filter (EnvFilter directive syntax, e.g.
+// "info,matrix_sdk=debug"). Returns false if it does not parse.
+#[no_mangle]
+pub extern "C" fn purple_matrix_rust_set_log_filter(directives: *const std::os::raw::c_char) -> bool {
+    if directives.is_null() { return false; }
+    let directives_str = unsafe { std::ffi::CStr::from_ptr(directives).to_string_lossy().into_owned() };
+    let directives_str = if directives_str.trim().is_empty() { DEFAULT_LOG_FILTER.to_string() } else { directives_str };
+    let Some(handle) = LOG_FILTER.get() else { return false; };
+    let filter = match tracing_subscriber::EnvFilter::try_new(&directives_str) {
+        Ok(f) => f,
+        Err(e) => {
+            log::warn!("Rejected log filter '{}': {}", directives_str, e);
+            return false;
+        }
+    };
+    if handle.reload(filter).is_err() {
+        return false;
+    }
+    sync_log_max_level();
+    log::info!("Log filter set to '{}'", directives_str);
+    true
+}
+
 pub fn escape_html(input: &str) -> String {
     let mut escaped = String::with_capacity(input.len());
     for c in input.chars() {
@@ -85,7 +159,7 @@ pub fn sanitize_untrusted_html(input: &str) -> String {
     crate::html_fmt::sanitize_matrix_html(input)
 }
 
-pub(crate) fn sanitize_string(s: &str) -> String {
+pub fn sanitize_string(s: &str) -> String {
     let res: String = s.chars()
         .map(|c| if (c as u32) < 0x10000 { c } else { ' ' })
         .collect();
@@ -96,7 +170,7 @@ pub(crate) fn sanitize_string(s: &str) -> String {
 }
 
 
-pub(crate) fn create_message_content(text: String) -> matrix_sdk::ruma::events::room::message::RoomMessageEventContent {
+pub fn create_message_content(text: String) -> matrix_sdk::ruma::events::room::message::RoomMessageEventContent {
     use matrix_sdk::ruma::events::room::message::RoomMessageEventContent;
     use pulldown_cmark::{Parser, Options, html};
 
@@ -26,16 +26,23 @@ pub async fn download_avatar(client: &Client, url: &matrix_sdk::ruma::OwnedMxcUr
     path.push(filename);
     
     if path.exists() {
+        crate::metrics::MEDIA_CACHE_HITS.inc();
         return Some(path.to_string_lossy().to_string());
     }
+    crate::metrics::MEDIA_CACHE_MISSES.inc();
 
     let request = MediaRequestParameters {
         source: MediaSource::Plain(url.clone()),
         format: MediaFormat::File,
     };
 
-    match client.media().get_media_content(&request, true).await {
+    let fetched = {
+        let _timer = crate::metrics::time(&crate::metrics::MEDIA_FETCH);
+        client.media().get_media_content(&request, true).await
+    };
+    match fetched {
         Ok(bytes) => {
+            crate::metrics::MEDIA_BYTES.add(bytes.len() as u64);
             if let Ok(mut file) = std::fs::File::create(&path) {
                 use std::io::Write;
                 if file.write_all(&bytes).is_ok() {
@@ -82,3 +89,305 @@ pub async fn cleanup_media_files() {
         }
     }
 }
+
+/// Longest edge of the thumbnail attached to outgoing images.
+const THUMBNAIL_MAX_DIM: u32 = 800;
+/// Grid used for the blurhash placeholder (4x3 is what most clients emit).
+const BLURHASH_X_COMPONENTS: u32 = 4;
+const BLURHASH_Y_COMPONENTS: u32 = 3;
+
+// user_id -> longest edge (px) an outgoing photo may have before it is re-encoded; 0 = never
+pub(crate) static UPLOAD_MAX_IMAGE_DIM: once_cell::sync::Lazy<dashmap::DashMap<String, u32>> =
+    once_cell::sync::Lazy::new(dashmap::DashMap::new);
+
+pub struct PreparedAttachment {
+    pub data: Vec<u8>,
+    pub mime: mime_guess::mime::Mime,
+    pub config: matrix_sdk::attachment::AttachmentConfig,
+}
+
+/// Decodes an outgoing image, turns it upright per its EXIF orientation, optionally
+/// downscales it to `max_dim`, and builds an AttachmentConfig carrying dimensions,
+/// size, blurhash and a thumbnail.
+/// CPU-bound: call from `spawn_blocking`. Non-images and undecodable data pass through untouched.
+pub fn prepare_attachment(data: Vec<u8>, mime: mime_guess::mime::Mime, max_dim: u32) -> PreparedAttachment {
+    use image::GenericImageView;
+    use matrix_sdk::attachment::{AttachmentConfig, AttachmentInfo, BaseImageInfo, Thumbnail};
+    use matrix_sdk::ruma::UInt;
+
+    let passthrough = |data, mime| PreparedAttachment { data, mime, config: AttachmentConfig::new() };
+
+    if mime.type_() != mime_guess::mime::IMAGE {
+        return passthrough(data, mime);
+    }
+    let format = match image::guess_format(&data) {
+        Ok(f) => f,
+        Err(_) => return passthrough(data, mime),
+    };
+    let mut img = match image::load_from_memory_with_format(&data, format) {
+        Ok(i) => i,
+        Err(e) => {
+            log::warn!("Could not decode outgoing image, sending without metadata: {}", e);
+            return passthrough(data, mime);
+        }
+    };
+
+    // image 0.23 ignores EXIF orientation. Rotating here keeps the dimensions,
+    // blurhash and thumbnail upright; a re-encode below carries no EXIF, and
+    // an original sent as-is still has the tag for the receiving client.
+    if format == image::ImageFormat::Jpeg {
+        if let Some(orientation) = jpeg_orientation(&data) {
+            img = apply_orientation(img, orientation);
+        }
+    }
+
+    let mut data = data;
+    let mut mime = mime;
+    let (mut width, mut height) = img.dimensions();
+
+    // GIFs are left alone so animations survive; everything else may be re-encoded.
+    let reencodable = matches!(format, image::ImageFormat::Jpeg | image::ImageFormat::Png | image::ImageFormat::Bmp);
+    if max_dim > 0 && reencodable && width.max(height) > max_dim {
+        let scaled = img.resize(max_dim, max_dim, image::imageops::FilterType::Triangle);
+        if let Some((bytes, m)) = encode_image(&scaled, format == image::ImageFormat::Jpeg, 85) {
+            if bytes.len() < data.len() {
+                log::info!("Downscaled outgoing image {}x{} -> {}x{} ({} -> {} bytes)",
+                    width, height, scaled.width(), scaled.height(), data.len(), bytes.len());
+                data = bytes;
+                mime = m;
+                img = scaled;
+                width = img.width();
+                height = img.height();
+            }
+        }
+    }
+
+    let mut config = AttachmentConfig::new();
+
+    if width.max(height) > THUMBNAIL_MAX_DIM {
+        let thumb = img.thumbnail(THUMBNAIL_MAX_DIM, THUMBNAIL_MAX_DIM);
+        if let Some((bytes, content_type)) = encode_image(&thumb, !img.color().has_alpha(), 80) {
+            if bytes.len() < data.len() {
+                if let Ok(size) = UInt::try_from(bytes.len() as u64) {
+                    config = config.thumbnail(Some(Thumbnail {
+                        width: UInt::from(thumb.width()),
+                        height: UInt::from(thumb.height()),
+                        size,
+                        content_type,
+                        data: bytes,
+                    }));
+                }
+            }
+        }
+    }
+
+    let info = BaseImageInfo {
+        width: Some(UInt::from(width)),
+        height: Some(UInt::from(height)),
+        size: UInt::try_from(data.len() as u64).ok(),
+        blurhash: Some(blurhash(&img)),
+        ..Default::default()
+    };
+    config = config.info(AttachmentInfo::Image(info));
+
+    PreparedAttachment { data, mime, config }
+}
+
+// EXIF orientation (2-8) of a JPEG that needs turning, if it has one.
+fn jpeg_orientation(data: &[u8]) -> Option<u16> {
+    if data.get(..2)? != [0xFF, 0xD8] {
+        return None;
+    }
+    let mut pos = 2;
+    while pos + 4 <= data.len() {
+        let marker = data[pos + 1];
+        // Not a marker, or start of scan / end of image: no APP1 ahead.
+        if data[pos] != 0xFF || marker == 0xDA || marker == 0xD9 {
+            return None;
+        }
+        let len = u16::from_be_bytes([data[pos + 2], data[pos + 3]]) as usize;
+        let segment = data.get(pos + 4..pos + 2 + len.max(2))?;
+        if marker == 0xE1 && segment.starts_with(b"Exif\0\0") {
+            return tiff_orientation(&segment[6..]).filter(|o| (2..=8).contains(o));
+        }
+        pos += 2 + len;
+    }
+    None
+}
+
+// Orientation tag (0x0112) from IFD0 of an EXIF TIFF block.
+fn tiff_orientation(tiff: &[u8]) -> Option<u16> {
+    let little = match tiff.get(..2)? {
+        b"II" => true,
+        b"MM" => false,
+        _ => return None,
+    };
+    let u16_at = |at: usize| {
+        let b = tiff.get(at..at + 2)?;
+        Some(if little { u16::from_le_bytes([b[0], b[1]]) } else { u16::from_be_bytes([b[0], b[1]]) })
+    };
+    let u32_at = |at: usize| {
+        let b = tiff.get(at..at + 4)?;
+        let b = [b[0], b[1], b[2], b[3]];
+        Some(if little { u32::from_le_bytes(b) } else { u32::from_be_bytes(b) })
+    };
+    let ifd = u32_at(4)? as usize;
+    for i in 0..u16_at(ifd)? as usize {
+        let entry = ifd + 2 + i * 12;
+        if u16_at(entry)? == 0x0112 {
+            // SHORT, count 1: the value sits in the first half of the value field.
+            return u16_at(entry + 8);
+        }
+    }
+    None
+}
+
+fn apply_orientation(img: image::DynamicImage, orientation: u16) -> image::DynamicImage {
+    match orientation {
+        2 => img.fliph(),
+        3 => img.rotate180(),
+        4 => img.flipv(),
+        5 => img.rotate90().fliph(),
+        6 => img.rotate90(),
+        7 => img.rotate270().fliph(),
+        8 => img.rotate270(),
+        _ => img,
+    }
+}
+
+fn encode_image(img: &image::DynamicImage, jpeg: bool, quality: u8) -> Option<(Vec<u8>, mime_guess::mime::Mime)> {
+    let mut out = Vec::new();
+    let result = if jpeg {
+        image::DynamicImage::ImageRgb8(img.to_rgb8()).write_to(&mut out, image::ImageOutputFormat::Jpeg(quality))
+    } else {
+        img.write_to(&mut out, image::ImageOutputFormat::Png)
+    };
+    match result {
+        Ok(()) => Some((out, if jpeg { mime_guess::mime::IMAGE_JPEG } else { mime_guess::mime::IMAGE_PNG })),
+        Err(e) => {
+            log::warn!("Failed to encode image: {}", e);
+            None
+        }
+    }
+}
+
+const BASE83: &[u8] = b"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+fn push_base83(out: &mut String, value: u32, length: u32) {
+    for i in 1..=length {
+        let digit = (value / 83u32.pow(length - i)) % 83;
+        out.push(BASE83[digit as usize] as char);
+    }
+}
+
+fn srgb_to_linear(v: u8) -> f32 {
+    let v = v as f32 / 255.0;
+    if v <= 0.04045 { v / 12.92 } else { ((v + 0.055) / 1.055).powf(2.4) }
+}
+
+fn linear_to_srgb(v: f32) -> u32 {
+    let v = v.max(0.0).min(1.0);
+    if v <= 0.003_130_8 {
+        (v * 12.92 * 255.0 + 0.5) as u32
+    } else {
+        ((1.055 * v.powf(1.0 / 2.4) - 0.055) * 255.0 + 0.5) as u32
+    }
+}
+
+/// Encodes a blurhash placeholder (https://blurha.sh) from a 32px preview of `img`.
+pub fn blurhash(img: &image::DynamicImage) -> String {
+    let small = img.thumbnail(32, 32).to_rgb8();
+    let (w, h) = small.dimensions();
+    let (cx, cy) = (BLURHASH_X_COMPONENTS, BLURHASH_Y_COMPONENTS);
+
+    let mut factors: Vec<[f32; 3]> = Vec::with_capacity((cx * cy) as usize);
+    for j in 0..cy {
+        for i in 0..cx {
+            let norm = if i == 0 && j == 0 { 1.0 } else { 2.0 };
+            let mut acc = [0.0f32; 3];
+            for (x, y, px) in small.enumerate_pixels() {
+                let basis = norm
+                    * (std::f32::consts::PI * i as f32 * x as f32 / w as f32).cos()
+                    * (std::f32::consts::PI * j as f32 * y as f32 / h as f32).cos();
+                acc[0] += basis * srgb_to_linear(px[0]);
+                acc[1] += basis * srgb_to_linear(px[1]);
+                acc[2] += basis * srgb_to_linear(px[2]);
+            }
+            let scale = 1.0 / (w * h) as f32;
+            factors.push([acc[0] * scale, acc[1] * scale, acc[2] * scale]);
+        }
+    }
+
+    let mut hash = String::with_capacity(28);
+    push_base83(&mut hash, (cx - 1) + (cy - 1) * 9, 1);
+
+    let (dc, ac) = (factors[0], &factors[1..]);
+    let max_value = if ac.is_empty() {
+        push_base83(&mut hash, 0, 1);
+        1.0
+    } else {
+        let actual_max = ac.iter().flat_map(|c| c.iter()).fold(0.0f32, |m, v| m.max(v.abs()));
+        let quantised = (actual_max * 166.0 - 0.5).floor().max(0.0).min(82.0) as u32;
+        push_base83(&mut hash, quantised, 1);
+        (quantised as f32 + 1.0) / 166.0
+    };
+
+    let dc_value = (linear_to_srgb(dc[0]) << 16) + (linear_to_srgb(dc[1]) << 8) + linear_to_srgb(dc[2]);
+    push_base83(&mut hash, dc_value, 4);
+
+    let quant = |v: f32| {
+        let v = v / max_value;
+        let signed = v.abs().sqrt().copysign(v);
+        (signed * 9.0 + 9.5).floor().max(0.0).min(18.0) as u32
+    };
+    for c in ac {
+        push_base83(&mut hash, quant(c[0]) * 19 * 19 + quant(c[1]) * 19 + quant(c[2]), 2);
+    }
+    hash
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_blurhash_solid_colour() {
+        let img = image::DynamicImage::ImageRgb8(image::RgbImage::from_pixel(64, 48, image::Rgb([255, 0, 0])));
+        let hash = blurhash(&img);
+        // 1 size flag + 1 max AC + 4 DC + 2 per AC component
+        assert_eq!(hash.len(), 2 + 4 + 2 * 11);
+        // 4x3 size flag, then a pure red DC term.
+        assert!(hash.starts_with('L'));
+        assert_eq!(&hash[2..6], "TI:j");
+        assert_eq!(hash, blurhash(&img));
+    }
+
+    #[test]
+    fn test_prepare_attachment_passes_non_images_through() {
+        let data = b"not an image".to_vec();
+        let prepared = prepare_attachment(data.clone(), mime_guess::mime::TEXT_PLAIN, 1024);
+        assert_eq!(prepared.data, data);
+        assert_eq!(prepared.mime, mime_guess::mime::TEXT_PLAIN);
+    }
+
+    #[test]
+    fn test_exif_orientation() {
+        use image::GenericImageView;
+
+        // SOI, APP1 "Exif" with a big-endian TIFF whose IFD0 holds Orientation = 6.
+        let mut tiff = b"MM\0\x2a\0\0\0\x08".to_vec();
+        tiff.extend_from_slice(&[0, 1, 0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, 6, 0, 0, 0, 0, 0, 0, 0, 0]);
+        let mut app1 = b"Exif\0\0".to_vec();
+        app1.extend_from_slice(&tiff);
+        let mut jpeg = vec![0xFF, 0xD8, 0xFF, 0xE1];
+        jpeg.extend_from_slice(&((app1.len() + 2) as u16).to_be_bytes());
+        jpeg.extend_from_slice(&app1);
+        jpeg.extend_from_slice(&[0xFF, 0xDA, 0, 2]);
+        assert_eq!(jpeg_orientation(&jpeg), Some(6));
+        assert_eq!(jpeg_orientation(&[0xFF, 0xD8, 0xFF, 0xDA, 0, 2]), None);
+
+        let wide = image::DynamicImage::ImageRgb8(image::RgbImage::new(40, 30));
+        assert_eq!(apply_orientation(wide.clone(), 6).dimensions(), (30, 40));
+        assert_eq!(apply_orientation(wide, 3).dimensions(), (40, 30));
+    }
+}
@@ -0,0 +1,375 @@
+// Process-wide performance counters.
+//
+// Everything here is a static of atomics: recording is a couple of relaxed
+// fetch_adds and never takes a lock, so it is safe on the sync path and from
+// the C poll timer. Histograms are log-linear (eight sub-buckets per power of
+// two, so any reported quantile is within 12.5% of the true value) over
+// microseconds.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::{Duration, SystemTime, UNIX_EPOCH};
+use dashmap::DashMap;
+use once_cell::sync::Lazy;
+
+pub struct Counter(AtomicU64);
+
+impl Counter {
+    pub const fn new() -> Self {
+        Counter(AtomicU64::new(0))
+    }
+
+    pub fn inc(&self) {
+        self.0.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub fn add(&self, n: u64) {
+        self.0.fetch_add(n, Ordering::Relaxed);
+    }
+
+    pub fn get(&self) -> u64 {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+const SUB_BITS: u32 = 3;
+const SUB: u64 = 1 << SUB_BITS;
+const BUCKETS: usize = ((64 - SUB_BITS as usize + 1) * SUB as usize) as usize;
+
+pub struct Histogram {
+    buckets: [AtomicU64; BUCKETS],
+    count: AtomicU64,
+    sum: AtomicU64,
+    max: AtomicU64,
+}
+
+fn bucket_of(v: u64) -> usize {
+    if v < SUB {
+        return v as usize;
+    }
+    let exp = 63 - v.leading_zeros();
+    let mantissa = (v >> (exp - SUB_BITS)) & (SUB - 1);
+    ((exp - SUB_BITS + 1) as u64 * SUB + mantissa) as usize
+}
+
+// Smallest value that lands in bucket `i`.
+fn bucket_floor(i: usize) -> u64 {
+    if i >= BUCKETS {
+        return u64::MAX;
+    }
+    let i = i as u64;
+    if i < SUB {
+        return i;
+    }
+    let exp = i / SUB + SUB_BITS as u64 - 1;
+    (SUB + i % SUB) << (exp - SUB_BITS as u64)
+}
+
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct Summary {
+    pub count: u64,
+    pub sum_us: u64,
+    pub p50_us: u64,
+    pub p90_us: u64,
+    pub p99_us: u64,
+    pub max_us: u64,
+}
+
+impl Histogram {
+    pub const fn new() -> Self {
+        #[allow(clippy::declare_interior_mutable_const)]
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Histogram { buckets: [ZERO; BUCKETS], count: ZERO, sum: ZERO, max: ZERO }
+    }
+
+    pub fn record_us(&self, us: u64) {
+        self.buckets[bucket_of(us)].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(us, Ordering::Relaxed);
+        self.max.fetch_max(us, Ordering::Relaxed);
+    }
+
+    pub fn record(&self, d: Duration) {
+        self.record_us(d.as_micros().min(u64::MAX as u128) as u64);
+    }
+
+    // Counts per bucket as (upper bound in µs, count), non-empty buckets only.
+    pub fn buckets(&self) -> Vec<(u64, u64)> {
+        self.buckets
+            .iter()
+            .enumerate()
+            .filter_map(|(i, b)| {
+                let n = b.load(Ordering::Relaxed);
+                (n > 0).then(|| (bucket_floor(i + 1).saturating_sub(1), n))
+            })
+            .collect()
+    }
+
+    // Samples at or below `us`, to bucket resolution.
+    pub fn count_le(&self, us: u64) -> u64 {
+        self.buckets
+            .iter()
+            .enumerate()
+            .take_while(|(i, _)| bucket_floor(i + 1).saturating_sub(1) <= us)
+            .map(|(_, b)| b.load(Ordering::Relaxed))
+            .sum()
+    }
+
+    pub fn summary(&self) -> Summary {
+        let counts: Vec<u64> = self.buckets.iter().map(|b| b.load(Ordering::Relaxed)).collect();
+        let total: u64 = counts.iter().sum();
+        let quantile = |q: f64| -> u64 {
+            if total == 0 {
+                return 0;
+            }
+            let rank = ((total as f64) * q).ceil().max(1.0) as u64;
+            let mut seen = 0;
+            for (i, n) in counts.iter().enumerate() {
+                seen += n;
+                if seen >= rank {
+                    return bucket_floor(i + 1).saturating_sub(1);
+                }
+            }
+            0
+        };
+        let max_us = self.max.load(Ordering::Relaxed);
+        Summary {
+            count: total,
+            sum_us: self.sum.load(Ordering::Relaxed),
+            p50_us: quantile(0.50).min(max_us),
+            p90_us: quantile(0.90).min(max_us),
+            p99_us: quantile(0.99).min(max_us),
+            max_us,
+        }
+    }
+}
+
+// Times the rest of the enclosing scope into `hist`.
+pub struct Timer<'a> {
+    hist: &'a Histogram,
+    start: std::time::Instant,
+}
+
+pub fn time(hist: &Histogram) -> Timer<'_> {
+    Timer { hist, start: std::time::Instant::now() }
+}
+
+impl Drop for Timer<'_> {
+    fn drop(&mut self) {
+        self.hist.record(self.start.elapsed());
+    }
+}
+
+// Interval between consecutive sync responses (includes the long-poll wait).
+pub static SYNC_ROUNDTRIP: Histogram = Histogram::new();
+pub static DECRYPT: Histogram = Histogram::new();
+pub static RENDER: Histogram = Histogram::new();
+// Time an FfiEvent spent in EVENTS_CHANNEL before the C side polled it.
+pub static EVENT_QUEUE_WAIT: Histogram = Histogram::new();
+// One run of the C poll timer that handled at least one event.
+pub static C_DRAIN: Histogram = Histogram::new();
+pub static MEDIA_FETCH: Histogram = Histogram::new();
+// From enqueue to the C dispatch of the event, and to a message being shown.
+pub static DISPATCH: Histogram = Histogram::new();
+pub static RECEIVE_TO_DISPLAY: Histogram = Histogram::new();
+
+pub static DECRYPT_FAILURES: Counter = Counter::new();
+pub static EVENTS_ENQUEUED: Counter = Counter::new();
+pub static EVENTS_DELIVERED: Counter = Counter::new();
+pub static MEDIA_CACHE_HITS: Counter = Counter::new();
+pub static MEDIA_CACHE_MISSES: Counter = Counter::new();
+pub static MEDIA_BYTES: Counter = Counter::new();
+
+// Rooms tracked for per-room message counts; beyond this they are not
+// labelled individually, to keep the exported series bounded.
+const MAX_ROOM_SERIES: usize = 500;
+
+static ROOM_MESSAGES: Lazy<DashMap<String, AtomicU64>> = Lazy::new(DashMap::new);
+static LAST_SYNC_SECS: AtomicU64 = AtomicU64::new(0);
+
+fn now_secs() -> u64 {
+    SystemTime::now().duration_since(UNIX_EPOCH).map(|d| d.as_secs()).unwrap_or(0)
+}
+
+pub fn mark_sync() {
+    LAST_SYNC_SECS.store(now_secs(), Ordering::Relaxed);
+}
+
+pub fn room_message(room_id: &str) {
+    if let Some(n) = ROOM_MESSAGES.get(room_id) {
+        n.fetch_add(1, Ordering::Relaxed);
+        return;
+    }
+    let key = if ROOM_MESSAGES.len() < MAX_ROOM_SERIES { room_id } else { "other" };
+    ROOM_MESSAGES.entry(key.to_string()).or_insert_with(|| AtomicU64::new(0)).fetch_add(1, Ordering::Relaxed);
+}
+
+pub fn histograms() -> [(&'static str, &'static Histogram); 8] {
+    [
+        ("sync_roundtrip", &SYNC_ROUNDTRIP),
+        ("decrypt", &DECRYPT),
+        ("render", &RENDER),
+        ("event_queue_wait", &EVENT_QUEUE_WAIT),
+        ("c_drain", &C_DRAIN),
+        ("media_fetch", &MEDIA_FETCH),
+        ("dispatch", &DISPATCH),
+        ("receive_to_display", &RECEIVE_TO_DISPLAY),
+    ]
+}
+
+pub fn counters() -> [(&'static str, &'static Counter); 6] {
+    [
+        ("decrypt_failures", &DECRYPT_FAILURES),
+        ("events_enqueued", &EVENTS_ENQUEUED),
+        ("events_delivered", &EVENTS_DELIVERED),
+        ("media_cache_hits", &MEDIA_CACHE_HITS),
+        ("media_cache_misses", &MEDIA_CACHE_MISSES),
+        ("media_bytes", &MEDIA_BYTES),
+    ]
+}
+
+fn fmt_us(us: u64) -> String {
+    if us >= 1_000_000 {
+        format!("{:.2}s", us as f64 / 1e6)
+    } else if us >= 1_000 {
+        format!("{:.1}ms", us as f64 / 1e3)
+    } else {
+        format!("{}µs", us)
+    }
+}
+
+// Human-readable snapshot, one line per metric, for /matrix_perf.
+pub fn report() -> String {
+    let mut lines = vec![
+        format!("<b>Event queue depth:</b> {}", crate::ffi::EVENTS_CHANNEL.1.len()),
+        format!("<b>Interned ids:</b> {}", crate::intern::len()),
+    ];
+    for (name, hist) in histograms() {
+        let s = hist.summary();
+        if s.count == 0 {
+            lines.push(format!("<b>{}:</b> no samples", name));
+            continue;
+        }
+        lines.push(format!(
+            "<b>{}:</b> n={} p50={} p90={} p99={} max={}",
+            name, s.count, fmt_us(s.p50_us), fmt_us(s.p90_us), fmt_us(s.p99_us), fmt_us(s.max_us)
+        ));
+    }
+    for (name, counter) in counters() {
+        lines.push(format!("<b>{}:</b> {}", name, counter.get()));
+    }
+    let (hits, misses) = (MEDIA_CACHE_HITS.get(), MEDIA_CACHE_MISSES.get());
+    if hits + misses > 0 {
+        lines.push(format!("<b>media_cache_hit_rate:</b> {:.1}%", hits as f64 * 100.0 / (hits + misses) as f64));
+    }
+    lines.join("<br/>")
+}
+
+// Resident set size of this process, from /proc (Linux only).
+fn rss_bytes() -> Option<u64> {
+    let status = std::fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|l| l.starts_with("VmRSS:"))?;
+    let kb: u64 = line.split_whitespace().nth(1)?.parse().ok()?;
+    Some(kb * 1024)
+}
+
+fn escape_label(v: &str) -> String {
+    v.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n")
+}
+
+// Export buckets, in µs. Fixed so series stay comparable across scrapes.
+const EXPORT_BUCKETS_US: [u64; 16] = [
+    100, 250, 500, 1_000, 2_500, 5_000, 10_000, 25_000, 50_000, 100_000,
+    250_000, 500_000, 1_000_000, 2_500_000, 10_000_000, 60_000_000,
+];
+
+// The whole registry in OpenMetrics text format.
+pub fn openmetrics() -> String {
+    use std::fmt::Write;
+    let mut out = String::new();
+
+    let _ = writeln!(out, "# TYPE purple_matrix_event_backlog gauge");
+    let _ = writeln!(out, "purple_matrix_event_backlog {}", crate::ffi::EVENTS_CHANNEL.1.len());
+
+    let last_sync = LAST_SYNC_SECS.load(Ordering::Relaxed);
+    if last_sync > 0 {
+        let _ = writeln!(out, "# TYPE purple_matrix_sync_lag_seconds gauge");
+        let _ = writeln!(out, "purple_matrix_sync_lag_seconds {}", now_secs().saturating_sub(last_sync));
+    }
+
+    if let Some(rss) = rss_bytes() {
+        let _ = writeln!(out, "# TYPE purple_matrix_process_resident_memory_bytes gauge");
+        let _ = writeln!(out, "purple_matrix_process_resident_memory_bytes {}", rss);
+    }
+
+    for (name, counter) in counters() {
+        let _ = writeln!(out, "# TYPE purple_matrix_{} counter", name);
+        let _ = writeln!(out, "purple_matrix_{}_total {}", name, counter.get());
+    }
+
+    let _ = writeln!(out, "# TYPE purple_matrix_room_messages counter");
+    for entry in ROOM_MESSAGES.iter() {
+        let _ = writeln!(out, "purple_matrix_room_messages_total{{room=\"{}\"}} {}",
+            escape_label(entry.key()), entry.value().load(Ordering::Relaxed));
+    }
+
+    for (name, hist) in histograms() {
+        let s = hist.summary();
+        let _ = writeln!(out, "# TYPE purple_matrix_{}_seconds histogram", name);
+        for le in EXPORT_BUCKETS_US {
+            let _ = writeln!(out, "purple_matrix_{}_seconds_bucket{{le=\"{}\"}} {}",
+                name, le as f64 / 1e6, hist.count_le(le).min(s.count));
+        }
+        let _ = writeln!(out, "purple_matrix_{}_seconds_bucket{{le=\"+Inf\"}} {}", name, s.count);
+        let _ = writeln!(out, "purple_matrix_{}_seconds_sum {}", name, s.sum_us as f64 / 1e6);
+        let _ = writeln!(out, "purple_matrix_{}_seconds_count {}", name, s.count);
+    }
+
+    out.push_str("# EOF\n");
+    out
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_buckets_are_monotonic_and_tight() {
+        for v in [0u64, 1, 7, 8, 9, 15, 16, 17, 100, 1_000, 123_456, u64::MAX / 2, u64::MAX] {
+            let b = bucket_of(v);
+            assert!(b < BUCKETS);
+            assert!(bucket_floor(b) <= v, "floor of bucket for {}", v);
+            if b + 1 < BUCKETS {
+                assert!(bucket_floor(b + 1) > v, "next floor for {}", v);
+            }
+        }
+        assert_eq!(bucket_floor(bucket_of(1_000)), 960);
+    }
+
+    #[test]
+    fn test_openmetrics_text() {
+        room_message("!a:example.org");
+        room_message("!a:example.org");
+        RENDER.record_us(300);
+        let text = openmetrics();
+        assert!(text.ends_with("# EOF\n"));
+        assert!(text.contains("purple_matrix_room_messages_total{room=\"!a:example.org\"} 2"));
+        assert!(text.contains("# TYPE purple_matrix_render_seconds histogram"));
+        assert!(text.contains("purple_matrix_render_seconds_bucket{le=\"+Inf\"}"));
+        assert!(!text.contains("purple_matrix_render_seconds_bucket{le=\"0.0001\"} 1"));
+        assert_eq!(escape_label("a\"b\\c"), "a\\\"b\\\\c");
+    }
+
+    #[test]
+    fn test_summary_quantiles() {
+        let h = Histogram::new();
+        assert_eq!(h.summary(), Summary::default());
+        for v in 1..=100 {
+            h.record_us(v * 10);
+        }
+        let s = h.summary();
+        assert_eq!(s.count, 100);
+        assert_eq!(s.max_us, 1_000);
+        assert!((450..=560).contains(&s.p50_us), "p50 {}", s.p50_us);
+        assert!((890..=1_000).contains(&s.p99_us), "p99 {}", s.p99_us);
+    }
+}
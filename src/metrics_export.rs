@@ -0,0 +1,146 @@
+// Opt-in OpenMetrics endpoint for the metrics registry.
+//
+// Serves `GET /metrics` on 127.0.0.1:<port>, or on a Unix socket when the
+// configured value is a path. One exporter per process; reconfiguring with a
+// different address replaces it and an empty value stops it.
+
+use std::sync::{Arc, Mutex};
+use once_cell::sync::Lazy;
+
+const CONTENT_TYPE: &str = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+static EXPORTER: Lazy<Mutex<Option<(String, Arc<tiny_http::Server>)>>> = Lazy::new(|| Mutex::new(None));
+
+enum Listen {
+    Port(u16),
+    #[cfg(unix)]
+    Socket(std::path::PathBuf),
+}
+
+fn parse_listen(value: &str) -> Option<Listen> {
+    let value = value.trim();
+    if value.is_empty() {
+        return None;
+    }
+    #[cfg(unix)]
+    if value.starts_with('/') {
+        return Some(Listen::Socket(value.into()));
+    }
+    match value.parse::<u16>() {
+        Ok(0) | Err(_) => None,
+        Ok(port) => Some(Listen::Port(port)),
+    }
+}
+
+fn bind(listen: &Listen) -> Result<tiny_http::Server, Box<dyn std::error::Error + Send + Sync + 'static>> {
+    match listen {
+        // Loopback only: the numbers say a lot about what the user is doing.
+        Listen::Port(port) => tiny_http::Server::http(("127.0.0.1", *port)),
+        #[cfg(unix)]
+        Listen::Socket(path) => {
+            clear_stale_socket(path)?;
+            tiny_http::Server::http_unix(path)
+        }
+    }
+}
+
+// A socket left by an earlier run is replaced; anything else at the path is
+// someone's file, so binding is refused rather than deleting it.
+#[cfg(unix)]
+fn clear_stale_socket(path: &std::path::Path) -> std::io::Result<()> {
+    use std::os::unix::fs::FileTypeExt;
+    match std::fs::symlink_metadata(path) {
+        Ok(meta) if meta.file_type().is_socket() => std::fs::remove_file(path),
+        Ok(_) => Err(std::io::Error::new(
+            std::io::ErrorKind::AlreadyExists,
+            "path exists and is not a socket",
+        )),
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound => Ok(()),
+        Err(e) => Err(e),
+    }
+}
+
+fn serve(server: Arc<tiny_http::Server>) {
+    for request in server.incoming_requests() {
+        let response = if request.url() == "/metrics" {
+            let header = tiny_http::Header::from_bytes("Content-Type", CONTENT_TYPE)
+                .expect("static header is valid");
+            tiny_http::Response::from_string(crate::metrics::openmetrics()).with_header(header)
+        } else {
+            tiny_http::Response::from_string("not found").with_status_code(404)
+        };
+        if let Err(e) = request.respond(response) {
+            log::debug!("Metrics scrape response failed: {}", e);
+        }
+    }
+}
+
+// Starts, moves or stops the exporter. `listen` is a port number, an
+// absolute socket path, or empty/"0" for off.
+pub fn configure(listen: &str) {
+    let mut guard = EXPORTER.lock().unwrap_or_else(|e| e.into_inner());
+    if guard.as_ref().map(|(addr, _)| addr.as_str()) == Some(listen.trim()) {
+        return;
+    }
+    if let Some((addr, server)) = guard.take() {
+        log::info!("Stopping metrics exporter on {}", addr);
+        server.unblock();
+    }
+
+    let Some(target) = parse_listen(listen) else { return; };
+    let server = match bind(&target) {
+        Ok(s) => Arc::new(s),
+        Err(e) => {
+            log::warn!("Failed to start metrics exporter on {}: {}", listen, e);
+            return;
+        }
+    };
+    let worker = server.clone();
+    if let Err(e) = std::thread::Builder::new()
+        .name("metrics-export".to_string())
+        .spawn(move || serve(worker))
+    {
+        log::warn!("Failed to start metrics exporter thread: {}", e);
+        return;
+    }
+    log::info!("Serving OpenMetrics on {}", listen.trim());
+    *guard = Some((listen.trim().to_string(), server));
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_listen() {
+        assert!(parse_listen("").is_none());
+        assert!(parse_listen("0").is_none());
+        assert!(parse_listen("nope").is_none());
+        assert!(matches!(parse_listen(" 9464 "), Some(Listen::Port(9464))));
+        #[cfg(unix)]
+        assert!(matches!(parse_listen("/run/finch/metrics.sock"), Some(Listen::Socket(_))));
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_only_stale_sockets_are_replaced() {
+        let dir = std::env::temp_dir().join(format!("pmr_metrics_{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        std::fs::create_dir_all(&dir).unwrap();
+
+        let missing = dir.join("missing.sock");
+        assert!(clear_stale_socket(&missing).is_ok());
+
+        let file = dir.join("notes.txt");
+        std::fs::write(&file, "keep me").unwrap();
+        assert!(clear_stale_socket(&file).is_err());
+        assert_eq!(std::fs::read_to_string(&file).unwrap(), "keep me");
+
+        let socket = dir.join("metrics.sock");
+        drop(std::os::unix::net::UnixListener::bind(&socket).unwrap());
+        assert!(clear_stale_socket(&socket).is_ok());
+        assert!(!socket.exists());
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
@@ -0,0 +1,135 @@
+// Coalescing read-receipt worker.
+//
+// Callers (opening a conversation, typing, sending) only record which event
+// they would like marked as read. At most one receipt per room is sent per
+// `RECEIPT_INTERVAL`, always for the newest request, and only if it moves the
+// marker forward. Nothing on the send path awaits it.
+
+use std::collections::VecDeque;
+use std::time::{Duration, Instant};
+use dashmap::DashMap;
+use matrix_sdk::ruma::OwnedEventId;
+use matrix_sdk::Room;
+use once_cell::sync::Lazy;
+use crate::RUNTIME;
+
+const RECEIPT_INTERVAL: Duration = Duration::from_millis(1500);
+// How many recent (event_id, ts) pairs are remembered per room for ordering.
+const RECENT_EVENTS_PER_ROOM: usize = 32;
+
+enum Target {
+    // Whatever `room.latest_event()` is at flush time.
+    Latest,
+    Event(OwnedEventId),
+}
+
+#[derive(Default)]
+struct RoomReceipts {
+    pending: Option<Target>,
+    scheduled: bool,
+    last_flush: Option<Instant>,
+    last_sent: Option<(OwnedEventId, Option<u64>)>,
+    recent: VecDeque<(OwnedEventId, u64)>,
+}
+
+impl RoomReceipts {
+    fn ts_of(&self, event_id: &OwnedEventId) -> Option<u64> {
+        self.recent.iter().rev().find(|(id, _)| id == event_id).map(|(_, ts)| *ts)
+    }
+}
+
+// (account user_id, room_id) -> receipt state
+static RECEIPTS: Lazy<DashMap<(String, String), RoomReceipts>> = Lazy::new(DashMap::new);
+
+fn room_key(room: &Room) -> (String, String) {
+    let user_id = room.client().user_id().map(|u| u.to_string()).unwrap_or_default();
+    (user_id, room.room_id().to_string())
+}
+
+// Records the origin timestamp of an event seen in `room`, so later receipts
+// can be ordered against it.
+pub fn observe(room: &Room, event_id: &str, ts: u64) {
+    let Ok(eid) = OwnedEventId::try_from(event_id) else { return; };
+    let mut state = RECEIPTS.entry(room_key(room)).or_default();
+    if state.recent.len() >= RECENT_EVENTS_PER_ROOM {
+        state.recent.pop_front();
+    }
+    state.recent.push_back((eid, ts));
+}
+
+// Requests a read receipt for the room's latest event.
+pub fn mark_latest(room: &Room) {
+    enqueue(room, Target::Latest);
+}
+
+// Requests a read receipt for a specific event.
+pub fn mark_event(room: &Room, event_id: OwnedEventId) {
+    enqueue(room, Target::Event(event_id));
+}
+
+fn enqueue(room: &Room, target: Target) {
+    let key = room_key(room);
+    let delay = {
+        let mut state = RECEIPTS.entry(key.clone()).or_default();
+        state.pending = Some(target);
+        if state.scheduled {
+            return;
+        }
+        state.scheduled = true;
+        state.last_flush
+            .map(|t| RECEIPT_INTERVAL.saturating_sub(t.elapsed()))
+            .unwrap_or(Duration::ZERO)
+    };
+
+    let room = room.clone();
+    RUNTIME.spawn(async move {
+        if !delay.is_zero() {
+            tokio::time::sleep(delay).await;
+        }
+        flush(room, key).await;
+    });
+}
+
+async fn flush(room: Room, key: (String, String)) {
+    use matrix_sdk::ruma::events::receipt::ReceiptThread;
+    use matrix_sdk::ruma::api::client::receipt::create_receipt::v3::ReceiptType;
+
+    let (target, last_sent) = {
+        let Some(mut state) = RECEIPTS.get_mut(&key) else { return; };
+        state.scheduled = false;
+        state.last_flush = Some(Instant::now());
+        (state.pending.take(), state.last_sent.clone())
+    };
+
+    let event_id = match target {
+        Some(Target::Event(eid)) => eid,
+        Some(Target::Latest) => match room.latest_event().and_then(|ev| ev.event_id().map(|e| e.to_owned())) {
+            Some(eid) => eid,
+            None => return,
+        },
+        None => return,
+    };
+
+    let ts = RECEIPTS.get(&key).and_then(|s| s.ts_of(&event_id));
+    if let Some((last_id, last_ts)) = &last_sent {
+        if *last_id == event_id {
+            return;
+        }
+        if let (Some(ts), Some(last_ts)) = (ts, last_ts) {
+            if ts <= *last_ts {
+                log::debug!("Dropping stale read receipt for {} in {}", event_id, key.1);
+                return;
+            }
+        }
+    }
+
+    log::debug!("Sending read receipt for event {} in room {}", event_id, key.1);
+    match room.send_single_receipt(ReceiptType::Read, ReceiptThread::Unthreaded, event_id.clone()).await {
+        Ok(()) => {
+            if let Some(mut state) = RECEIPTS.get_mut(&key) {
+                state.last_sent = Some((event_id, ts));
+            }
+        }
+        Err(e) => log::warn!("Failed to send read receipt: {:?}", e),
+    }
+}
@@ -0,0 +1,313 @@
+// On-device full-text index over rendered messages.
+//
+// Every message that passes through `render_room_message` (live sync, sync
+// backfill and history fetches, after decryption) is queued here and written
+// in batches by a dedicated thread into an SQLite FTS5 table next to the SDK
+// store. Searching it works for encrypted rooms, which the server-side
+// `/search` endpoint cannot do. Edits replace the indexed text of the event
+// they target and redactions remove it.
+
+use std::path::PathBuf;
+use std::sync::Mutex;
+use crossbeam_channel::{unbounded, Receiver, Sender};
+use once_cell::sync::Lazy;
+use rusqlite::{params, Connection};
+
+const INDEX_FILE: &str = "search_index.sqlite3";
+const WRITE_BATCH: usize = 256;
+pub const MAX_RESULTS: usize = 50;
+
+const SCHEMA: &str = "
+    PRAGMA journal_mode = WAL;
+    PRAGMA synchronous = NORMAL;
+    CREATE TABLE IF NOT EXISTS message_meta (
+        id INTEGER PRIMARY KEY,
+        account TEXT NOT NULL,
+        room_id TEXT NOT NULL,
+        event_id TEXT NOT NULL,
+        sender TEXT NOT NULL,
+        ts INTEGER NOT NULL,
+        UNIQUE(account, event_id)
+    );
+    CREATE INDEX IF NOT EXISTS message_meta_room ON message_meta(account, room_id);
+    CREATE VIRTUAL TABLE IF NOT EXISTS message_fts USING fts5(
+        body,
+        tokenize = 'unicode61 remove_diacritics 2'
+    );
+";
+
+struct IndexedMessage {
+    account: String,
+    room_id: String,
+    event_id: String,
+    sender: String,
+    ts: u64,
+    body: String,
+}
+
+enum Op {
+    // Ignored if the event is already indexed (backfill, history re-reads).
+    Add(IndexedMessage),
+    // An edit: `event_id` is the edited event, whose row is replaced.
+    Replace(IndexedMessage),
+    Remove { account: String, event_id: String },
+}
+
+pub struct SearchHit {
+    pub sender: String,
+    pub body: String,
+    pub ts: u64,
+}
+
+static WRITER: Lazy<Sender<Op>> = Lazy::new(|| {
+    let (tx, rx) = unbounded();
+    if let Err(e) = std::thread::Builder::new()
+        .name("search-index".to_string())
+        .spawn(move || run_writer(rx))
+    {
+        log::error!("Failed to start search index writer: {}", e);
+    }
+    tx
+});
+
+static READER: Lazy<Mutex<Option<Connection>>> = Lazy::new(|| Mutex::new(None));
+
+fn index_path() -> Option<PathBuf> {
+    let mut path = crate::DATA_PATH.lock().unwrap_or_else(|e| e.into_inner()).clone()?;
+    path.push(INDEX_FILE);
+    Some(path)
+}
+
+fn open_index() -> Option<Connection> {
+    let path = index_path()?;
+    match Connection::open(&path).and_then(|c| c.execute_batch(SCHEMA).map(|_| c)) {
+        Ok(conn) => Some(conn),
+        Err(e) => {
+            log::warn!("Failed to open search index {:?}: {}", path, e);
+            None
+        }
+    }
+}
+
+fn indexed(room: &matrix_sdk::Room, event_id: &str, sender: &str, ts: u64, body: &str) -> Option<IndexedMessage> {
+    if body.trim().is_empty() {
+        return None;
+    }
+    Some(IndexedMessage {
+        account: room.client().user_id()?.to_string(),
+        room_id: room.room_id().to_string(),
+        event_id: event_id.to_string(),
+        sender: sender.to_string(),
+        ts,
+        body: body.to_string(),
+    })
+}
+
+// Queues one message for indexing. Cheap; never blocks on SQLite.
+pub fn index_message(room: &matrix_sdk::Room, event_id: &str, sender: &str, ts: u64, body: &str) {
+    if let Some(m) = indexed(room, event_id, sender, ts, body) {
+        let _ = WRITER.send(Op::Add(m));
+    }
+}
+
+// Queues the new text of an edit of `target_event_id`.
+pub fn index_edit(room: &matrix_sdk::Room, target_event_id: &str, sender: &str, ts: u64, body: &str) {
+    if let Some(m) = indexed(room, target_event_id, sender, ts, body) {
+        let _ = WRITER.send(Op::Replace(m));
+    }
+}
+
+// Drops a redacted event from the index.
+pub fn remove(room: &matrix_sdk::Room, event_id: &str) {
+    let Some(account) = room.client().user_id().map(|u| u.to_string()) else { return; };
+    let _ = WRITER.send(Op::Remove { account, event_id: event_id.to_string() });
+}
+
+fn run_writer(rx: Receiver<Op>) {
+    let mut conn: Option<Connection> = None;
+    while let Ok(first) = rx.recv() {
+        let mut batch = vec![first];
+        while batch.len() < WRITE_BATCH {
+            match rx.try_recv() {
+                Ok(m) => batch.push(m),
+                Err(_) => break,
+            }
+        }
+        if conn.is_none() {
+            conn = open_index();
+        }
+        let Some(c) = conn.as_mut() else { continue; };
+        if let Err(e) = write_batch(c, &batch) {
+            log::warn!("Failed to index {} messages: {}", batch.len(), e);
+            conn = None;
+        }
+    }
+}
+
+fn write_batch(conn: &mut Connection, batch: &[Op]) -> rusqlite::Result<()> {
+    let tx = conn.transaction()?;
+    {
+        let mut meta = tx.prepare_cached(
+            "INSERT OR IGNORE INTO message_meta (account, room_id, event_id, sender, ts)
+             VALUES (?1, ?2, ?3, ?4, ?5)",
+        )?;
+        let mut fts = tx.prepare_cached("INSERT INTO message_fts (rowid, body) VALUES (?1, ?2)")?;
+        let mut drop_fts = tx.prepare_cached(
+            "DELETE FROM message_fts WHERE rowid IN
+             (SELECT id FROM message_meta WHERE account = ?1 AND event_id = ?2)",
+        )?;
+        let mut drop_meta = tx.prepare_cached("DELETE FROM message_meta WHERE account = ?1 AND event_id = ?2")?;
+        for op in batch {
+            let m = match op {
+                Op::Add(m) => m,
+                Op::Replace(m) => {
+                    drop_fts.execute(params![m.account, m.event_id])?;
+                    drop_meta.execute(params![m.account, m.event_id])?;
+                    m
+                }
+                Op::Remove { account, event_id } => {
+                    drop_fts.execute(params![account, event_id])?;
+                    drop_meta.execute(params![account, event_id])?;
+                    continue;
+                }
+            };
+            if meta.execute(params![m.account, m.room_id, m.event_id, m.sender, m.ts as i64])? == 1 {
+                fts.execute(params![tx.last_insert_rowid(), m.body])?;
+            }
+        }
+    }
+    tx.commit()
+}
+
+// Turns free text into an FTS5 query: every word must match, the last one as
+// a prefix, and nothing the user types is interpreted as FTS syntax.
+fn fts_query(term: &str) -> Option<String> {
+    let words: Vec<String> = term
+        .split_whitespace()
+        .map(|w| format!("\"{}\"", w.replace('"', "\"\"")))
+        .collect();
+    if words.is_empty() {
+        return None;
+    }
+    Some(format!("{}*", words.join(" ")))
+}
+
+fn query(conn: &Connection, account: &str, room_id: &str, term: &str) -> rusqlite::Result<Vec<SearchHit>> {
+    let Some(q) = fts_query(term) else { return Ok(Vec::new()); };
+    let mut stmt = conn.prepare_cached(
+        "SELECT m.sender, message_fts.body, m.ts
+         FROM message_fts JOIN message_meta m ON m.id = message_fts.rowid
+         WHERE message_fts MATCH ?1 AND m.account = ?2 AND m.room_id = ?3
+         ORDER BY bm25(message_fts), m.ts DESC
+         LIMIT ?4",
+    )?;
+    let rows = stmt.query_map(params![q, account, room_id, MAX_RESULTS as i64], |row| {
+        Ok(SearchHit {
+            sender: row.get(0)?,
+            body: row.get(1)?,
+            ts: row.get::<_, i64>(2)? as u64,
+        })
+    })?;
+    let hits: rusqlite::Result<Vec<SearchHit>> = rows.collect();
+    hits
+}
+
+// Ranked local search within one room. Blocking: call from `spawn_blocking`.
+pub fn search(account: &str, room_id: &str, term: &str) -> Vec<SearchHit> {
+    let mut guard = READER.lock().unwrap_or_else(|e| e.into_inner());
+    if guard.is_none() {
+        *guard = open_index();
+    }
+    let Some(conn) = guard.as_ref() else { return Vec::new(); };
+    match query(conn, account, room_id, term) {
+        Ok(hits) => hits,
+        Err(e) => {
+            log::warn!("Local search failed: {}", e);
+            Vec::new()
+        }
+    }
+}
+
+// "YYYY-MM-DD HH:MM UTC" for a millisecond epoch timestamp.
+pub fn format_timestamp(ms: u64) -> String {
+    let secs = ms / 1000;
+    let days = (secs / 86_400) as i64;
+    let (hour, minute) = ((secs % 86_400) / 3600, (secs % 3600) / 60);
+    // Civil-from-days (Howard Hinnant).
+    let z = days + 719_468;
+    let era = z.div_euclid(146_097);
+    let doe = z - era * 146_097;
+    let yoe = (doe - doe / 1460 + doe / 36_524 - doe / 146_096) / 365;
+    let doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    let mp = (5 * doy + 2) / 153;
+    let day = doy - (153 * mp + 2) / 5 + 1;
+    let month = if mp < 10 { mp + 3 } else { mp - 9 };
+    let year = yoe + era * 400 + if month <= 2 { 1 } else { 0 };
+    format!("{:04}-{:02}-{:02} {:02}:{:02} UTC", year, month, day, hour, minute)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn msg(event_id: &str, ts: u64, body: &str) -> IndexedMessage {
+        IndexedMessage {
+            account: "@me:example.org".to_string(),
+            room_id: "!room:example.org".to_string(),
+            event_id: event_id.to_string(),
+            sender: "@alice:example.org".to_string(),
+            ts,
+            body: body.to_string(),
+        }
+    }
+
+    #[test]
+    fn test_fts_query_quotes_user_input() {
+        assert_eq!(fts_query("  "), None);
+        assert_eq!(fts_query("hello wor").as_deref(), Some("\"hello\" \"wor\"*"));
+        assert_eq!(fts_query("a\"b OR").as_deref(), Some("\"a\"\"b\" \"OR\"*"));
+    }
+
+    #[test]
+    fn test_format_timestamp() {
+        assert_eq!(format_timestamp(0), "1970-01-01 00:00 UTC");
+        assert_eq!(format_timestamp(1_709_210_096_000), "2024-02-29 12:34 UTC");
+    }
+
+    #[test]
+    fn test_index_and_search() {
+        let mut conn = Connection::open_in_memory().unwrap();
+        conn.execute_batch(SCHEMA).unwrap();
+        write_batch(&mut conn, &[
+            Op::Add(msg("$1", 1, "the deploy is finished")),
+            Op::Add(msg("$2", 2, "lunch anyone?")),
+            Op::Add(msg("$1", 3, "duplicate event id is ignored")),
+        ]).unwrap();
+
+        let hits = query(&conn, "@me:example.org", "!room:example.org", "depl").unwrap();
+        assert_eq!(hits.len(), 1);
+        assert_eq!(hits[0].body, "the deploy is finished");
+        assert!(query(&conn, "@me:example.org", "!room:example.org", "duplicate").unwrap().is_empty());
+        assert!(query(&conn, "@other:example.org", "!room:example.org", "lunch").unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_edits_replace_and_redactions_remove() {
+        let mut conn = Connection::open_in_memory().unwrap();
+        conn.execute_batch(SCHEMA).unwrap();
+        write_batch(&mut conn, &[
+            Op::Add(msg("$1", 1, "meet at noon")),
+            Op::Add(msg("$2", 2, "secret password")),
+            Op::Replace(msg("$1", 3, "meet at three")),
+            Op::Remove { account: "@me:example.org".to_string(), event_id: "$2".to_string() },
+        ]).unwrap();
+
+        let hits = query(&conn, "@me:example.org", "!room:example.org", "meet").unwrap();
+        assert_eq!(hits.len(), 1);
+        assert_eq!(hits[0].body, "meet at three");
+        assert!(query(&conn, "@me:example.org", "!room:example.org", "noon").unwrap().is_empty());
+        assert!(query(&conn, "@me:example.org", "!room:example.org", "secret").unwrap().is_empty());
+        let rows: i64 = conn.query_row("SELECT count(*) FROM message_meta", [], |r| r.get(0)).unwrap();
+        assert_eq!(rows, 1);
+    }
+}
@@ -0,0 +1,172 @@
+// Per-room outbound message queue.
+//
+// Every room gets one worker task that sends its messages strictly in the
+// order they were queued. A failed send is retried with exponential backoff
+// using the same transaction id, so the homeserver deduplicates a request
+// that did go through before the connection dropped. Only failures that can
+// clear up are retried: no response at all, a timeout, a 5xx, or a rate
+// limit, which waits for the server's retry_after (capped) instead. The
+// worker exits after sitting idle for a while and is recreated on the next
+// message.
+
+use std::time::{Duration, SystemTime};
+use dashmap::DashMap;
+use matrix_sdk::ruma::api::client::error::{ErrorKind, RetryAfter};
+use matrix_sdk::ruma::events::room::message::RoomMessageEventContent;
+use matrix_sdk::ruma::{OwnedTransactionId, TransactionId};
+use matrix_sdk::Room;
+use once_cell::sync::Lazy;
+use tokio::sync::mpsc::{unbounded_channel, UnboundedReceiver, UnboundedSender};
+use crate::RUNTIME;
+
+const MAX_SEND_ATTEMPTS: u32 = 6;
+const INITIAL_BACKOFF: Duration = Duration::from_secs(1);
+const MAX_BACKOFF: Duration = Duration::from_secs(30);
+const QUEUE_IDLE_TIMEOUT: Duration = Duration::from_secs(60);
+
+struct Outgoing {
+    room: Room,
+    content: RoomMessageEventContent,
+    txn_id: OwnedTransactionId,
+}
+
+// (account user_id, room_id) -> sender feeding that room's worker
+static QUEUES: Lazy<DashMap<(String, String), UnboundedSender<Outgoing>>> = Lazy::new(DashMap::new);
+
+// Queues `content` for `room`. `txn_id` is the id the local echo was tagged
+// with; a fresh one is generated when the caller did not echo anything.
+pub fn enqueue(room: &Room, content: RoomMessageEventContent, txn_id: Option<String>) {
+    let user_id = room.client().user_id().map(|u| u.to_string()).unwrap_or_default();
+    let key = (user_id, room.room_id().to_string());
+    let txn_id = match txn_id {
+        Some(t) if !t.is_empty() => OwnedTransactionId::from(t),
+        _ => TransactionId::new(),
+    };
+    crate::typing_notices::message_sent(room);
+    let mut item = Outgoing { room: room.clone(), content, txn_id };
+
+    // The entry lock is held while sending so a worker cannot retire between
+    // us looking up its sender and the message landing in its channel.
+    let mut entry = QUEUES.entry(key.clone()).or_insert_with(|| spawn_worker(key.clone()));
+    if let Err(e) = entry.send(item) {
+        // The worker is gone (runtime shutdown); start a new one.
+        item = e.0;
+        *entry = spawn_worker(key);
+        let _ = entry.send(item);
+    }
+}
+
+fn spawn_worker(key: (String, String)) -> UnboundedSender<Outgoing> {
+    let (tx, rx) = unbounded_channel();
+    RUNTIME.spawn(run_worker(key, rx));
+    tx
+}
+
+async fn run_worker(key: (String, String), mut rx: UnboundedReceiver<Outgoing>) {
+    loop {
+        match tokio::time::timeout(QUEUE_IDLE_TIMEOUT, rx.recv()).await {
+            Ok(Some(item)) => transmit(&key, item).await,
+            Ok(None) => break,
+            Err(_) => {
+                // Only retire if nothing slipped in; enqueue() sends under the
+                // same shard lock, so the check cannot race with it.
+                if QUEUES.remove_if(&key, |_, _| rx.is_empty()).is_some() {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+enum Retry {
+    GiveUp,
+    // Retry, waiting this long instead of the backoff when the server said so.
+    After(Option<Duration>),
+}
+
+// `status` is the HTTP status when the server answered; `transport` is set
+// when the request never got an answer.
+fn classify(kind: Option<&ErrorKind>, status: Option<u16>, transport: bool) -> Retry {
+    if let Some(ErrorKind::LimitExceeded { retry_after }) = kind {
+        return Retry::After(match retry_after {
+            Some(RetryAfter::Delay(d)) => Some(*d),
+            Some(RetryAfter::DateTime(at)) => Some(at.duration_since(SystemTime::now()).unwrap_or_default()),
+            None => None,
+        });
+    }
+    match status {
+        Some(408) | Some(500..=599) => Retry::After(None),
+        // Any other answer (M_FORBIDDEN, M_UNKNOWN with a 400, M_NOT_FOUND,
+        // ...) will be the same next time.
+        Some(_) => Retry::GiveUp,
+        None if transport => Retry::After(None),
+        // Failed before reaching the server (encryption, serialization).
+        None => Retry::GiveUp,
+    }
+}
+
+fn is_transport_error(err: &matrix_sdk::Error) -> bool {
+    match err {
+        matrix_sdk::Error::Http(e) => {
+            let e: &matrix_sdk::HttpError = e;
+            matches!(e, matrix_sdk::HttpError::Reqwest(_))
+        }
+        _ => false,
+    }
+}
+
+async fn transmit(key: &(String, String), item: Outgoing) {
+    let mut delay = INITIAL_BACKOFF;
+    for attempt in 1..=MAX_SEND_ATTEMPTS {
+        let result = item.room
+            .send(item.content.clone())
+            .with_transaction_id(item.txn_id.clone())
+            .await;
+        let err = match result {
+            Ok(_) => {
+                log::info!("Message {} sent to room {}", item.txn_id, key.1);
+                return;
+            }
+            Err(e) => e,
+        };
+
+        let status = err.as_client_api_error().map(|e| e.status_code.as_u16());
+        let wait = match classify(err.client_api_error_kind(), status, is_transport_error(&err)) {
+            // A long retry_after would hold up the whole room; the attempt
+            // limit still bounds a server that keeps refusing.
+            Retry::After(wait) if attempt < MAX_SEND_ATTEMPTS => wait.unwrap_or(delay).min(MAX_BACKOFF),
+            _ => {
+                log::error!("Giving up on message {} to room {} after {} attempt(s): {:?}", item.txn_id, key.1, attempt, err);
+                crate::ffi::send_system_message_to_room(&key.0, &key.1, &format!("Failed to send message: {}", err));
+                return;
+            }
+        };
+
+        log::warn!("Send of {} to room {} failed (attempt {}), retrying in {:?}: {:?}", item.txn_id, key.1, attempt, wait, err);
+        tokio::time::sleep(wait).await;
+        delay = (delay * 2).min(MAX_BACKOFF);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_permanent_errors_are_not_retried() {
+        assert!(matches!(classify(Some(&ErrorKind::TooLarge), Some(413), false), Retry::GiveUp));
+        assert!(matches!(classify(Some(&ErrorKind::NotJson), Some(400), false), Retry::GiveUp));
+        assert!(matches!(classify(Some(&ErrorKind::Unknown), Some(400), false), Retry::GiveUp));
+        assert!(matches!(classify(Some(&ErrorKind::NotFound), Some(404), false), Retry::GiveUp));
+        // Server trouble is worth another go, whatever the body says.
+        assert!(matches!(classify(Some(&ErrorKind::Unknown), Some(502), false), Retry::After(None)));
+        assert!(matches!(classify(None, Some(504), false), Retry::After(None)));
+        // Transport errors carry neither kind nor status.
+        assert!(matches!(classify(None, None, true), Retry::After(None)));
+        assert!(matches!(classify(None, None, false), Retry::GiveUp));
+        let limited = ErrorKind::LimitExceeded { retry_after: Some(RetryAfter::Delay(Duration::from_millis(2500))) };
+        assert!(matches!(classify(Some(&limited), Some(429), false), Retry::After(Some(d)) if d == Duration::from_millis(2500)));
+        let limited = ErrorKind::LimitExceeded { retry_after: None };
+        assert!(matches!(classify(Some(&limited), Some(429), false), Retry::After(None)));
+    }
+}
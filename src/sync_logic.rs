@@ -5,6 +5,11 @@ use matrix_sdk::{
 };
 
 use crate::handlers::{messages, presence, typing, reactions, room_state, account_data, polls, receipts};
+use std::collections::HashSet;
+
+// Page size used to close the gap between the local event store and the live
+// timeline when a conversation opens with stored history.
+const GAP_FILL_LIMIT: u16 = 50;
 
 fn is_auth_failure(error_str: &str) -> bool {
     error_str.contains("M_UNKNOWN_TOKEN")
@@ -29,7 +34,7 @@ fn handle_auth_failure(client: &Client) {
 
     let msg = "Matrix session expired. Please re-login.";
     let event = crate::ffi::FfiEvent::LoginFailed {
-        user_id: user_id.unwrap_or_default(),
+        user_id: crate::intern::id(user_id.unwrap_or_default()),
         message: msg.to_string(),
     };
     let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -55,7 +60,7 @@ pub async fn start_sync_loop(client: Client) {
                 handle_auth_failure(&client_for_sync); 
             } else {
                 let event = crate::ffi::FfiEvent::LoginFailed {
-                    user_id: user_id.clone(),
+                    user_id: crate::intern::id(&user_id),
                     message: format!("Initial sync error: {}", error_str),
                 };
                 let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -78,8 +83,8 @@ pub async fn start_sync_loop(client: Client) {
         let member_count = room.joined_members_count();
         
         let event = crate::ffi::FfiEvent::RoomJoined {
-            user_id: user_id.clone(),
-            room_id: room_id.clone(),
+            user_id: crate::intern::id(&user_id),
+            room_id: crate::intern::id(&room_id),
             name: name.clone(),
             group_name: group.clone(),
             avatar_url: None,
@@ -105,8 +110,8 @@ pub async fn start_sync_loop(client: Client) {
                     if let Some(url) = room.avatar_url() {
                         if let Some(path) = crate::media_helper::download_avatar(&client_clone, &url, &room_id_clone).await {
                              let event = crate::ffi::FfiEvent::RoomJoined {
-                                 user_id: user_id_clone.clone(),
-                                 room_id: room_id_clone.clone(),
+                                 user_id: crate::intern::id(&user_id_clone),
+                                 room_id: crate::intern::id(&room_id_clone),
                                  name: name_clone,
                                  group_name: group_clone,
                                  avatar_url: Some(path.to_string()),
@@ -126,8 +131,8 @@ pub async fn start_sync_loop(client: Client) {
                             let can_redact = my_level >= pl.redact;
                             let can_invite = my_level >= pl.invite;
                             let pl_event = crate::ffi::FfiEvent::PowerLevelUpdate {
-                                user_id: user_id_clone,
-                                room_id: room_id_clone,
+                                user_id: crate::intern::id(user_id_clone),
+                                room_id: crate::intern::id(room_id_clone),
                                 is_admin,
                                 can_kick,
                                 can_ban,
@@ -151,13 +156,23 @@ pub async fn start_sync_loop(client: Client) {
         for (room_id, joined_room) in response.rooms.joined {
             if let Some(room) = client_for_sync.get_room(&room_id) {
                 let full_id = room_id.to_string();
-                for event in joined_room.timeline.events {
-                    process_sync_event_for_history(&client_for_sync, &room, &full_id, event).await;
+                let events = joined_room.timeline.events;
+                let decrypted = crate::decryption::decrypt_page(&room, events.iter()).await;
+                let mut failed = Vec::new();
+                for (event, dec) in events.iter().zip(decrypted) {
+                    if dec.undecryptable {
+                        failed.push(event.clone());
+                    }
+                    process_sync_event_for_history(&client_for_sync, &room, &full_id, event, dec).await;
                 }
+                crate::decryption::retry_from_backup(room.clone(), full_id, failed);
             }
         }
     }
 
+    crate::dm_rooms::seed(&client_for_sync).await;
+    crate::decryption::watch_room_keys(client_for_sync.clone());
+
     // 3. START PERSISTENT SYNC LOOP
     client_for_sync.add_event_handler(messages::handle_room_message);
     client_for_sync.add_event_handler(messages::handle_encrypted);
@@ -175,47 +190,45 @@ pub async fn start_sync_loop(client: Client) {
     client_for_sync.add_event_handler(polls::handle_poll_start);
     client_for_sync.add_event_handler(receipts::handle_receipt);
 
-    client_for_sync.add_event_handler(|event: matrix_sdk::ruma::events::AnySyncTimelineEvent, room: Room| async move {
-        log::debug!("Sync event received in room {}: {:?}", room.room_id(), event.event_type());
-    });
+    // The catch-all handler deserializes every timeline event a second time,
+    // so it only exists when debug logging is on as sync starts.
+    if log::log_enabled!(log::Level::Debug) {
+        client_for_sync.add_event_handler(|event: matrix_sdk::ruma::events::AnySyncTimelineEvent, room: Room| async move {
+            log::debug!("Sync event received in room {}: {:?}", room.room_id(), event.event_type());
+        });
+    }
 
     client_for_sync.add_event_handler(|event: matrix_sdk::ruma::events::key::verification::request::ToDeviceKeyVerificationRequestEvent, client: Client| async move {
              crate::verification_logic::handle_verification_request(client, event).await;
     });
 
-    if let Err(e) = client_for_sync.sync(SyncSettings::default()).await {
+    let last_sync = std::sync::Arc::new(std::sync::Mutex::new(std::time::Instant::now()));
+    let sync_result = client_for_sync.sync_with_callback(SyncSettings::default(), move |_| {
+        let last_sync = last_sync.clone();
+        async move {
+            let mut last = last_sync.lock().unwrap_or_else(|e| e.into_inner());
+            crate::metrics::SYNC_ROUNDTRIP.record(last.elapsed());
+            crate::metrics::mark_sync();
+            *last = std::time::Instant::now();
+            matrix_sdk::LoopCtrl::Continue
+        }
+    }).await;
+    if let Err(e) = sync_result {
          let error_str = e.to_string();
          log::error!("Continuous sync loop crashed for {}: {}", user_id, error_str);
          if is_auth_failure(&error_str) { handle_auth_failure(&client_for_sync); }
     }
 }
 
-async fn process_sync_event_for_history(client: &Client, room: &matrix_sdk::Room, room_id: &str, timeline_event: matrix_sdk::deserialized_responses::TimelineEvent) {
+async fn process_sync_event_for_history(client: &Client, room: &matrix_sdk::Room, room_id: &str, timeline_event: &matrix_sdk::deserialized_responses::TimelineEvent, decrypted: crate::decryption::Decrypted) {
     use matrix_sdk::ruma::events::room::message::Relation;
     use matrix_sdk::ruma::events::AnySyncMessageLikeEvent;
     use matrix_sdk::ruma::events::AnySyncTimelineEvent;
 
     let user_id = client.user_id().map(|u| u.as_str().to_string()).unwrap_or_default();
     
-    let mut any_event_opt: Option<AnySyncTimelineEvent> = timeline_event.raw().deserialize().ok();
-    let mut is_encrypted = false;
-
-    if let Some(AnySyncTimelineEvent::MessageLike(matrix_sdk::ruma::events::AnySyncMessageLikeEvent::RoomEncrypted(_))) = &any_event_opt {
-        is_encrypted = true;
-        let event_id = timeline_event.event_id().map(|e| e.to_string()).unwrap_or_default();
-        let raw_json = timeline_event.raw().json().get().to_string();
-        if let Ok(raw_original) = matrix_sdk::ruma::serde::Raw::<matrix_sdk::ruma::events::room::encrypted::OriginalSyncRoomEncryptedEvent>::from_json_string(raw_json) {
-            match room.decrypt_event(&raw_original, None).await {
-                 Ok(decrypted) => {
-                      log::debug!("Successfully decrypted history event {}", event_id);
-                      any_event_opt = decrypted.raw().deserialize().ok();
-                 },
-                 Err(e) => {
-                      log::warn!("Failed to decrypt history event {}: {:?}", event_id, e);
-                 }
-            }
-        }
-    }
+    let any_event_opt: Option<AnySyncTimelineEvent> = decrypted.event;
+    let mut is_encrypted = decrypted.was_encrypted;
 
     if let Some(any_event) = any_event_opt {
         let sender = any_event.sender().to_string();
@@ -260,11 +273,20 @@ async fn process_sync_event_for_history(client: &Client, room: &matrix_sdk::Room
 
         if body.is_empty() { return; }
 
+        crate::event_store::append(&user_id, room_id, crate::event_store::StoredEvent {
+            event_id: event_id.clone(),
+            sender: sender.clone(),
+            body: body.clone(),
+            thread_root_id: cur_thread_id.clone(),
+            timestamp,
+            encrypted: is_encrypted,
+        });
+
         let event = crate::ffi::FfiEvent::MessageReceived {
-            user_id,
-            sender,
+            user_id: crate::intern::id(&user_id),
+            sender: crate::intern::id(&sender),
             msg: body,
-            room_id: Some(room_id.to_string()),
+            room_id: Some(crate::intern::id(&room_id)),
             thread_root_id: cur_thread_id,
             event_id,
             timestamp,
@@ -274,6 +296,66 @@ async fn process_sync_event_for_history(client: &Client, room: &matrix_sdk::Room
     }
 }
 
+// Sends stored events that belong in the conversation (the thread, or the
+// main timeline) to the UI. Returns how many were sent.
+fn paint_stored(user_id: &str, full_room_id: &str, thread_root_id: Option<&str>, events: Vec<crate::event_store::StoredEvent>) -> usize {
+    let mut shown = 0;
+    for ev in events {
+        let in_view = match thread_root_id {
+            Some(t) => ev.event_id == t || ev.thread_root_id.as_deref() == Some(t),
+            None => ev.thread_root_id.is_none(),
+        };
+        if !in_view { continue; }
+        let _ = crate::ffi::EVENTS_CHANNEL.0.send(crate::ffi::FfiEvent::MessageReceived {
+            user_id: crate::intern::id(user_id),
+            sender: crate::intern::id(ev.sender),
+            msg: ev.body,
+            room_id: Some(crate::intern::id(full_room_id)),
+            thread_root_id: ev.thread_root_id,
+            event_id: ev.event_id,
+            timestamp: ev.timestamp,
+            encrypted: ev.encrypted,
+        });
+        shown += 1;
+    }
+    shown
+}
+
+// Pages back through the stored span left unpainted when the conversation
+// opened. Returns false once the store is exhausted, with the server token
+// restored so the caller pages from the server instead.
+async fn page_from_store(user_id: &str, base_room_id: &str, full_room_id: &str, thread_root_id: Option<&str>, mut cursor: crate::history_state::StoreCursor) -> bool {
+    loop {
+        let (acct, rid, ts, id) = (user_id.to_string(), base_room_id.to_string(), cursor.timestamp, cursor.event_id.clone());
+        let page = tokio::task::spawn_blocking(move || {
+            crate::event_store::load_before(&acct, &rid, ts, &id, crate::event_store::PAINT_LIMIT)
+        }).await.unwrap_or_default();
+        let Some(oldest) = page.events.first().map(|e| (e.timestamp, e.event_id.clone())) else {
+            crate::history_state::clear_store_cursor(user_id, full_room_id);
+            if let Some(token) = cursor.stored_token {
+                crate::history_state::set_token(user_id, full_room_id, token);
+            }
+            return false;
+        };
+        let more = page.more;
+        (cursor.timestamp, cursor.event_id) = oldest;
+        let shown = paint_stored(user_id, full_room_id, thread_root_id, page.events);
+        log::info!("Painted {} more stored events for {}", shown, full_room_id);
+        if !more {
+            crate::history_state::clear_store_cursor(user_id, full_room_id);
+            if let Some(token) = cursor.stored_token {
+                crate::history_state::set_token(user_id, full_room_id, token);
+            }
+            return true;
+        }
+        // A thread may have nothing in this page of the room; keep going.
+        if shown > 0 {
+            crate::history_state::set_store_cursor(user_id, full_room_id, cursor);
+            return true;
+        }
+    }
+}
+
 pub async fn fetch_room_history_logic(client: Client, room_id: String) {
     let limit = 200; // Increased default limit for all rooms
     fetch_room_history_logic_with_limit(client, room_id, limit).await;
@@ -294,33 +376,51 @@ pub async fn fetch_room_history_logic_with_limit(client: Client, full_room_id: S
 
      if let Ok(ruma_room_id) = <&RoomId>::try_from(base_room_id.as_str()) {
          if let Some(room) = client.get_room(ruma_room_id) {
+             // First open this run: paint from the local store, then only ask
+             // the server for what arrived since.
+             let first_fetch = crate::history_state::mark_painted(&user_id, &full_room_id);
+             if !first_fetch {
+                 if let Some(cursor) = crate::history_state::store_cursor(&user_id, &full_room_id) {
+                     if page_from_store(&user_id, &base_room_id, &full_room_id, thread_root_id.as_deref(), cursor).await {
+                         return;
+                     }
+                 }
+             }
+             let mut gap = crate::history_state::gap(&user_id, &full_room_id);
+             let mut limit = limit;
+             if first_fetch {
+                 let (acct, rid) = (user_id.clone(), base_room_id.clone());
+                 let stored = tokio::task::spawn_blocking(move || {
+                     crate::event_store::load_tail(&acct, &rid, crate::event_store::PAINT_LIMIT)
+                 }).await.unwrap_or_default();
+                 if !stored.events.is_empty() {
+                     log::info!("Painting {} stored events for {}", stored.events.len(), full_room_id);
+                     let painted: HashSet<String> = stored.events.iter().map(|e| e.event_id.clone()).collect();
+                     let oldest_painted = stored.events.first()
+                         .filter(|_| stored.more)
+                         .map(|e| (e.timestamp, e.event_id.clone()));
+                     paint_stored(&user_id, &full_room_id, thread_root_id.as_deref(), stored.events);
+                     let stored_gap = crate::history_state::Gap { painted, stored_token: stored.token, oldest_painted };
+                     crate::history_state::open_gap(&user_id, &full_room_id, stored_gap.clone());
+                     gap = Some(stored_gap);
+                     limit = limit.min(GAP_FILL_LIMIT);
+                 }
+             }
+
              let mut options = matrix_sdk::room::MessagesOptions::backward();
              options.limit = limit.into();
-             if let Some(token) = crate::PAGINATION_TOKENS.get(&full_room_id) { options.from = Some(token.clone()); }
+             if let Some(token) = crate::history_state::token(&user_id, &full_room_id) { options.from = Some(token); }
              
              if let Ok(messages) = room.messages(options).await {
-                 if let Some(end) = &messages.end { crate::PAGINATION_TOKENS.insert(full_room_id.clone(), end.clone()); }
-
-                 for timeline_event in messages.chunk.iter().rev() {
-                     let mut any_event_opt: Option<AnySyncTimelineEvent> = timeline_event.raw().deserialize().ok();
-                     let mut is_encrypted = false;
-
-                     if let Some(AnySyncTimelineEvent::MessageLike(matrix_sdk::ruma::events::AnySyncMessageLikeEvent::RoomEncrypted(_))) = &any_event_opt {
-                         is_encrypted = true;
-                         let event_id = timeline_event.event_id().map(|e| e.to_string()).unwrap_or_default();
-                         let raw_json = timeline_event.raw().json().get().to_string();
-                         if let Ok(raw_original) = matrix_sdk::ruma::serde::Raw::<matrix_sdk::ruma::events::room::encrypted::OriginalSyncRoomEncryptedEvent>::from_json_string(raw_json) {
-                             match room.decrypt_event(&raw_original, None).await {
-                                  Ok(decrypted) => {
-                                       log::debug!("Successfully decrypted fetched history event {}", event_id);
-                                       any_event_opt = decrypted.raw().deserialize().ok();
-                                  },
-                                  Err(e) => {
-                                       log::warn!("Failed to decrypt fetched history event {}: {:?}", event_id, e);
-                                  }
-                             }
-                         }
-                     }
+                 if let Some(end) = &messages.end { crate::history_state::set_token(&user_id, &full_room_id, end.clone()); }
+                 let mut reached_store = false;
+
+                 let decrypted = crate::decryption::decrypt_page(&room, messages.chunk.iter().rev()).await;
+                 let mut failed = Vec::new();
+
+                 for (timeline_event, dec) in messages.chunk.iter().rev().zip(decrypted) {
+                     let any_event_opt = dec.event;
+                     let mut is_encrypted = dec.was_encrypted;
 
                      if let Some(event) = any_event_opt {
                          let event_id = event.event_id().to_string();
@@ -364,6 +464,19 @@ pub async fn fetch_room_history_logic_with_limit(client: Client, full_room_id: S
 
                          if body.is_empty() { continue; }
 
+                         if gap.as_ref().is_some_and(|g| g.painted.contains(&event_id)) {
+                             reached_store = true;
+                             continue;
+                         }
+                         crate::event_store::append(&user_id, &base_room_id, crate::event_store::StoredEvent {
+                             event_id: event_id.clone(),
+                             sender: sender.clone(),
+                             body: body.clone(),
+                             thread_root_id: cur_thread_id.clone(),
+                             timestamp,
+                             encrypted: is_encrypted,
+                         });
+
                          if let Some(target_thread) = &thread_root_id {
                              let is_root = event_id == *target_thread;
                              let is_in_thread = cur_thread_id.as_deref() == Some(target_thread);
@@ -372,11 +485,14 @@ pub async fn fetch_room_history_logic_with_limit(client: Client, full_room_id: S
                              if cur_thread_id.is_some() { continue; }
                          }
 
+                         if dec.undecryptable {
+                             failed.push(timeline_event.clone());
+                         }
                          let event = crate::ffi::FfiEvent::MessageReceived {
-                             user_id: user_id.clone(),
-                             sender,
+                             user_id: crate::intern::id(&user_id),
+                             sender: crate::intern::id(&sender),
                              msg: body,
-                             room_id: Some(full_room_id.clone()),
+                             room_id: Some(crate::intern::id(&full_room_id)),
                              thread_root_id: cur_thread_id,
                              event_id,
                              timestamp,
@@ -386,6 +502,41 @@ pub async fn fetch_room_history_logic_with_limit(client: Client, full_room_id: S
                          tokio::time::sleep(std::time::Duration::from_millis(2)).await;
                      }
                  }
+
+                 crate::decryption::retry_from_backup(room.clone(), full_room_id.clone(), failed);
+
+                 // The gap is closed: further back-pagination first pages
+                 // through whatever of the stored span was not painted, then
+                 // resumes where an earlier run left off rather than re-walking
+                 // the stored span. Until then the stored boundary is left
+                 // alone on disk; the token of a part-filled gap would lose it.
+                 match gap {
+                     Some(gap) if reached_store => {
+                         crate::history_state::close_gap(&user_id, &full_room_id);
+                         match gap.oldest_painted {
+                             Some((timestamp, event_id)) => {
+                                 crate::history_state::set_store_cursor(&user_id, &full_room_id, crate::history_state::StoreCursor {
+                                     timestamp,
+                                     event_id,
+                                     stored_token: gap.stored_token,
+                                 });
+                                 return;
+                             }
+                             None => {
+                                 if let Some(token) = gap.stored_token {
+                                     crate::history_state::set_token(&user_id, &full_room_id, token);
+                                 }
+                             }
+                         }
+                     }
+                     Some(_) => return,
+                     None => {}
+                 }
+                 if thread_root_id.is_none() {
+                     if let Some(token) = crate::history_state::token(&user_id, &full_room_id) {
+                         crate::event_store::save_token(&user_id, &base_room_id, &token);
+                     }
+                 }
              }
          }
      }
@@ -0,0 +1,249 @@
+// Per-room index of thread summaries.
+//
+// Kept current from the sync stream (every new m.thread reply bumps its root) and
+// from server refreshes, and persisted per account so the thread list opens
+// from disk instead of walking the whole /threads API each time.
+// `refreshed_ts` is the newest thread activity seen by the last server
+// refresh; the next refresh stops paging once it reaches older threads.
+
+use std::collections::{HashMap, HashSet};
+use std::path::PathBuf;
+use std::time::Duration;
+use crossbeam_channel::{unbounded, Receiver, Sender};
+use dashmap::DashMap;
+use once_cell::sync::Lazy;
+use serde::{Deserialize, Serialize};
+
+const SNIPPET_CHARS: usize = 100;
+// Reply ids remembered per thread so a re-delivered reply is not counted twice.
+const RECENT_REPLIES: usize = 8;
+// Writes for a room are coalesced over this window.
+const FLUSH_DELAY: Duration = Duration::from_secs(2);
+
+#[derive(Clone, Debug, Default, Serialize, Deserialize, PartialEq)]
+pub struct ThreadSummary {
+    pub root_id: String,
+    pub root_snippet: String,
+    pub latest_snippet: String,
+    pub reply_count: u64,
+    pub last_ts: u64,
+    #[serde(default, skip_serializing_if = "Vec::is_empty")]
+    pub recent_reply_ids: Vec<String>,
+}
+
+#[derive(Default, Serialize, Deserialize)]
+struct RoomThreads {
+    threads: HashMap<String, ThreadSummary>,
+    refreshed_ts: u64,
+}
+
+type Key = (String, String);
+
+static INDEX: Lazy<DashMap<Key, RoomThreads>> = Lazy::new(DashMap::new);
+
+static WRITER: Lazy<Sender<Key>> = Lazy::new(|| {
+    let (tx, rx) = unbounded();
+    if let Err(e) = std::thread::Builder::new()
+        .name("thread-index".to_string())
+        .spawn(move || run_writer(rx))
+    {
+        log::error!("Failed to start thread index writer: {}", e);
+    }
+    tx
+});
+
+fn index_file(account: &str, room_id: &str) -> Option<PathBuf> {
+    let mut path = crate::DATA_PATH.lock().unwrap_or_else(|e| e.into_inner()).clone()?;
+    path.push("threads");
+    path.push(crate::event_store::safe_name(account));
+    path.push(format!("{}.json", crate::event_store::safe_name(room_id)));
+    Some(path)
+}
+
+fn load(account: &str, room_id: &str) -> RoomThreads {
+    index_file(account, room_id)
+        .and_then(|p| std::fs::read(p).ok())
+        .and_then(|b| serde_json::from_slice(&b).ok())
+        .unwrap_or_default()
+}
+
+// Loads the room from disk the first time it is touched this run. The files
+// are small (one line per thread), so this stays inline.
+fn with_room<R>(account: &str, room_id: &str, f: impl FnOnce(&mut RoomThreads) -> R) -> R {
+    let key = (account.to_string(), room_id.to_string());
+    let mut entry = INDEX.entry(key).or_insert_with(|| load(account, room_id));
+    f(entry.value_mut())
+}
+
+fn mark_dirty(account: &str, room_id: &str) {
+    let _ = WRITER.send((account.to_string(), room_id.to_string()));
+}
+
+pub fn snippet(body: &str) -> String {
+    let line = body.lines().next().unwrap_or("").trim();
+    if line.chars().count() > SNIPPET_CHARS {
+        format!("{}...", line.chars().take(SNIPPET_CHARS - 3).collect::<String>())
+    } else {
+        line.to_string()
+    }
+}
+
+// A reply seen on the sync stream. Only replies newer than the thread's last
+// activity are counted: anything older was either counted already (sync or
+// backfill delivering it again) or is left to the next server refresh.
+pub fn record_reply(account: &str, room_id: &str, root_id: &str, event_id: &str, body: &str, ts: u64) {
+    let counted = with_room(account, room_id, |room| {
+        let t = room.threads.entry(root_id.to_string()).or_insert_with(|| ThreadSummary {
+            root_id: root_id.to_string(),
+            ..Default::default()
+        });
+        if ts < t.last_ts || t.recent_reply_ids.iter().any(|id| id == event_id) {
+            return false;
+        }
+        t.reply_count += 1;
+        t.last_ts = ts;
+        t.latest_snippet = snippet(body);
+        if t.recent_reply_ids.len() >= RECENT_REPLIES {
+            t.recent_reply_ids.remove(0);
+        }
+        t.recent_reply_ids.push(event_id.to_string());
+        true
+    });
+    if counted {
+        mark_dirty(account, room_id);
+    }
+}
+
+// A summary from the server, which is authoritative for everything but
+// activity newer than it knew about. Returns whether the listed summary
+// changed; a thread the sync stream already brought up to date has not.
+pub fn upsert(account: &str, room_id: &str, summary: ThreadSummary) -> bool {
+    let changed = with_room(account, room_id, |room| {
+        match room.threads.get_mut(&summary.root_id) {
+            Some(t) if t.last_ts > summary.last_ts => {
+                let reply_count = t.reply_count.max(summary.reply_count);
+                let changed = t.root_snippet != summary.root_snippet || t.reply_count != reply_count;
+                t.root_snippet = summary.root_snippet;
+                t.reply_count = reply_count;
+                changed
+            }
+            Some(t) => {
+                let recent = std::mem::take(&mut t.recent_reply_ids);
+                let changed = *t != summary;
+                *t = ThreadSummary { recent_reply_ids: recent, ..summary };
+                changed
+            }
+            None => {
+                room.threads.insert(summary.root_id.clone(), summary);
+                true
+            }
+        }
+    });
+    if changed {
+        mark_dirty(account, room_id);
+    }
+    changed
+}
+
+// Newest activity first, plus the refresh watermark.
+pub fn snapshot(account: &str, room_id: &str) -> (Vec<ThreadSummary>, u64) {
+    with_room(account, room_id, |room| {
+        let mut threads: Vec<ThreadSummary> = room.threads.values().cloned().collect();
+        threads.sort_by(|a, b| b.last_ts.cmp(&a.last_ts));
+        (threads, room.refreshed_ts)
+    })
+}
+
+pub fn set_refreshed(account: &str, room_id: &str, ts: u64) {
+    with_room(account, room_id, |room| room.refreshed_ts = room.refreshed_ts.max(ts));
+    mark_dirty(account, room_id);
+}
+
+// Drops the in-memory copy; the files stay for the next login.
+pub fn forget_account(account: &str) {
+    INDEX.retain(|(a, _), _| a != account);
+}
+
+fn run_writer(rx: Receiver<Key>) {
+    while let Ok(first) = rx.recv() {
+        std::thread::sleep(FLUSH_DELAY);
+        let mut dirty: HashSet<Key> = HashSet::new();
+        dirty.insert(first);
+        dirty.extend(rx.try_iter());
+        for (account, room_id) in dirty {
+            let json = match INDEX.get(&(account.clone(), room_id.clone())) {
+                Some(room) => serde_json::to_vec(room.value()),
+                None => continue,
+            };
+            let Some(path) = index_file(&account, &room_id) else { continue; };
+            let result = json.map_err(std::io::Error::from).and_then(|bytes| {
+                if let Some(dir) = path.parent() {
+                    std::fs::create_dir_all(dir)?;
+                }
+                // Write then rename so a crash never leaves a torn index.
+                let tmp = path.with_extension("json.tmp");
+                std::fs::write(&tmp, bytes)?;
+                std::fs::rename(&tmp, &path)
+            });
+            if let Err(e) = result {
+                log::warn!("Failed to save thread index for {}: {}", room_id, e);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_replies_and_server_summaries_merge() {
+        let (acct, room) = ("@me:example.org", "!threads:example.org");
+        record_reply(acct, room, "$root", "$r1", "first reply", 10);
+        record_reply(acct, room, "$root", "$r2", "second reply\nwith more lines", 20);
+        // Re-delivered by a later sync or backfill: not counted again.
+        record_reply(acct, room, "$root", "$r2", "second reply\nwith more lines", 20);
+        record_reply(acct, room, "$root", "$r1", "first reply", 10);
+        record_reply(acct, room, "$root", "$r0", "late history reply", 5);
+
+        let (threads, refreshed) = snapshot(acct, room);
+        assert_eq!(refreshed, 0);
+        assert_eq!(threads.len(), 1);
+        assert_eq!(threads[0].reply_count, 2);
+        assert_eq!(threads[0].latest_snippet, "second reply");
+
+        // Older server view keeps our newer activity but takes its root text.
+        let older = ThreadSummary {
+            root_id: "$root".to_string(),
+            root_snippet: "the root".to_string(),
+            latest_snippet: "first reply".to_string(),
+            reply_count: 1,
+            last_ts: 10,
+            ..Default::default()
+        };
+        assert!(upsert(acct, room, older.clone()));
+        assert!(!upsert(acct, room, older));
+        let other = ThreadSummary {
+            root_id: "$other".to_string(),
+            last_ts: 30,
+            ..Default::default()
+        };
+        assert!(upsert(acct, room, other.clone()));
+        assert!(!upsert(acct, room, other));
+        let (threads, _) = snapshot(acct, room);
+        assert_eq!(threads[0].root_id, "$other");
+        assert_eq!(threads[1].root_snippet, "the root");
+        assert_eq!(threads[1].latest_snippet, "second reply");
+        assert_eq!(threads[1].reply_count, 2);
+
+        forget_account(acct);
+    }
+
+    #[test]
+    fn test_snippet_truncates_on_char_boundary() {
+        let long = "é".repeat(150);
+        let s = snippet(&long);
+        assert_eq!(s.chars().count(), SNIPPET_CHARS);
+        assert!(s.ends_with("..."));
+    }
+}
@@ -0,0 +1,134 @@
+// Per-room typing-notification state machine.
+//
+// Pidgin reports every typing state change, and while typing re-reports it
+// on the first keypress after the resend interval the C side returns, which
+// keeps `last_input` fresh; only transitions reach the network. While typing, one task per room refreshes the notice just before
+// the server-side timeout the SDK requests (4s) would expire, and sends a
+// single "stopped" when the user goes idle, stops, or sends the message.
+// Repeated "typing" reports while already typing cost one map lookup.
+
+use std::time::{Duration, Instant};
+use dashmap::DashMap;
+use matrix_sdk::Room;
+use once_cell::sync::Lazy;
+use crate::RUNTIME;
+
+const REFRESH_INTERVAL: Duration = Duration::from_secs(3);
+const IDLE_TIMEOUT: Duration = Duration::from_secs(10);
+
+#[derive(Default)]
+struct TypingState {
+    typing: bool,
+    last_input: Option<Instant>,
+    // Bumped on every transition; a refresher exits once it no longer matches.
+    session: u64,
+}
+
+#[derive(Debug, PartialEq)]
+enum Action {
+    None,
+    Start(u64),
+    Stop,
+}
+
+// (account user_id, room_id) -> typing state
+static TYPING: Lazy<DashMap<(String, String), TypingState>> = Lazy::new(DashMap::new);
+
+fn room_key(room: &Room) -> (String, String) {
+    let user_id = room.client().user_id().map(|u| u.to_string()).unwrap_or_default();
+    (user_id, room.room_id().to_string())
+}
+
+fn transition(key: (String, String), typing: bool) -> Action {
+    let mut state = TYPING.entry(key).or_default();
+    if typing {
+        state.last_input = Some(Instant::now());
+        if state.typing {
+            return Action::None;
+        }
+        state.typing = true;
+        state.session += 1;
+        Action::Start(state.session)
+    } else {
+        if !state.typing {
+            return Action::None;
+        }
+        state.typing = false;
+        state.session += 1;
+        Action::Stop
+    }
+}
+
+// Records the user's typing state in `room`, touching the network only on a
+// transition.
+pub fn set_typing(room: &Room, typing: bool) {
+    let key = room_key(room);
+    match transition(key.clone(), typing) {
+        Action::None => {}
+        Action::Start(session) => {
+            crate::read_receipts::mark_latest(room);
+            RUNTIME.spawn(refresh(room.clone(), key, session));
+        }
+        Action::Stop => send_stop(room),
+    }
+}
+
+// Ends any typing notice in `room` because a message was just sent there.
+pub fn message_sent(room: &Room) {
+    if transition(room_key(room), false) == Action::Stop {
+        send_stop(room);
+    }
+}
+
+fn send_stop(room: &Room) {
+    let room = room.clone();
+    RUNTIME.spawn(async move {
+        if let Err(e) = room.typing_notice(false).await {
+            log::debug!("Failed to clear typing notice in {}: {:?}", room.room_id(), e);
+        }
+    });
+}
+
+async fn refresh(room: Room, key: (String, String), session: u64) {
+    loop {
+        if let Err(e) = room.typing_notice(true).await {
+            log::debug!("Failed to send typing notice in {}: {:?}", key.1, e);
+        }
+        tokio::time::sleep(REFRESH_INTERVAL).await;
+
+        let idle = {
+            let Some(mut state) = TYPING.get_mut(&key) else { return; };
+            if state.session != session {
+                return;
+            }
+            let idle = state.last_input.map(|t| t.elapsed() >= IDLE_TIMEOUT).unwrap_or(true);
+            if idle {
+                state.typing = false;
+                state.session += 1;
+            }
+            idle
+        };
+        if idle {
+            let _ = room.typing_notice(false).await;
+            return;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_only_transitions_produce_actions() {
+        let key = ("@me:example.org".to_string(), "!typing:example.org".to_string());
+        assert_eq!(transition(key.clone(), false), Action::None);
+        let Action::Start(first) = transition(key.clone(), true) else { panic!("expected start"); };
+        assert_eq!(transition(key.clone(), true), Action::None);
+        assert_eq!(transition(key.clone(), true), Action::None);
+        assert_eq!(transition(key.clone(), false), Action::Stop);
+        assert_eq!(transition(key.clone(), false), Action::None);
+        let Action::Start(second) = transition(key, true) else { panic!("expected start"); };
+        assert!(second > first);
+    }
+}
@@ -13,8 +13,8 @@ pub async fn handle_verification_request(client: Client, event: matrix_sdk::ruma
     log::info!("Received verification request from {} with flow {}", sender, flow_id);
 
     let event = crate::ffi::FfiEvent::SasRequest {
-        user_id: user_id,
-        target_user_id: sender.to_string(),
+        user_id: crate::intern::id(user_id),
+        target_user_id: crate::intern::id(sender),
         flow_id: flow_id.to_string(),
     };
     let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -36,8 +36,8 @@ pub async fn handle_sas_verification(sas: SasVerification, client: Client) {
 
         ACTIVE_SAS_FLOWS.insert(flow_id.clone(), sas.clone());
         let event = crate::ffi::FfiEvent::SasHaveEmoji {
-            user_id: user_id.clone(),
-            target_user_id: target.to_string(),
+            user_id: crate::intern::id(&user_id),
+            target_user_id: crate::intern::id(target),
             flow_id: flow_id.clone(),
             emojis: emoji_str,
         };
@@ -55,8 +55,8 @@ pub async fn handle_verification_change(verification: Verification, client: Clie
                 let html = format!("Scan this QR code in your other Matrix client to verify with {}: (QR data present)", target);
                 
                 let event = crate::ffi::FfiEvent::ShowVerificationQr {
-                    user_id: user_id.clone(),
-                    target_user_id: target.to_string(),
+                    user_id: crate::intern::id(&user_id),
+                    target_user_id: crate::intern::id(target),
                     html_data: html,
                 };
                 let _ = crate::ffi::EVENTS_CHANNEL.0.send(event);
@@ -0,0 +1,304 @@
+// Event dispatch microbenchmark.
+//
+// Replays a fixed-seed stream of FFI events (messages, typing, room joins,
+// read receipts) through poll_rust_channel_cb and the idle callbacks it
+// schedules (process_msg_cb, process_room_cb, ...), on top of the libpurple
+// mocks from unit_tests.c. Reports events/s and heap allocations per event
+// with libpurple verbose debugging off and on (the mock purple_debug_info
+// formats its arguments like the real one), and per-event latency
+// percentiles with it off.
+//
+//   make bench-c                      # 100000 events
+//   make bench-c BENCH_EVENTS=N
+//   make bench-c NO_VERBOSE_DEBUG=1   # verbose logging compiled out (rebuild)
+
+#define main matrix_unit_tests_main
+#include "unit_tests.c"
+#undef main
+
+#include "../plugin_src/matrix_dispatch.c"
+
+#include <stdlib.h>
+#include <time.h>
+
+// --- Allocation counting ---
+// The executable's malloc interposes on the one glib's g_malloc calls, so
+// every allocation made on the dispatch path passes through here.
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gboolean bench_counting = FALSE;
+static guint64 bench_allocs = 0;
+
+void *malloc(size_t size) {
+  if (bench_counting)
+    bench_allocs++;
+  return __libc_malloc(size);
+}
+void *calloc(size_t nmemb, size_t size) {
+  if (bench_counting)
+    bench_allocs++;
+  return __libc_calloc(nmemb, size);
+}
+void *realloc(void *ptr, size_t size) {
+  if (bench_counting)
+    bench_allocs++;
+  return __libc_realloc(ptr, size);
+}
+#define BENCH_HAVE_ALLOC_COUNT 1
+#else
+static gboolean bench_counting = FALSE;
+static guint64 bench_allocs = 0;
+#define BENCH_HAVE_ALLOC_COUNT 0
+#endif
+
+// --- Mocks for what the dispatch path needs beyond unit_tests.c ---
+
+void serv_got_typing(PurpleConnection *gc, const char *name, int timeout,
+                     PurpleTypingState state) {}
+void purple_blist_update_node_icon(PurpleBlistNode *node) {}
+void purple_matrix_rust_record_drain(guint64 micros, guint32 events) {}
+
+// --- Replayed stream ---
+
+typedef struct {
+  int type;
+  void *data;
+} BenchEvent;
+
+static BenchEvent *stream = NULL;
+static size_t stream_len = 0;
+static size_t stream_pos = 0;
+// poll_event stops here; the latency pass hands out one event per tick.
+static size_t stream_limit = 0;
+
+bool purple_matrix_rust_poll_event(int *out_type, void **out_data,
+                                   guint64 *out_span) {
+  if (stream_pos >= stream_limit)
+    return false;
+  *out_type = stream[stream_pos].type;
+  *out_data = stream[stream_pos].data;
+  *out_span = stream_pos + 1;
+  stream_pos++;
+  return true;
+}
+
+void purple_matrix_rust_free_event(int ev_type, void *data) {
+  switch (ev_type) {
+  case FFI_EVENT_MESSAGE_RECEIVED: {
+    CMessageReceived *s = data;
+    g_free(s->user_id);
+    g_free(s->sender);
+    g_free(s->msg);
+    g_free(s->room_id);
+    g_free(s->thread_root_id);
+    g_free(s->event_id);
+    break;
+  }
+  case FFI_EVENT_TYPING: {
+    CTyping *s = data;
+    g_free(s->user_id);
+    g_free(s->room_id);
+    g_free(s->who);
+    break;
+  }
+  case FFI_EVENT_ROOM_JOINED: {
+    CRoomJoined *s = data;
+    g_free(s->user_id);
+    g_free(s->room_id);
+    g_free(s->name);
+    g_free(s->group_name);
+    g_free(s->avatar_url);
+    g_free(s->topic);
+    break;
+  }
+  case FFI_EVENT_READ_MARKER: {
+    CReadMarker *s = data;
+    g_free(s->user_id);
+    g_free(s->room_id);
+    g_free(s->event_id);
+    g_free(s->who);
+    break;
+  }
+  }
+  g_free(data);
+}
+
+#define BENCH_SEED 0x2545F4914F6CDD1DULL
+#define BENCH_ROOMS 200
+// The mocks only have an open conversation for this room.
+#define BENCH_OPEN_ROOM "test_room_123"
+#define BENCH_USER "test_user"
+
+static const char *bench_bodies[] = {
+    "ok",
+    "see you tomorrow",
+    "<b>deploy</b> is done, <i>please</i> check the dashboards",
+    "has anyone looked at the flaky sync test? it failed twice tonight 🙈",
+    "<a href=\"https://example.org/issue/42\">#42</a> should be fixed now",
+    "🎉🎉🎉",
+    "<blockquote>quoted text</blockquote>agreed, let's ship it",
+    "a somewhat longer plain message that goes on for a while to look like "
+    "the kind of paragraph people paste into a busy room every so often",
+};
+
+static guint64 bench_rng(guint64 *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * BENCH_SEED;
+}
+
+static char *bench_room(guint64 *rng) {
+  return g_strdup_printf("!room%03u:example.org",
+                         (unsigned)(bench_rng(rng) % BENCH_ROOMS));
+}
+
+// Builds the stream: 70% messages (half into the open conversation), 10%
+// typing, 10% read receipts, 10% room joins. Same seed, same stream.
+static void build_stream(size_t n) {
+  guint64 rng = BENCH_SEED;
+  stream = g_new0(BenchEvent, n);
+  stream_len = n;
+  for (size_t i = 0; i < n; i++) {
+    guint64 pick = bench_rng(&rng) % 10;
+    if (pick < 7) {
+      CMessageReceived *s = g_new0(CMessageReceived, 1);
+      s->user_id = g_strdup(BENCH_USER);
+      s->sender = g_strdup_printf("@user%u:example.org",
+                                  (unsigned)(bench_rng(&rng) % 50));
+      s->msg = g_strdup(bench_bodies[bench_rng(&rng) %
+                                     G_N_ELEMENTS(bench_bodies)]);
+      s->room_id = (bench_rng(&rng) % 2) ? g_strdup(BENCH_OPEN_ROOM)
+                                         : bench_room(&rng);
+      if (bench_rng(&rng) % 8 == 0)
+        s->thread_root_id = g_strdup("$root:example.org");
+      s->event_id = g_strdup_printf("$ev%zu:example.org", i);
+      s->timestamp = 1700000000000ULL + i;
+      s->encrypted = bench_rng(&rng) % 2;
+      stream[i] = (BenchEvent){FFI_EVENT_MESSAGE_RECEIVED, s};
+    } else if (pick == 7) {
+      CTyping *s = g_new0(CTyping, 1);
+      s->user_id = g_strdup(BENCH_USER);
+      s->room_id = g_strdup(BENCH_OPEN_ROOM);
+      s->who = g_strdup_printf("@user%u:example.org",
+                               (unsigned)(bench_rng(&rng) % 50));
+      s->is_typing = bench_rng(&rng) % 2;
+      stream[i] = (BenchEvent){FFI_EVENT_TYPING, s};
+    } else if (pick == 8) {
+      CReadMarker *s = g_new0(CReadMarker, 1);
+      s->user_id = g_strdup(BENCH_USER);
+      s->room_id = g_strdup(BENCH_OPEN_ROOM);
+      s->event_id = g_strdup_printf("$ev%zu:example.org", i / 2);
+      s->who = g_strdup_printf("@user%u:example.org",
+                               (unsigned)(bench_rng(&rng) % 50));
+      stream[i] = (BenchEvent){FFI_EVENT_READ_MARKER, s};
+    } else {
+      CRoomJoined *s = g_new0(CRoomJoined, 1);
+      s->user_id = g_strdup(BENCH_USER);
+      s->room_id = bench_room(&rng);
+      s->name = g_strdup_printf("Room %s 🚀", s->room_id + 5);
+      s->group_name = g_strdup("Matrix Rooms");
+      s->avatar_url = g_strdup("");
+      s->topic = g_strdup("Topic of the day");
+      s->encrypted = bench_rng(&rng) % 2;
+      s->member_count = bench_rng(&rng) % 500;
+      stream[i] = (BenchEvent){FFI_EVENT_ROOM_JOINED, s};
+    }
+  }
+  stream_pos = 0;
+}
+
+static void free_stream(void) {
+  // Only events never handed out are still owned here.
+  for (size_t i = stream_pos; i < stream_len; i++)
+    purple_matrix_rust_free_event(stream[i].type, stream[i].data);
+  g_free(stream);
+  stream = NULL;
+  stream_len = stream_pos = stream_limit = 0;
+}
+
+static guint64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000000ULL + (guint64)ts.tv_nsec;
+}
+
+// One poll tick followed by the idle callbacks it queued, as the main loop
+// would run them.
+static void bench_tick(void) {
+  poll_rust_channel_cb(NULL);
+  while (g_main_context_iteration(NULL, FALSE))
+    ;
+}
+
+// Drains a fresh n-event stream with production batching; returns the
+// elapsed nanoseconds and stores the allocation count.
+static guint64 bench_throughput(size_t n, guint64 *allocs) {
+  build_stream(n);
+  stream_limit = stream_len;
+  bench_allocs = 0;
+  bench_counting = TRUE;
+  guint64 start = now_ns();
+  while (stream_pos < stream_len)
+    bench_tick();
+  guint64 elapsed = now_ns() - start;
+  bench_counting = FALSE;
+  *allocs = bench_allocs;
+  free_stream();
+  return elapsed;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  guint64 x = *(const guint64 *)a, y = *(const guint64 *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  if (n == 0)
+    n = 100000;
+
+  // Warm up the account cache, blist index and conversation data.
+  build_stream(1000);
+  stream_limit = stream_len;
+  while (stream_pos < stream_len)
+    bench_tick();
+  free_stream();
+
+  // Throughput and allocations, verbose debugging off (the default) and on.
+  guint64 allocs, allocs_verbose;
+  guint64 elapsed = bench_throughput(n, &allocs);
+  mock_debug_verbose = TRUE;
+  guint64 elapsed_verbose = bench_throughput(n, &allocs_verbose);
+  mock_debug_verbose = FALSE;
+
+  // Latency: one event per tick, dispatch through display.
+  build_stream(n);
+  guint64 *lat = g_new(guint64, n);
+  for (size_t i = 0; i < n; i++) {
+    stream_limit = i + 1;
+    guint64 t0 = now_ns();
+    bench_tick();
+    lat[i] = now_ns() - t0;
+  }
+  free_stream();
+  qsort(lat, n, sizeof(*lat), cmp_u64);
+
+  printf("events:      %zu (batches of %d)\n", n, MATRIX_DISPATCH_BUDGET);
+  printf("throughput:  %.0f events/s verbose off, %.0f events/s verbose on\n",
+         elapsed ? (double)n * 1e9 / (double)elapsed : 0.0,
+         elapsed_verbose ? (double)n * 1e9 / (double)elapsed_verbose : 0.0);
+  if (BENCH_HAVE_ALLOC_COUNT)
+    printf("allocations: %.2f per event verbose off, %.2f verbose on\n",
+           (double)allocs / (double)n, (double)allocs_verbose / (double)n);
+  else
+    printf("allocations: n/a (needs glibc)\n");
+  printf("latency:     p50 %.2f us, p99 %.2f us, max %.2f us\n",
+         lat[n / 2] / 1000.0, lat[(n * 99) / 100] / 1000.0,
+         lat[n - 1] / 1000.0);
+  g_free(lat);
+  return 0;
+}
@@ -0,0 +1,165 @@
+// End-to-end throughput against the offline mock homeserver.
+//
+// Logs in through purple_matrix_rust_login, so the real client build, sync
+// loop, handlers, send queue and history fetch run exactly as under Pidgin,
+// and reads FfiEvents off EVENTS_CHANNEL the way the C poll timer would.
+// Reports startup time (login to every room joined), sustained live message
+// throughput, send throughput and history paging time.
+//
+//   cargo test --release --test load -- --ignored --nocapture
+//   MOCK_HS_ROOMS=10000 MOCK_HS_RATE=500 MOCK_HS_ENCRYPTED_PCT=30 \
+//   LOAD_SECONDS=30 cargo test --release --test load -- --ignored --nocapture
+
+mod mock_homeserver;
+
+use std::collections::HashSet;
+use std::ffi::CString;
+use std::sync::atomic::Ordering;
+use std::time::{Duration, Instant};
+
+use mock_homeserver::{Config, MockHomeserver};
+use purple_matrix_rust::ffi::{FfiEvent, EVENTS_CHANNEL};
+
+#[derive(Default)]
+struct Seen {
+    connected: bool,
+    login_failed: Option<String>,
+    rooms: HashSet<String>,
+    live: u64,
+    history: u64,
+}
+
+fn drain(seen: &mut Seen) {
+    while let Ok(event) = EVENTS_CHANNEL.1.try_recv() {
+        match event {
+            FfiEvent::Connected { .. } => seen.connected = true,
+            FfiEvent::LoginFailed { message, .. } => seen.login_failed = Some(message),
+            FfiEvent::RoomJoined { room_id, .. } => { seen.rooms.insert(room_id.to_string()); }
+            FfiEvent::MessageReceived { event_id, .. } => {
+                if event_id.starts_with("$hist") {
+                    seen.history += 1;
+                } else if event_id.starts_with("$live") {
+                    seen.live += 1;
+                }
+            }
+            _ => {}
+        }
+    }
+}
+
+// Drains until `done` holds; false on timeout.
+fn wait_for(seen: &mut Seen, timeout: Duration, done: impl Fn(&Seen) -> bool) -> bool {
+    let deadline = Instant::now() + timeout;
+    loop {
+        drain(seen);
+        if let Some(msg) = &seen.login_failed {
+            panic!("login failed: {}", msg);
+        }
+        if done(seen) {
+            return true;
+        }
+        if Instant::now() >= deadline {
+            return false;
+        }
+        std::thread::sleep(Duration::from_millis(2));
+    }
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name).ok().and_then(|v| v.parse().ok()).unwrap_or(default)
+}
+
+fn cstr(s: &str) -> CString {
+    CString::new(s).expect("no interior NUL")
+}
+
+#[test]
+#[ignore = "load test: needs loopback sockets and runs for several seconds"]
+fn load_against_mock_homeserver() {
+    let cfg = Config::from_env();
+    let seconds: u64 = env_or("LOAD_SECONDS", 5);
+    let sends: u64 = env_or("LOAD_SENDS", 200);
+    let history_rooms = cfg.rooms.min(env_or("LOAD_HISTORY_ROOMS", 20));
+    let server = MockHomeserver::start(cfg.clone());
+
+    let data_dir = std::env::temp_dir().join(format!("purple-matrix-load-{}", std::process::id()));
+    let _ = std::fs::remove_dir_all(&data_dir);
+    std::fs::create_dir_all(&data_dir).expect("create data dir");
+
+    purple_matrix_rust::purple_matrix_rust_init();
+    let (user, pass) = (cstr("load"), cstr(mock_homeserver::PASSWORD));
+    let (hs, dir) = (cstr(&server.url), cstr(&data_dir.to_string_lossy()));
+
+    // Startup: login through initial sync until every room reached the UI.
+    let mut seen = Seen::default();
+    let started = Instant::now();
+    purple_matrix_rust::auth::purple_matrix_rust_login(user.as_ptr(), pass.as_ptr(), hs.as_ptr(), dir.as_ptr());
+    let rooms = cfg.rooms;
+    assert!(
+        wait_for(&mut seen, Duration::from_secs(300), |s| s.connected && s.rooms.len() >= rooms),
+        "startup timed out: connected={} rooms={}/{}", seen.connected, seen.rooms.len(), rooms
+    );
+    let startup = started.elapsed();
+
+    // Sustained live traffic.
+    let (live0, gen0) = (seen.live, server.stats().live_events.load(Ordering::Relaxed));
+    let window = Instant::now();
+    wait_for(&mut seen, Duration::from_secs(seconds), |_| false);
+    let window = window.elapsed().as_secs_f64();
+    let delivered = seen.live - live0;
+    let generated = server.stats().live_events.load(Ordering::Relaxed) - gen0;
+
+    // Sends through the per-room queues.
+    let user_id = cstr(mock_homeserver::USER_ID);
+    let sent0 = server.stats().sends.load(Ordering::Relaxed);
+    let send_start = Instant::now();
+    for i in 0..sends {
+        let room = cstr(&mock_homeserver::room_id(i as usize % rooms));
+        let text = cstr(&format!("load send {}", i));
+        purple_matrix_rust::ffi::messages::purple_matrix_rust_send_message(user_id.as_ptr(), room.as_ptr(), text.as_ptr());
+    }
+    let sent_ok = wait_for(&mut seen, Duration::from_secs(120), |_| {
+        server.stats().sends.load(Ordering::Relaxed) - sent0 >= sends
+    });
+    let send_time = send_start.elapsed().as_secs_f64();
+
+    // History: one page per room, until every event reached the channel.
+    let page = cfg.history_page.min(50) as u64;
+    let hist0 = seen.history;
+    let hist_start = Instant::now();
+    for i in 0..history_rooms {
+        let room = cstr(&mock_homeserver::room_id(i));
+        purple_matrix_rust::ffi::rooms::purple_matrix_rust_fetch_history(user_id.as_ptr(), room.as_ptr());
+    }
+    let expected = history_rooms as u64 * page;
+    let hist_ok = wait_for(&mut seen, Duration::from_secs(120), |s| s.history - hist0 >= expected);
+    let hist_time = hist_start.elapsed().as_secs_f64();
+
+    println!("rooms:      {} ({}% encrypted)", cfg.rooms, cfg.encrypted_pct);
+    println!("startup:    {:.2} s", startup.as_secs_f64());
+    println!(
+        "live:       {:.0} msg/s delivered ({} of {} generated in {:.1} s, target {} msg/s)",
+        delivered as f64 / window, delivered, generated, window, cfg.rate
+    );
+    println!(
+        "send:       {:.0} msg/s ({} messages{})",
+        sends as f64 / send_time, sends, if sent_ok { "" } else { ", TIMED OUT" }
+    );
+    println!(
+        "history:    {:.2} s for {} rooms x {} events{}",
+        hist_time, history_rooms, page, if hist_ok { "" } else { ", TIMED OUT" }
+    );
+    println!(
+        "server:     {} syncs, {} history pages, {} media downloads",
+        server.stats().syncs.load(Ordering::Relaxed),
+        server.stats().history_pages.load(Ordering::Relaxed),
+        server.stats().media.load(Ordering::Relaxed)
+    );
+
+    let _ = std::fs::remove_dir_all(&data_dir);
+    if cfg.rate > 0.0 {
+        assert!(delivered > 0, "no live messages reached the event channel");
+    }
+    assert!(sent_ok, "sends did not reach the homeserver");
+    assert!(hist_ok, "history did not reach the event channel");
+}
@@ -0,0 +1,411 @@
+// Offline homeserver stand-in for load tests.
+//
+// Serves just enough of the client-server API for the real login, sync,
+// history, send, media and key paths: one synthetic account in `rooms` rooms,
+// a live stream of `rate` messages per second spread over those rooms, and a
+// share of encrypted rooms whose events carry undecryptable Megolm payloads.
+// Every request is answered on its own thread so long-polled /sync never
+// holds up the rest.
+
+#![allow(dead_code)]
+
+use std::io::Read;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+use serde_json::{json, Value};
+
+pub const USER_ID: &str = "@load:localhost";
+pub const PASSWORD: &str = "load";
+const DEVICE_ID: &str = "LOADDEVICE";
+const PEERS: usize = 8;
+// Upper bound on live events per /sync response.
+const MAX_BATCH: u64 = 1000;
+
+// 1x1 transparent PNG for every media download.
+const PNG: &[u8] = &[
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0x15, 0xc4,
+    0x89, 0x00, 0x00, 0x00, 0x0a, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9c, 0x63, 0x00, 0x01, 0x00, 0x00,
+    0x05, 0x00, 0x01, 0x0d, 0x0a, 0x2d, 0xb4, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae,
+    0x42, 0x60, 0x82,
+];
+
+#[derive(Clone, Debug)]
+pub struct Config {
+    pub rooms: usize,
+    // Live messages per second, across all rooms.
+    pub rate: f64,
+    // Share of rooms (0-100) with m.room.encryption.
+    pub encrypted_pct: usize,
+    // Timeline events per room in the initial sync.
+    pub initial_messages: usize,
+    // Events per /messages page.
+    pub history_page: usize,
+}
+
+impl Default for Config {
+    fn default() -> Self {
+        Config { rooms: 10, rate: 50.0, encrypted_pct: 0, initial_messages: 5, history_page: 50 }
+    }
+}
+
+fn env_or<T: std::str::FromStr>(name: &str, default: T) -> T {
+    std::env::var(name).ok().and_then(|v| v.parse().ok()).unwrap_or(default)
+}
+
+impl Config {
+    // MOCK_HS_ROOMS, MOCK_HS_RATE, MOCK_HS_ENCRYPTED_PCT, MOCK_HS_INITIAL,
+    // MOCK_HS_HISTORY_PAGE override the defaults.
+    pub fn from_env() -> Self {
+        let d = Config::default();
+        Config {
+            rooms: env_or("MOCK_HS_ROOMS", d.rooms).clamp(1, 10_000),
+            rate: env_or("MOCK_HS_RATE", d.rate).max(0.0),
+            encrypted_pct: env_or("MOCK_HS_ENCRYPTED_PCT", d.encrypted_pct).min(100),
+            initial_messages: env_or("MOCK_HS_INITIAL", d.initial_messages),
+            history_page: env_or("MOCK_HS_HISTORY_PAGE", d.history_page).max(1),
+        }
+    }
+}
+
+pub fn room_id(i: usize) -> String {
+    format!("!load{}:localhost", i)
+}
+
+#[derive(Default)]
+pub struct Stats {
+    pub syncs: AtomicU64,
+    pub live_events: AtomicU64,
+    pub sends: AtomicU64,
+    pub history_pages: AtomicU64,
+    pub media: AtomicU64,
+}
+
+struct State {
+    cfg: Config,
+    stats: Stats,
+    // Set by the first incremental /sync; live messages are due from then on.
+    live_since: Mutex<Option<Instant>>,
+    // Sent events waiting to be echoed back: (room index, event).
+    echoes: Mutex<Vec<(usize, Value)>>,
+    next_event: AtomicU64,
+}
+
+pub struct MockHomeserver {
+    pub url: String,
+    server: Arc<tiny_http::Server>,
+    state: Arc<State>,
+}
+
+impl MockHomeserver {
+    pub fn start(cfg: Config) -> Self {
+        let server = Arc::new(tiny_http::Server::http("127.0.0.1:0").expect("bind mock homeserver"));
+        let port = server.server_addr().to_ip().expect("tcp listener").port();
+        let state = Arc::new(State {
+            cfg,
+            stats: Stats::default(),
+            live_since: Mutex::new(None),
+            echoes: Mutex::new(Vec::new()),
+            next_event: AtomicU64::new(0),
+        });
+        let (srv, st) = (server.clone(), state.clone());
+        std::thread::Builder::new()
+            .name("mock-homeserver".to_string())
+            .spawn(move || {
+                for request in srv.incoming_requests() {
+                    let st = st.clone();
+                    std::thread::spawn(move || handle(&st, request));
+                }
+            })
+            .expect("spawn mock homeserver");
+        MockHomeserver { url: format!("http://127.0.0.1:{}", port), server, state }
+    }
+
+    pub fn stats(&self) -> &Stats {
+        &self.state.stats
+    }
+}
+
+impl Drop for MockHomeserver {
+    fn drop(&mut self) {
+        self.server.unblock();
+    }
+}
+
+fn now_ms() -> u64 {
+    SystemTime::now().duration_since(UNIX_EPOCH).map(|d| d.as_millis() as u64).unwrap_or(0)
+}
+
+fn percent_decode(s: &str) -> String {
+    let bytes = s.as_bytes();
+    let mut out = Vec::with_capacity(bytes.len());
+    let mut i = 0;
+    while i < bytes.len() {
+        if bytes[i] == b'%' && i + 2 < bytes.len() {
+            let hex = std::str::from_utf8(&bytes[i + 1..i + 3]).ok();
+            if let Some(b) = hex.and_then(|h| u8::from_str_radix(h, 16).ok()) {
+                out.push(b);
+                i += 3;
+                continue;
+            }
+        }
+        out.push(bytes[i]);
+        i += 1;
+    }
+    String::from_utf8_lossy(&out).into_owned()
+}
+
+fn json_response(status: u16, body: &Value) -> tiny_http::Response<std::io::Cursor<Vec<u8>>> {
+    let header = tiny_http::Header::from_bytes(&b"Content-Type"[..], &b"application/json"[..]).expect("static header");
+    tiny_http::Response::from_data(body.to_string().into_bytes())
+        .with_status_code(status)
+        .with_header(header)
+}
+
+fn not_found() -> tiny_http::Response<std::io::Cursor<Vec<u8>>> {
+    json_response(404, &json!({"errcode": "M_UNRECOGNIZED", "error": "Not served by the mock homeserver"}))
+}
+
+fn handle(state: &State, mut request: tiny_http::Request) {
+    let url = request.url().to_string();
+    let (path, query) = url.split_once('?').unwrap_or((url.as_str(), ""));
+    let params: Vec<(String, String)> = url::form_urlencoded::parse(query.as_bytes()).into_owned().collect();
+    let param = |k: &str| params.iter().find(|(n, _)| n == k).map(|(_, v)| v.clone());
+    let segments: Vec<String> = path.trim_start_matches('/').split('/').map(percent_decode).collect();
+    let seg: Vec<&str> = segments.iter().map(|s| s.as_str()).collect();
+    let method = request.method().as_str().to_string();
+
+    let mut body = String::new();
+    let _ = request.as_reader().read_to_string(&mut body);
+
+    let is_media = (seg.len() >= 2 && seg[0] == "_matrix" && seg[1] == "media")
+        || seg.iter().any(|s| *s == "download" || *s == "thumbnail");
+    if is_media {
+        state.stats.media.fetch_add(1, Ordering::Relaxed);
+        let header = tiny_http::Header::from_bytes(&b"Content-Type"[..], &b"image/png"[..]).expect("static header");
+        let _ = request.respond(tiny_http::Response::from_data(PNG.to_vec()).with_header(header));
+        return;
+    }
+
+    // Everything else lives under /_matrix/client/{version}/...
+    let api: Vec<&str> = if seg.len() >= 3 && seg[0] == "_matrix" && seg[1] == "client" {
+        if seg[2] == "versions" { vec!["versions"] } else { seg[3..].to_vec() }
+    } else {
+        let _ = request.respond(not_found());
+        return;
+    };
+
+    let response = match (method.as_str(), api.as_slice()) {
+        ("GET", ["versions"]) => json_response(200, &json!({
+            "versions": ["v1.1", "v1.2", "v1.3", "v1.4", "v1.5", "v1.6", "v1.7", "v1.8", "v1.9", "v1.10", "v1.11"],
+            "unstable_features": {}
+        })),
+        ("GET", ["login"]) => json_response(200, &json!({"flows": [{"type": "m.login.password"}]})),
+        ("POST", ["login"]) => json_response(200, &json!({
+            "user_id": USER_ID, "access_token": "mock_access_token", "device_id": DEVICE_ID, "home_server": "localhost"
+        })),
+        ("GET", ["account", "whoami"]) => json_response(200, &json!({"user_id": USER_ID, "device_id": DEVICE_ID})),
+        ("POST", ["user", _, "filter"]) => json_response(200, &json!({"filter_id": "load"})),
+        ("GET", ["capabilities"]) => json_response(200, &json!({"capabilities": {}})),
+        ("GET", ["pushrules", ..]) => json_response(200, &json!({
+            "global": {"override": [], "content": [], "room": [], "sender": [], "underride": []}
+        })),
+        ("GET", ["profile", user, ..]) => json_response(200, &json!({"displayname": user.trim_start_matches('@')})),
+        ("GET", ["sync"]) => json_response(200, &sync(state, param("since"), param("timeout"))),
+        ("GET", ["rooms", room, "messages"]) => json_response(200, &messages(state, room, param("from"), param("limit"))),
+        ("PUT", ["rooms", room, "send", ev_type, txn]) => json_response(200, &send(state, room, ev_type, txn, &body)),
+        ("GET", ["rooms", room, "members"]) => json_response(200, &json!({"chunk": members(room)})),
+        ("GET", ["rooms", _, "joined_members"]) => json_response(200, &json!({"joined": {USER_ID: {}}})),
+        ("PUT", ["rooms", _, "typing", _]) | ("POST", ["rooms", _, "receipt", ..]) | ("POST", ["rooms", _, "read_markers"]) => {
+            json_response(200, &json!({}))
+        }
+        ("POST", ["keys", "upload"]) => json_response(200, &json!({"one_time_key_counts": {"signed_curve25519": 50}})),
+        ("POST", ["keys", "query"]) => json_response(200, &json!({"device_keys": {}, "failures": {}})),
+        ("POST", ["keys", "claim"]) => json_response(200, &json!({"one_time_keys": {}, "failures": {}})),
+        ("POST", ["keys", "device_signing", "upload"]) => json_response(200, &json!({})),
+        ("POST", ["keys", "signatures", "upload"]) => json_response(200, &json!({"failures": {}})),
+        ("PUT", ["sendToDevice", ..]) => json_response(200, &json!({})),
+        ("GET", ["room_keys", "version"]) => json_response(404, &json!({"errcode": "M_NOT_FOUND", "error": "No backup"})),
+        ("PUT", ["user", _, "account_data", _]) => json_response(200, &json!({})),
+        _ => not_found(),
+    };
+    let _ = request.respond(response);
+}
+
+fn room_index(room: &str) -> Option<usize> {
+    room.strip_prefix("!load")?.strip_suffix(":localhost")?.parse().ok()
+}
+
+fn is_encrypted(cfg: &Config, room: usize) -> bool {
+    room % 100 < cfg.encrypted_pct
+}
+
+fn peer(n: u64) -> String {
+    format!("@peer{}:localhost", n % PEERS as u64)
+}
+
+fn state_event(ev_type: &str, state_key: &str, content: Value, n: usize) -> Value {
+    json!({
+        "type": ev_type, "state_key": state_key, "content": content, "sender": USER_ID,
+        "event_id": format!("$state{}_{}:localhost", n, ev_type), "origin_server_ts": 1_600_000_000_000u64,
+    })
+}
+
+fn members(room: &str) -> Vec<Value> {
+    let n = room_index(room).unwrap_or(0);
+    let mut out = vec![state_event("m.room.member", USER_ID, json!({"membership": "join"}), n)];
+    for p in 0..PEERS as u64 {
+        let id = peer(p);
+        out.push(state_event("m.room.member", &id, json!({"membership": "join"}), n));
+    }
+    out
+}
+
+// A message from a peer; encrypted rooms get a Megolm event nobody can
+// decrypt, every 50th plaintext message is an image.
+fn message_event(cfg: &Config, room: usize, prefix: &str, n: u64, ts: u64) -> Value {
+    let event_id = format!("${}{}:localhost", prefix, n);
+    if is_encrypted(cfg, room) {
+        return json!({
+            "type": "m.room.encrypted", "event_id": event_id, "sender": peer(n), "origin_server_ts": ts,
+            "content": {
+                "algorithm": "m.megolm.v1.aes-sha2", "ciphertext": "AwgAEnB1cnBsZS1tYXRyaXgtbG9hZA",
+                "device_id": "PEERDEVICE", "sender_key": "c2VuZGVyLWtleS1mb3ItbG9hZC10ZXN0cw",
+                "session_id": format!("session{}", room),
+            }
+        });
+    }
+    let content = if n % 50 == 0 {
+        json!({"msgtype": "m.image", "body": format!("image{}.png", n), "url": format!("mxc://localhost/img{}", n),
+               "info": {"mimetype": "image/png", "size": PNG.len(), "w": 1, "h": 1}})
+    } else if n % 7 == 0 {
+        json!({"msgtype": "m.text", "body": format!("**update {}** see https://example.org/{}", n, n),
+               "format": "org.matrix.custom.html",
+               "formatted_body": format!("<b>update {}</b> see <a href=\"https://example.org/{}\">example.org</a>", n, n)})
+    } else {
+        json!({"msgtype": "m.text", "body": format!("load message {} in room {}", n, room)})
+    };
+    json!({"type": "m.room.message", "event_id": event_id, "sender": peer(n), "origin_server_ts": ts, "content": content})
+}
+
+fn initial_sync(state: &State) -> Value {
+    let cfg = &state.cfg;
+    let mut join = serde_json::Map::new();
+    let ts = now_ms();
+    for i in 0..cfg.rooms {
+        let mut st = vec![
+            state_event("m.room.create", "", json!({"creator": USER_ID, "room_version": "10"}), i),
+            state_event("m.room.name", "", json!({"name": format!("Load room {}", i)}), i),
+            state_event("m.room.topic", "", json!({"topic": "Synthetic load"}), i),
+            state_event("m.room.power_levels", "", json!({"users": {USER_ID: 100}}), i),
+        ];
+        st.extend(members(&room_id(i)));
+        if is_encrypted(cfg, i) {
+            st.push(state_event("m.room.encryption", "", json!({"algorithm": "m.megolm.v1.aes-sha2"}), i));
+        }
+        let timeline: Vec<Value> = (0..cfg.initial_messages as u64)
+            .map(|k| message_event(cfg, i, &format!("init{}_", i), k, ts - 1000 + k))
+            .collect();
+        join.insert(room_id(i), json!({
+            "state": {"events": st},
+            "timeline": {"events": timeline, "limited": true, "prev_batch": format!("p{}_0", i)},
+            "ephemeral": {"events": []},
+            "account_data": {"events": []},
+            "unread_notifications": {"highlight_count": 0, "notification_count": 0},
+            "summary": {"m.joined_member_count": PEERS + 1, "m.invited_member_count": 0},
+        }));
+    }
+    json!({
+        "next_batch": "s0",
+        "rooms": {"join": join},
+        "presence": {"events": []},
+        "account_data": {"events": []},
+        "to_device": {"events": []},
+        "device_lists": {"changed": [], "left": []},
+        "device_one_time_keys_count": {"signed_curve25519": 50},
+    })
+}
+
+fn sync(state: &State, since: Option<String>, timeout: Option<String>) -> Value {
+    state.stats.syncs.fetch_add(1, Ordering::Relaxed);
+    let Some(since) = since else { return initial_sync(state); };
+    let batch: u64 = since.trim_start_matches('s').parse().unwrap_or(0);
+    let started = *state.live_since.lock().unwrap().get_or_insert_with(Instant::now);
+    let timeout = Duration::from_millis(timeout.and_then(|t| t.parse().ok()).unwrap_or(30_000)).min(Duration::from_secs(30));
+    let polled = Instant::now();
+
+    // Long-poll until a live message is due, an echo is waiting or time is up.
+    let due = loop {
+        let due = (started.elapsed().as_secs_f64() * state.cfg.rate) as u64;
+        let emitted = state.stats.live_events.load(Ordering::Relaxed);
+        if due > emitted || !state.echoes.lock().unwrap().is_empty() || polled.elapsed() >= timeout {
+            break due;
+        }
+        std::thread::sleep(Duration::from_millis(5));
+    };
+
+    let mut rooms: std::collections::BTreeMap<usize, Vec<Value>> = Default::default();
+    let ts = now_ms();
+    let emitted = state.stats.live_events.load(Ordering::Relaxed);
+    let count = due.saturating_sub(emitted).min(MAX_BATCH);
+    for _ in 0..count {
+        let n = state.next_event.fetch_add(1, Ordering::Relaxed);
+        let room = (n as usize * 7919) % state.cfg.rooms;
+        rooms.entry(room).or_default().push(message_event(&state.cfg, room, "live", n, ts));
+    }
+    state.stats.live_events.fetch_add(count, Ordering::Relaxed);
+    for (room, ev) in state.echoes.lock().unwrap().drain(..) {
+        rooms.entry(room).or_default().push(ev);
+    }
+
+    let mut join = serde_json::Map::new();
+    for (room, events) in rooms {
+        join.insert(room_id(room), json!({"timeline": {"events": events, "limited": false}}));
+    }
+    json!({
+        "next_batch": format!("s{}", batch + 1),
+        "rooms": {"join": join},
+        "device_one_time_keys_count": {"signed_curve25519": 50},
+    })
+}
+
+// Back-pagination: pages of `history_page` events, numbered per room so a
+// token always yields the same page.
+fn messages(state: &State, room: &str, from: Option<String>, limit: Option<String>) -> Value {
+    state.stats.history_pages.fetch_add(1, Ordering::Relaxed);
+    let Some(i) = room_index(room) else { return json!({"chunk": [], "start": ""}); };
+    let page: u64 = from.as_deref()
+        .and_then(|t| t.rsplit('_').next())
+        .and_then(|p| p.parse().ok())
+        .unwrap_or(0);
+    let limit = limit.and_then(|l| l.parse::<usize>().ok()).unwrap_or(10).min(state.cfg.history_page) as u64;
+    let base_ts = 1_600_000_000_000u64;
+    let chunk: Vec<Value> = (0..limit)
+        .map(|k| {
+            // Newest first, walking back.
+            let n = page * 1000 + k;
+            message_event(&state.cfg, i, &format!("hist{}_", i), n, base_ts - n * 1000)
+        })
+        .collect();
+    json!({
+        "chunk": chunk,
+        "start": from.unwrap_or_else(|| format!("p{}_0", i)),
+        "end": format!("p{}_{}", i, page + 1),
+    })
+}
+
+fn send(state: &State, room: &str, ev_type: &str, txn: &str, body: &str) -> Value {
+    state.stats.sends.fetch_add(1, Ordering::Relaxed);
+    let n = state.next_event.fetch_add(1, Ordering::Relaxed);
+    let event_id = format!("$sent{}:localhost", n);
+    if let Some(i) = room_index(room) {
+        let content: Value = serde_json::from_str(body).unwrap_or_else(|_| json!({}));
+        state.echoes.lock().unwrap().push((i, json!({
+            "type": ev_type, "event_id": event_id, "sender": USER_ID, "origin_server_ts": now_ms(),
+            "content": content, "unsigned": {"transaction_id": txn},
+        })));
+    }
+    json!({"event_id": event_id})
+}
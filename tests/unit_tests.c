@@ -32,7 +32,17 @@ GHashTable *mock_blist_chats = NULL;
 
 // --- Mocks for Libpurple Functions (needed by plugin.c) ---
 
-void purple_debug_info(const char *cat, const char *format, ...) {}
+// Formats like the real one (output dropped) so the dispatch bench pays for
+// what it logs; verbose is off unless the bench turns it on.
+gboolean mock_debug_verbose = FALSE;
+void purple_debug_info(const char *cat, const char *format, ...) {
+  char buf[1024];
+  va_list args;
+  va_start(args, format);
+  g_vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+}
+gboolean purple_debug_is_verbose(void) { return mock_debug_verbose; }
 
 void purple_debug_error(const char *cat, const char *format, ...) {
   va_list args;
@@ -377,6 +387,10 @@ void purple_buddy_icons_set_for_user(PurpleAccount *account, const char *who,
 gconstpointer purple_imgstore_get_data(PurpleStoredImage *i) { return NULL; }
 size_t purple_imgstore_get_size(PurpleStoredImage *i) { return 0; }
 PurpleStoredImage *purple_imgstore_find_by_id(int id) { return NULL; }
+const char *purple_imgstore_get_filename(const PurpleStoredImage *i) {
+  return NULL;
+}
+const char *purple_imgstore_get_extension(PurpleStoredImage *i) { return NULL; }
 PurpleConversation *serv_got_joined_chat(PurpleConnection *gc, int id,
                                          const char *name) {
   return NULL;
@@ -434,6 +448,12 @@ void purple_matrix_rust_send_message(const char *user_id, const char *room_id,
                                      const char *text) {
   printf("[Rust Mock] send_message: %s -> %s\n", room_id, text);
 }
+void purple_matrix_rust_send_message_txn(const char *user_id,
+                                         const char *room_id, const char *text,
+                                         const char *txn_id) {
+  printf("[Rust Mock] send_message_txn: %s -> %s (%s)\n", room_id, text,
+         txn_id);
+}
 void purple_matrix_rust_send_typing(const char *user_id, const char *room_id,
                                     bool is_typing) {}
 void purple_matrix_rust_join_room(const char *user_id, const char *room_id) {}
@@ -536,6 +556,13 @@ void purple_matrix_rust_set_room_mute_state(const char *user_id,
 void purple_matrix_rust_destroy_session(const char *user_id) {}
 void purple_matrix_rust_send_file(const char *user_id, const char *room_id,
                                   const char *filename) {}
+void purple_matrix_rust_send_image_bytes(const char *user_id,
+                                         const char *room_id,
+                                         const char *filename,
+                                         const unsigned char *data,
+                                         size_t size) {}
+void purple_matrix_rust_set_upload_max_image_dim(const char *user_id,
+                                                 guint32 max_dim) {}
 void purple_matrix_rust_send_reply(const char *user_id, const char *room_id,
                                    const char *event_id, const char *text) {}
 void purple_matrix_rust_send_edit(const char *user_id, const char *room_id,
@@ -671,9 +698,9 @@ void test_matrix_room_activity_signal() {
 
   // Construct dummy incoming message
   MatrixMsgData *msg = g_new0(MatrixMsgData, 1);
-  msg->user_id = g_strdup("test_user"); // matches purple_account_get_username
-  msg->room_id = g_strdup("test_room_123");
-  msg->sender = g_strdup("@alice:matrix.org");
+  msg->user_id = g_intern_string("test_user"); // matches purple_account_get_username
+  msg->room_id = g_intern_string("test_room_123");
+  msg->sender = g_intern_string("@alice:matrix.org");
   msg->message = g_strdup("<b>Hello World</b>");
   msg->event_id = g_strdup("$event_test");
   msg->timestamp = 1000;
@@ -708,6 +735,32 @@ void test_matrix_mute_state() {
   g_assert_null(val);
 }
 
+void test_matrix_local_echo_rekey() {
+  PurpleConversation *conv = purple_find_conversation_with_account_mock(
+      PURPLE_CONV_TYPE_CHAT, "test_room_123", NULL);
+  char *txn_id = matrix_new_txn_id();
+  char *other = matrix_new_txn_id();
+
+  g_assert_cmpstr(txn_id, !=, other);
+
+  matrix_record_recent_event(conv, txn_id, "test_user", "hello", NULL, FALSE,
+                             1000);
+  matrix_record_recent_event(conv, "$later:example.org", "@bob:example.org",
+                             "hi", NULL, FALSE, 2000);
+
+  g_assert_false(matrix_rekey_recent_event(conv, other, "$nope:example.org"));
+  g_assert_true(matrix_rekey_recent_event(conv, txn_id, "$mine:example.org"));
+  g_assert_cmpstr(
+      purple_conversation_get_data(conv, "matrix_recent_event_id_1"), ==,
+      "$mine:example.org");
+  g_assert_cmpstr(
+      purple_conversation_get_data(conv, "matrix_recent_event_id_0"), ==,
+      "$later:example.org");
+
+  g_free(txn_id);
+  g_free(other);
+}
+
 // Global hash table to mock conversation data
 GHashTable *mock_conv_data = NULL;
 
@@ -763,6 +816,57 @@ void test_matrix_inspector_state_memory() {
   g_assert_null(updated);
 }
 
+void test_matrix_account_lookup_exact() {
+  PurpleAccount *account = find_matrix_account();
+  g_assert_nonnull(account);
+
+  // Mock username is "test_user": full id and MXID localpart both resolve
+  g_assert_true(find_matrix_account_by_id("test_user") == account);
+  g_assert_true(find_matrix_account_by_id("@test_user:example.org") == account);
+
+  // Substrings no longer match in either direction
+  g_assert_null(find_matrix_account_by_id("@test_user2:example.org"));
+  g_assert_null(find_matrix_account_by_id("@test_use:example.org"));
+
+  // Both successful lookups were cached; they go away with the account
+  g_assert_true(g_hash_table_lookup(account_by_id, "@test_user:example.org") ==
+                account);
+  g_assert_true(g_hash_table_lookup(account_by_id, "test_user") == account);
+  matrix_forget_account_id(account);
+  g_assert_null(g_hash_table_lookup(account_by_id, "@test_user:example.org"));
+  g_assert_null(g_hash_table_lookup(account_by_id, "test_user"));
+}
+
+void test_matrix_room_snapshot_diff() {
+  MatrixRoomSnapshot *snap = g_new0(MatrixRoomSnapshot, 1);
+  MatrixRoomData full = {.name = "Room", .group_name = "Matrix Rooms",
+                         .avatar_url = "/tmp/avatar", .topic = "Topic",
+                         .encrypted = TRUE, .member_count = 3,
+                         .fields = MATRIX_ROOM_FIELD_ALL};
+
+  g_assert_cmpuint(room_snapshot_merge(snap, &full), ==, MATRIX_ROOM_FIELD_ALL);
+  // Identical RoomJoined (e.g. the post-avatar resend) is a no-op
+  g_assert_cmpuint(room_snapshot_merge(snap, &full), ==, 0);
+
+  // Tag updates only touch the group and leave the rest alone
+  MatrixRoomData tag = {.group_name = "Favourites",
+                        .fields = MATRIX_ROOM_FIELD_GROUP};
+  g_assert_cmpuint(room_snapshot_merge(snap, &tag), ==,
+                   MATRIX_ROOM_FIELD_GROUP);
+  g_assert_true(snap->encrypted);
+  g_assert_cmpstr(snap->name, ==, "Room");
+
+  room_snapshot_free(snap);
+}
+
+void test_matrix_send_typing_resend() {
+  // Pidgin only re-reports typing if asked to; stopping needs no resend
+  g_assert_cmpuint(matrix_send_typing(NULL, "@bob:example.org", PURPLE_TYPING),
+                   ==, MATRIX_TYPING_RESEND_SECS);
+  g_assert_cmpuint(
+      matrix_send_typing(NULL, "@bob:example.org", PURPLE_NOT_TYPING), ==, 0);
+}
+
 int main(int argc, char **argv) {
   g_test_init(&argc, &argv, NULL);
   g_test_add_func("/matrix/get_chat_name", test_matrix_get_chat_name);
@@ -781,6 +885,14 @@ int main(int argc, char **argv) {
   g_test_add_func("/matrix/ui/room_activity_signal",
                   test_matrix_room_activity_signal);
   g_test_add_func("/matrix/ui/mute_state", test_matrix_mute_state);
+  g_test_add_func("/matrix/account_lookup_exact",
+                  test_matrix_account_lookup_exact);
+  g_test_add_func("/matrix/chat/local_echo_rekey",
+                  test_matrix_local_echo_rekey);
+  g_test_add_func("/matrix/blist/room_snapshot_diff",
+                  test_matrix_room_snapshot_diff);
+  g_test_add_func("/matrix/chat/send_typing_resend",
+                  test_matrix_send_typing_resend);
   return g_test_run();
 }
 // Additional Libpurple Mocks
@@ -843,6 +955,13 @@ void purple_matrix_rust_who_read(const char *user_id, const char *room_id) {}
 void purple_matrix_rust_get_supported_versions(const char *user_id) {}
 void purple_matrix_rust_get_my_profile(const char *user_id) {}
 void purple_matrix_rust_get_server_info(const char *user_id) {}
+void purple_matrix_rust_get_perf_stats(const char *user_id) {}
+bool purple_matrix_rust_replay_events(const char *user_id, const char *path,
+                                      double speed) {
+  return false;
+}
+void purple_matrix_rust_trace_event(guint64 span, int stage) {}
+bool purple_matrix_rust_set_log_filter(const char *directives) { return TRUE; }
 void purple_matrix_rust_resync_recent_history(const char *user_id,
                                               const char *room_id) {}
 void purple_matrix_rust_search_stickers(const char *user_id,